@@ -3,10 +3,10 @@
 
 //#define RES_MY_RES			CINDER_RESOURCE( ../resources/, image_name.png, 128, IMAGE )
 
-
-
-
-
-
-
-
+
+
+
+
+
+
+
@@ -1,5 +1,5 @@
-#include "status.h"
-
-namespace cs {
-
-} // namespace cs
+#include "status.h"
+
+namespace cs {
+
+} // namespace cs
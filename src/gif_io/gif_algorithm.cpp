@@ -1,181 +1,907 @@
-#include "gif_algorithm.h"
-
-#include <algorithm>
-#include <unordered_map>
-
-namespace gif {
-
-namespace {
-void		rgb_to_hsv(const gif::ColorA8u&, double &h, double &s, double &v);
-}
-
-/**
- * @class gif::BitmapToPaletteDefault
- * @brief Default implementation, currently simple clamp that finds the most-used colors.
- */
-class BitmapToPaletteDefault : public BitmapToPalette {
-public:
-	BitmapToPaletteDefault() { }
-
-	void			convert(const gif::Bitmap &src, const size_t max_size, gif::Palette &out) override {
-		out.mColors.clear();
-		if (src.empty()) return;
-
-		// Simple utility to find all colors and eliminate based on a similarity until we're down to our max size.
-		std::unordered_map<gif::ColorA8u, size_t>	ct;
-		for (const auto& pix : src.mPixels) {
-			const gif::ColorA8u		sc = gif::ColorA8u(pix.r, pix.g, pix.b, 255);
-			ct[sc]++;
-		}
-
-		// For now, just clip based the most-used colors. CLEARLY THIS NEEDS TO CHANGE
-		using Counter = std::pair<gif::ColorA8u, size_t>;
-		std::vector<Counter>						vec;
-		for (const auto& p : ct) vec.push_back(Counter(p.first, p.second));
-		std::sort(vec.begin(), vec.end(), [](const Counter &a, const Counter &b)->bool{return a.second > b.second;});
-		if (vec.size() > max_size) vec.resize(max_size);
-		out.mColors.reserve(max_size);
-		for (const auto& p : vec) out.mColors.push_back(p.first);
-	}
-};
-
-BitmapToPaletteRef BitmapToPalette::create() {
-	return std::make_shared<BitmapToPaletteDefault>();
-}
-
-/**
- * @class gif::ToColorIndexDefault
- * @brief Given a palette, find the nearest color match to each incoming color.
- * @description Convert an RGB palette to HSV values and find the nearest.
- */
-class ToColorIndexDefault : public ToColorIndex {
-public:
-	ToColorIndexDefault() { }
-	ToColorIndexDefault(const double weight_hue, const double weight_saturation, const double weight_value)
-		: mWeightHue(weight_hue), mWeightSat(weight_saturation), mWeightVal(weight_value) { }
-
-	void		setTo(const gif::Palette &pal) override {
-		mColors.clear();
-		for (const auto& c : pal.mColors) {
-			HSV			hsv;
-			rgb_to_hsv(c, hsv.h, hsv.s, hsv.v);
-			mColors.push_back(Lookup(hsv, c));
-		}
-	}
-
-	size_t		match(const gif::ColorA8u &c) const override {
-		// Pulled from
-		// https://social.msdn.microsoft.com/Forums/windows/en-us/105206d5-f7f7-4848-a32e-2b5cc10dc56f/how-to-find-the-nearest-matching-color-?forum=winforms
-		// XXX Although not using that currently, I must have introduced a bug, simple RGB comparison right now.
-
-		double			minDistance = std::numeric_limits<double>::max();
-		size_t			index = 0, ci = 0;
-		double			h, s, v;
-		rgb_to_hsv(c, h, s, v);
-		float			new_d = 255.0f * 4.0f;
-		size_t			new_i = 0;
-		for (const auto& p : mColors) {
-	#if 1
-			const float		dr = fabsf(static_cast<float>(c.r) - static_cast<float>(p.second.r));
-			const float		dg = fabsf(static_cast<float>(c.g) - static_cast<float>(p.second.g));
-			const float		db = fabsf(static_cast<float>(c.b) - static_cast<float>(p.second.b));
-			const float		color_d = (dr + dg + db);
-			if (color_d < new_d) {
-				new_d = color_d;
-				new_i = ci;
-			}
-	#else
-			double		dH = p.first.h - h,
-						dS = p.first.s - s,
-						dV = p.first.v - v;
-			double curDistance = std::sqrt(mWeightHue * std::pow(dH, 2) + mWeightSat * std::pow(dS, 2) + mWeightVal * std::pow(dV, 2));
-			if (curDistance < minDistance) {
-				minDistance = curDistance;
-				index = ci;
-			}
-	#endif
-			++ci;
-		}
-	//	return index;
-		return new_i;
-	}
-
-private:
-	struct HSV { double h = 0.0; double s = 0.0; double v = 0.0;};
-	using Lookup = std::pair<HSV, gif::ColorA8u>;
-	std::vector<Lookup>	mColors;
-
-	double				mWeightHue = 0.8,
-						mWeightSat = 0.1,
-						mWeightVal = 0.1;
-};
-
-ToColorIndexRef ToColorIndex::create() {
-	return std::make_shared<ToColorIndexDefault>();
-}
-
-/**
- * @class gif::ToPalettedBitmapDefault
- */
-class ToPalettedBitmapDefault : public ToPalettedBitmap {
-public:
-	ToPalettedBitmapDefault() { }
-
-	bool		convert(const gif::Bitmap &bm, const gif::ToColorIndexRef &tci, gif::PalettedBitmap &pbm) override {
-		pbm.clear();
-		if (bm.empty() || !tci) return false;
-		pbm.setTo(bm.mWidth, bm.mHeight);
-		if (bm.mPixels.size() != pbm.mPixels.size()) return false;
-
-		auto		dst = pbm.mPixels.begin();
-		for (const auto& c : bm.mPixels) {
-			*dst = tci->match(c);
-			++dst;
-		}
-
-		return true;
-	}
-};
-
-ToPalettedBitmapRef ToPalettedBitmap::create() {
-	return std::make_shared<ToPalettedBitmapDefault>();
-}
-
-namespace {
-
-// Results in HSV of H=[0,360], S=[0,1], V=[0,1]
-// if S == 0 then H = -1 (undefined)
-void		rgb_to_hsv(const gif::ColorA8u &c, double &_h, double &_s, double &_v) {
-	const double			r = static_cast<double>(c.r) / 255.0,
-							g = static_cast<double>(c.g) / 255.0,
-							b = static_cast<double>(c.b) / 255.0;
-	const double			max = std::max<double>(r, std::max<double>(g, b));
-	const double			min = std::min<double>(r, std::min<double>(g, b));
-	const double			delta = max-min;
-	_v = max;
-
-	// gray
-	if (min == max) {
-		_h = -1.0;
-		_s = 0.0;
-		return;
-	}
-
-	if (max != 0.0) {
-		_s = delta / max;
-	} else {
-		_s = 0.0;
-		_h = -1;
-		return;
-	}
-
-	if (r == max)			_h = (g-b) / delta;
-	else if (g == max)		_h = 2 + (b-r) / delta;
-	else					_h = 4 + (r-g) / delta;
-	_h *= 60.0;
-	if (_h < 0.0)			_h += 360;				
-}
-
-}
-
-} // namespace gif
+#include "gif_algorithm.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <exception>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include "gif_color_index.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GIFIO_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace gif {
+
+namespace {
+const size_t	WEB_SAFE_STEPS(6);
+const size_t	WEB_SAFE_SPACING(51);
+
+void		rgb_to_hsv(const gif::ColorA8u&, double &h, double &s, double &v);
+}
+
+/**
+ * @class gif::BitmapToPalette
+ */
+void BitmapToPalette::begin() {
+	throw std::runtime_error("gif::BitmapToPalette::begin() not supported");
+}
+
+void BitmapToPalette::add(const gif::Bitmap&) {
+	throw std::runtime_error("gif::BitmapToPalette::add() not supported");
+}
+
+void BitmapToPalette::convert(const gif::BitmapView &view, const size_t max_size, gif::Palette &out) {
+	gif::Bitmap		bm;
+	view.copyTo(bm);
+	convert(bm, max_size, out);
+}
+
+void BitmapToPalette::add(const gif::BitmapView &view) {
+	gif::Bitmap		bm;
+	view.copyTo(bm);
+	add(bm);
+}
+
+void BitmapToPalette::end(const size_t, gif::Palette&) {
+	throw std::runtime_error("gif::BitmapToPalette::end() not supported");
+}
+
+/**
+ * @class gif::BitmapToPaletteMostUsed
+ * @brief Simple clamp that finds the most-used colors.
+ */
+class BitmapToPaletteMostUsed : public BitmapToPalette {
+public:
+	BitmapToPaletteMostUsed() { }
+
+	void			convert(const gif::Bitmap &src, const size_t max_size, gif::Palette &out) override {
+		convert(gif::BitmapView(src), max_size, out);
+	}
+
+	void			convert(const gif::BitmapView &src, const size_t max_size, gif::Palette &out) override {
+		begin();
+		add(src);
+		end(max_size, out);
+	}
+
+	void			begin() override {
+		mCounts.clear();
+	}
+
+	void			add(const gif::Bitmap &src) override {
+		add(gif::BitmapView(src));
+	}
+
+	void			add(const gif::BitmapView &src) override {
+		// Simple utility to find all colors and eliminate based on a similarity until we're down to our max size.
+		std::vector<gif::ColorA8u>	scratch(src.mWidth > 0 ? src.mWidth : 0);
+		for (int32_t y=0; y<src.mHeight; ++y) {
+			const gif::ColorA8u*	row = src.row(y, scratch.data());
+			for (int32_t x=0; x<src.mWidth; ++x) {
+				const gif::ColorA8u	sc = gif::ColorA8u(row[x].r, row[x].g, row[x].b, 255);
+				mCounts[sc]++;
+			}
+		}
+	}
+
+	void			end(const size_t max_size, gif::Palette &out) override {
+		out.mColors.clear();
+		if (mCounts.empty()) return;
+
+		// For now, just clip based the most-used colors. CLEARLY THIS NEEDS TO CHANGE
+		using Counter = std::pair<gif::ColorA8u, size_t>;
+		std::vector<Counter>						vec;
+		for (const auto& p : mCounts) vec.push_back(Counter(p.first, p.second));
+		std::sort(vec.begin(), vec.end(), [](const Counter &a, const Counter &b)->bool{return a.second > b.second;});
+		if (vec.size() > max_size) vec.resize(max_size);
+		out.mColors.reserve(max_size);
+		for (const auto& p : vec) out.mColors.push_back(p.first);
+		mCounts.clear();
+	}
+
+private:
+	std::unordered_map<gif::ColorA8u, size_t>	mCounts;
+};
+
+/**
+ * @class gif::BitmapToPaletteMedianCut
+ * @brief Build a histogram at 5 bits per channel, then repeatedly split the
+ * most significant box of colors at its median until there are enough boxes.
+ * Each box contributes the average of its colors.
+ */
+class BitmapToPaletteMedianCut : public BitmapToPalette {
+public:
+	BitmapToPaletteMedianCut(const uint32_t thread_count)
+			: mThreadCount(thread_count) {
+		mHistogram.resize(HISTOGRAM_SIZE);
+	}
+
+	void			convert(const gif::Bitmap &src, const size_t max_size, gif::Palette &out) override {
+		convert(gif::BitmapView(src), max_size, out);
+	}
+
+	void			convert(const gif::BitmapView &src, const size_t max_size, gif::Palette &out) override {
+		begin();
+		add(src);
+		end(max_size, out);
+	}
+
+	void			begin() override {
+		std::fill(mHistogram.begin(), mHistogram.end(), HistogramBin());
+	}
+
+	void			add(const gif::Bitmap &src) override {
+		add(gif::BitmapView(src));
+	}
+
+	void			add(const gif::BitmapView &src) override {
+		if (src.empty()) return;
+		const size_t			height = static_cast<size_t>(src.mHeight);
+		const size_t			ranges = std::min(height, parallel_ranges(src.size(), MIN_PIXELS_PER_THREAD, mThreadCount));
+
+		// Each thread fills a private histogram, which are then merged.
+		mPartials.resize(ranges - 1);
+		parallel_for(height, ranges, [this, &src](const size_t begin, const size_t end, const size_t range) {
+			Histogram*					h = &mHistogram;
+			if (range > 0) {
+				h = &mPartials[range-1];
+				h->assign(HISTOGRAM_SIZE, HistogramBin());
+			}
+			std::vector<gif::ColorA8u>	scratch(src.mWidth);
+			for (size_t y=begin; y<end; ++y) {
+				const gif::ColorA8u*	row = src.row(static_cast<int32_t>(y), scratch.data());
+				add_to_histogram(row, row + src.mWidth, *h);
+			}
+		});
+		for (const auto& h : mPartials) {
+			for (size_t k=0; k<HISTOGRAM_SIZE; ++k) mHistogram[k] += h[k];
+		}
+	}
+
+	void			end(const size_t max_size, gif::Palette &out) override {
+		out.mColors.clear();
+		if (max_size < 1) return;
+
+		mBoxes.clear();
+		Box				all;
+		all.mHi[0] = all.mHi[1] = all.mHi[2] = HISTOGRAM_SIDE - 1;
+		shrink(all);
+		if (all.mCount < 1) return;
+		mBoxes.push_back(all);
+
+		while (mBoxes.size() < max_size) {
+			// Split the box with the most pixels spread over the widest range,
+			// which keeps rare but distant colors from being absorbed.
+			size_t		best = mBoxes.size();
+			uint64_t	best_score = 0;
+			for (size_t k=0; k<mBoxes.size(); ++k) {
+				const Box&		b = mBoxes[k];
+				const uint32_t	len = b.longestLength();
+				if (len < 1) continue;
+				const uint64_t	score = b.mCount * len;
+				if (score > best_score) {
+					best_score = score;
+					best = k;
+				}
+			}
+			if (best >= mBoxes.size()) break;
+
+			Box			a = mBoxes[best], b;
+			if (!split(a, b)) break;
+			mBoxes[best] = a;
+			mBoxes.push_back(b);
+		}
+
+		out.mColors.reserve(mBoxes.size());
+		for (const auto& b : mBoxes) out.mColors.push_back(average(b));
+	}
+
+private:
+	static const uint32_t		HISTOGRAM_BITS = 5;
+	static const uint32_t		HISTOGRAM_SIDE = 1<<HISTOGRAM_BITS;
+	static const size_t			HISTOGRAM_SIZE = HISTOGRAM_SIDE * HISTOGRAM_SIDE * HISTOGRAM_SIDE;
+	static const size_t			MIN_PIXELS_PER_THREAD = 1<<16;
+
+	// Each bin stores the sum of its colors, so palette entries are exact averages.
+	struct HistogramBin {
+		uint64_t				mCount = 0, mR = 0, mG = 0, mB = 0;
+
+		HistogramBin&			operator+=(const HistogramBin &o) {
+			mCount += o.mCount; mR += o.mR; mG += o.mG; mB += o.mB;
+			return *this;
+		}
+	};
+	using Histogram = std::vector<HistogramBin>;
+
+	// An inclusive range of histogram bins on each axis (r, g, b).
+	struct Box {
+		uint32_t				mLo[3] = { 0, 0, 0 },
+								mHi[3] = { 0, 0, 0 };
+		uint64_t				mCount = 0;
+
+		uint32_t				longestAxis() const {
+			uint32_t			axis = 0;
+			for (uint32_t k=1; k<3; ++k) if (mHi[k]-mLo[k] > mHi[axis]-mLo[axis]) axis = k;
+			return axis;
+		}
+		uint32_t				longestLength() const {
+			const uint32_t		axis = longestAxis();
+			return mHi[axis] - mLo[axis];
+		}
+	};
+
+	static inline size_t		bin_index(const uint32_t r, const uint32_t g, const uint32_t b) {
+		return (r << (2*HISTOGRAM_BITS)) | (g << HISTOGRAM_BITS) | b;
+	}
+
+	static void					add_to_histogram(const gif::ColorA8u *begin, const gif::ColorA8u *end, Histogram &h) {
+		const uint32_t			shift = 8 - HISTOGRAM_BITS;
+		for (; begin != end; ++begin) {
+			HistogramBin&		bin = h[bin_index(begin->r>>shift, begin->g>>shift, begin->b>>shift)];
+			++bin.mCount;
+			bin.mR += begin->r;
+			bin.mG += begin->g;
+			bin.mB += begin->b;
+		}
+	}
+
+	// Reduce the box to the bounds of the bins it contains, and count them.
+	void						shrink(Box &box) const {
+		uint32_t				lo[3] = { HISTOGRAM_SIDE, HISTOGRAM_SIDE, HISTOGRAM_SIDE },
+								hi[3] = { 0, 0, 0 };
+		uint64_t				count = 0;
+		for (uint32_t r=box.mLo[0]; r<=box.mHi[0]; ++r) {
+			for (uint32_t g=box.mLo[1]; g<=box.mHi[1]; ++g) {
+				for (uint32_t b=box.mLo[2]; b<=box.mHi[2]; ++b) {
+					const uint64_t	c = mHistogram[bin_index(r, g, b)].mCount;
+					if (c < 1) continue;
+					count += c;
+					lo[0] = std::min(lo[0], r); hi[0] = std::max(hi[0], r);
+					lo[1] = std::min(lo[1], g); hi[1] = std::max(hi[1], g);
+					lo[2] = std::min(lo[2], b); hi[2] = std::max(hi[2], b);
+				}
+			}
+		}
+		box.mCount = count;
+		if (count < 1) return;
+		for (uint32_t k=0; k<3; ++k) {
+			box.mLo[k] = lo[k];
+			box.mHi[k] = hi[k];
+		}
+	}
+
+	// Split a at the median of its longest axis, placing the upper half in b.
+	bool						split(Box &a, Box &b) {
+		const uint32_t			axis = a.longestAxis();
+		if (a.mHi[axis] <= a.mLo[axis]) return false;
+
+		// Count each slice along the axis
+		mSlices.assign(HISTOGRAM_SIDE, 0);
+		for (uint32_t r=a.mLo[0]; r<=a.mHi[0]; ++r) {
+			for (uint32_t g=a.mLo[1]; g<=a.mHi[1]; ++g) {
+				for (uint32_t bl=a.mLo[2]; bl<=a.mHi[2]; ++bl) {
+					const uint32_t	slice = (axis == 0 ? r : (axis == 1 ? g : bl));
+					mSlices[slice] += mHistogram[bin_index(r, g, bl)].mCount;
+				}
+			}
+		}
+		// The cut is the last slice in the lower half, and always leaves both halves non-empty
+		// since shrink() guarantees the end slices are occupied.
+		uint32_t				cut = a.mLo[axis];
+		uint64_t				sum = mSlices[cut];
+		while (cut + 1 < a.mHi[axis] && sum + mSlices[cut+1] <= a.mCount / 2) {
+			++cut;
+			sum += mSlices[cut];
+		}
+
+		b = a;
+		a.mHi[axis] = cut;
+		b.mLo[axis] = cut + 1;
+		shrink(a);
+		shrink(b);
+		return true;
+	}
+
+	gif::ColorA8u				average(const Box &box) const {
+		HistogramBin			sum;
+		for (uint32_t r=box.mLo[0]; r<=box.mHi[0]; ++r) {
+			for (uint32_t g=box.mLo[1]; g<=box.mHi[1]; ++g) {
+				for (uint32_t b=box.mLo[2]; b<=box.mHi[2]; ++b) {
+					sum += mHistogram[bin_index(r, g, b)];
+				}
+			}
+		}
+		if (sum.mCount < 1) return gif::ColorA8u(0, 0, 0, 255);
+		const uint64_t			half = sum.mCount / 2;
+		return gif::ColorA8u(	static_cast<uint8_t>((sum.mR + half) / sum.mCount),
+								static_cast<uint8_t>((sum.mG + half) / sum.mCount),
+								static_cast<uint8_t>((sum.mB + half) / sum.mCount), 255);
+	}
+
+	const uint32_t				mThreadCount;
+	Histogram					mHistogram;
+	std::vector<Histogram>		mPartials;
+	std::vector<Box>			mBoxes;
+	std::vector<uint64_t>		mSlices;
+};
+
+BitmapToPaletteRef BitmapToPalette::create(const uint32_t thread_count) {
+	return std::make_shared<BitmapToPaletteMedianCut>(thread_count);
+}
+
+BitmapToPaletteRef BitmapToPalette::createMostUsed() {
+	return std::make_shared<BitmapToPaletteMostUsed>();
+}
+
+/**
+ * @class gif::BitmapToPaletteFixed
+ * @brief Answer a palette supplied by the client.
+ */
+class BitmapToPaletteFixed : public BitmapToPalette {
+public:
+	BitmapToPaletteFixed(const gif::Palette &p) : mPalette(p) { }
+
+	void			convert(const gif::Bitmap&, const size_t max_size, gif::Palette &out) override {
+		end(max_size, out);
+	}
+
+	void			convert(const gif::BitmapView&, const size_t max_size, gif::Palette &out) override {
+		end(max_size, out);
+	}
+
+	void			begin() override { }
+	void			add(const gif::Bitmap&) override { }
+	void			add(const gif::BitmapView&) override { }
+
+	void			end(const size_t max_size, gif::Palette &out) override {
+		const size_t	size = std::min(max_size, mPalette.size());
+		out.mColors.assign(mPalette.mColors.begin(), mPalette.mColors.begin() + size);
+	}
+
+	bool			isFixed() const override { return true; }
+
+private:
+	const gif::Palette	mPalette;
+};
+
+BitmapToPaletteRef BitmapToPalette::createFixed(const gif::Palette &p) {
+	return std::make_shared<BitmapToPaletteFixed>(p);
+}
+
+/**
+ * @class gif::ToColorIndexLinear
+ * @brief Given a palette, find the nearest color match to each incoming color.
+ * @description Convert an RGB palette to HSV values and find the nearest.
+ */
+class ToColorIndexLinear : public ToColorIndex {
+public:
+	ToColorIndexLinear() { }
+	ToColorIndexLinear(const double weight_hue, const double weight_saturation, const double weight_value)
+		: mWeightHue(weight_hue), mWeightSat(weight_saturation), mWeightVal(weight_value) { }
+
+	void		setTo(const gif::Palette &pal) override {
+		mColors.clear();
+		for (const auto& c : pal.mColors) {
+			HSV			hsv;
+			rgb_to_hsv(c, hsv.h, hsv.s, hsv.v);
+			mColors.push_back(Lookup(hsv, c));
+		}
+	}
+
+	size_t		match(const gif::ColorA8u &c) const override {
+		// Pulled from
+		// https://social.msdn.microsoft.com/Forums/windows/en-us/105206d5-f7f7-4848-a32e-2b5cc10dc56f/how-to-find-the-nearest-matching-color-?forum=winforms
+		// XXX Although not using that currently, I must have introduced a bug, simple RGB comparison right now.
+
+		size_t			ci = 0;
+	#if 0
+		double			minDistance = std::numeric_limits<double>::max();
+		size_t			index = 0;
+		double			h, s, v;
+		rgb_to_hsv(c, h, s, v);
+	#endif
+		float			new_d = 255.0f * 4.0f;
+		size_t			new_i = 0;
+		for (const auto& p : mColors) {
+	#if 1
+			const float		dr = fabsf(static_cast<float>(c.r) - static_cast<float>(p.second.r));
+			const float		dg = fabsf(static_cast<float>(c.g) - static_cast<float>(p.second.g));
+			const float		db = fabsf(static_cast<float>(c.b) - static_cast<float>(p.second.b));
+			const float		color_d = (dr + dg + db);
+			if (color_d < new_d) {
+				new_d = color_d;
+				new_i = ci;
+			}
+	#else
+			double		dH = p.first.h - h,
+						dS = p.first.s - s,
+						dV = p.first.v - v;
+			double curDistance = std::sqrt(mWeightHue * std::pow(dH, 2) + mWeightSat * std::pow(dS, 2) + mWeightVal * std::pow(dV, 2));
+			if (curDistance < minDistance) {
+				minDistance = curDistance;
+				index = ci;
+			}
+	#endif
+			++ci;
+		}
+	//	return index;
+		return new_i;
+	}
+
+private:
+	struct HSV { double h = 0.0; double s = 0.0; double v = 0.0;};
+	using Lookup = std::pair<HSV, gif::ColorA8u>;
+	std::vector<Lookup>	mColors;
+
+	double				mWeightHue = 0.8,
+						mWeightSat = 0.1,
+						mWeightVal = 0.1;
+};
+
+/**
+ * @class gif::ToColorIndex
+ */
+void ToColorIndex::matchSpan(const gif::ColorA8u *src, uint8_t *dst, const size_t size) const {
+	for (size_t k=0; k<size; ++k) dst[k] = static_cast<uint8_t>(match(src[k]));
+}
+
+/**
+ * @class gif::ToColorIndexFixed
+ * @brief Compute the index for a known palette with F. Since the writer might
+ * set a different palette (i.e. one built from the exact colors of a frame),
+ * any other palette is matched through an inverse map instead.
+ */
+template <typename F>
+class ToColorIndexFixed : public ToColorIndex {
+public:
+	ToColorIndexFixed(const gif::Palette &p, const F &f) : mPalette(p), mIndex(f) { }
+
+	void			setTo(const gif::Palette &p) override {
+		mFixed = (p.mColors == mPalette.mColors);
+		if (!mFixed) mFallback.setTo(p);
+	}
+
+	size_t			match(const gif::ColorA8u &c) const override {
+		return mFixed ? mIndex(c) : mFallback.match(c);
+	}
+
+	void			matchSpan(const gif::ColorA8u *src, uint8_t *dst, const size_t size) const override {
+		if (!mFixed) {
+			mFallback.matchSpan(src, dst, size);
+			return;
+		}
+		for (size_t k=0; k<size; ++k) dst[k] = static_cast<uint8_t>(mIndex(src[k]));
+	}
+
+private:
+	const gif::Palette		mPalette;
+	const F					mIndex;
+	bool					mFixed = false;
+	ToColorIndexInverseMap	mFallback;
+};
+
+// Each channel rounds to the nearest step independently, which is
+// also the nearest entry by the sum of channel differences.
+struct WebSafeIndex {
+	size_t			operator()(const gif::ColorA8u &c) const {
+		return	step(c.r) * WEB_SAFE_STEPS * WEB_SAFE_STEPS + step(c.g) * WEB_SAFE_STEPS + step(c.b);
+	}
+	static size_t	step(const uint8_t v) {
+		return (static_cast<size_t>(v) + WEB_SAFE_SPACING / 2) / WEB_SAFE_SPACING;
+	}
+};
+
+struct GrayscaleIndex {
+	GrayscaleIndex(const size_t levels) : mLevels(levels) { }
+	size_t			operator()(const gif::ColorA8u &c) const {
+		// Rec. 601 luma in 8 bit fixed point.
+		const size_t	y = (static_cast<size_t>(c.r) * 77 + static_cast<size_t>(c.g) * 150 + static_cast<size_t>(c.b) * 29) >> 8;
+		return (y * (mLevels - 1) + 127) / 255;
+	}
+	const size_t	mLevels;
+};
+
+ToColorIndexRef ToColorIndex::create() {
+	return std::make_shared<ToColorIndexInverseMap>();
+}
+
+ToColorIndexRef ToColorIndex::createLinear() {
+	return std::make_shared<ToColorIndexLinear>();
+}
+
+ToColorIndexRef ToColorIndex::createWebSafe() {
+	return std::make_shared<ToColorIndexFixed<WebSafeIndex>>(web_safe_palette(), WebSafeIndex());
+}
+
+ToColorIndexRef ToColorIndex::createGrayscale(const size_t levels) {
+	return std::make_shared<ToColorIndexFixed<GrayscaleIndex>>(grayscale_palette(levels), GrayscaleIndex(levels));
+}
+
+/**
+ * @func gif::web_safe_palette()
+ */
+gif::Palette	web_safe_palette() {
+	gif::Palette		p;
+	p.mColors.reserve(WEB_SAFE_STEPS * WEB_SAFE_STEPS * WEB_SAFE_STEPS);
+	for (size_t r=0; r<WEB_SAFE_STEPS; ++r) {
+		for (size_t g=0; g<WEB_SAFE_STEPS; ++g) {
+			for (size_t b=0; b<WEB_SAFE_STEPS; ++b) {
+				p.mColors.push_back(gif::ColorA8u(	static_cast<uint8_t>(r * WEB_SAFE_SPACING),
+													static_cast<uint8_t>(g * WEB_SAFE_SPACING),
+													static_cast<uint8_t>(b * WEB_SAFE_SPACING)));
+			}
+		}
+	}
+	return p;
+}
+
+/**
+ * @func gif::grayscale_palette()
+ */
+gif::Palette	grayscale_palette(const size_t levels) {
+	if (levels < 2 || levels > 256) throw std::runtime_error("grayscale_palette() levels must be 2 to 256");
+	gif::Palette		p;
+	p.mColors.reserve(levels);
+	for (size_t k=0; k<levels; ++k) {
+		const uint8_t	v = static_cast<uint8_t>((k * 255 + (levels - 1) / 2) / (levels - 1));
+		p.mColors.push_back(gif::ColorA8u(v, v, v));
+	}
+	return p;
+}
+
+/**
+ * @class gif::ToPalettedBitmapOrdered
+ * @brief Dither to the nearest color with an ordered threshold tile.
+ * @description Each pixel is offset by the tile's threshold at its position
+ * before being matched, so pixels don't depend on each other: rows are split
+ * across threads and the offsets are applied 4 pixels at a time. The offsets
+ * are stored as separate amounts to add and subtract so saturating byte math
+ * does the clamping.
+ */
+class ToPalettedBitmapOrdered : public ToPalettedBitmap {
+public:
+	ToPalettedBitmapOrdered(const OrderedDither pattern, const float strength, const uint32_t thread_count)
+			: mThreadCount(thread_count) {
+		std::vector<uint32_t>		tile;
+		if (pattern == OrderedDither::kBlueNoise) makeBlueNoise(tile);
+		else makeBayer(tile);
+
+		const size_t				count = mTileSize * mTileSize;
+		const float					spread = DEFAULT_SPREAD * std::max(0.0f, std::min(strength, MAX_STRENGTH));
+		mAdd.assign(count * 4, 0);
+		mSub.assign(count * 4, 0);
+		for (size_t k=0; k<count; ++k) {
+			const float				t = (static_cast<float>(tile[k]) + 0.5f) / static_cast<float>(count) - 0.5f;
+			const int				offset = static_cast<int>(std::floor(t * spread + 0.5f));
+			uint8_t*				dst = (offset >= 0 ? &mAdd[k*4] : &mSub[k*4]);
+			// Alpha is left alone.
+			dst[0] = dst[1] = dst[2] = static_cast<uint8_t>(std::abs(offset));
+		}
+	}
+
+	void						setOrigin(const int32_t x, const int32_t y) override {
+		mOriginX = x;
+		mOriginY = y;
+	}
+
+	bool						convert(const gif::Bitmap &bm, const gif::ToColorIndexRef &tci, gif::PalettedBitmap &pbm) override {
+		return convert(gif::BitmapView(bm), tci, pbm);
+	}
+
+	bool						convert(const gif::BitmapView &bm, const gif::ToColorIndexRef &tci, gif::PalettedBitmap &pbm) override {
+		pbm.clear();
+		if (bm.empty() || !tci) return false;
+		pbm.setTo(bm.mWidth, bm.mHeight);
+		if (bm.size() != pbm.mPixels.size()) return false;
+
+		const ToColorIndexInverseMap*	bound = dynamic_cast<const ToColorIndexInverseMap*>(tci.get());
+		const gif::ToColorIndex*	any = tci.get();
+		const size_t				width = static_cast<size_t>(bm.mWidth);
+		const size_t				height = static_cast<size_t>(bm.mHeight);
+		const size_t				ranges = std::min(height, parallel_ranges(bm.size(), MIN_PIXELS_PER_THREAD, mThreadCount));
+		parallel_for(height, ranges, [this, &bm, &pbm, bound, any, width](const size_t begin, const size_t end, const size_t) {
+			std::vector<gif::ColorA8u>	row(width), scratch(width);
+			for (size_t y=begin; y<end; ++y) {
+				const gif::ColorA8u*	src = bm.row(static_cast<int32_t>(y), scratch.data());
+				uint8_t*				dst = pbm.mPixels.data() + y * width;
+				ditherRow(src, row.data(), width, y);
+				if (bound) {
+					for (size_t x=0; x<width; ++x) dst[x] = static_cast<uint8_t>(bound->ToColorIndexInverseMap::match(row[x]));
+				} else {
+					any->matchSpan(row.data(), dst, width);
+				}
+			}
+		});
+		return true;
+	}
+
+private:
+	// A strength of 1 spreads the thresholds over this many levels, which suits a 256 color palette.
+	static const int			DEFAULT_SPREAD = 32;
+	static const float			MAX_STRENGTH;
+	static const size_t			MIN_PIXELS_PER_THREAD = 1<<15;
+	static const size_t			BAYER_BITS = 3;
+	static const size_t			BLUE_NOISE_SIZE = 32;
+
+	void						ditherRow(const gif::ColorA8u *src, gif::ColorA8u *dst, const size_t width, const size_t y) const {
+		// Tiles are anchored to the frame, so partial frames line up with earlier ones.
+		const size_t			tile_y = wrap(static_cast<int64_t>(y) + mOriginY);
+		const uint8_t*			add = &mAdd[tile_y * mTileSize * 4];
+		const uint8_t*			sub = &mSub[tile_y * mTileSize * 4];
+		const uint8_t*			in = reinterpret_cast<const uint8_t*>(src);
+		uint8_t*				out = reinterpret_cast<uint8_t*>(dst);
+		size_t					tile_x = wrap(mOriginX);
+		size_t					x = 0;
+#if defined(GIFIO_SSE2)
+		// The tile size is a multiple of 4, so a group of 4 pixels never wraps
+		// unless the origin isn't aligned, which takes the scalar path below.
+		if ((tile_x & 3) == 0) {
+			for (; x + 4 <= width; x += 4) {
+				__m128i			c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + x * 4));
+				c = _mm_adds_epu8(c, _mm_loadu_si128(reinterpret_cast<const __m128i*>(add + tile_x * 4)));
+				c = _mm_subs_epu8(c, _mm_loadu_si128(reinterpret_cast<const __m128i*>(sub + tile_x * 4)));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4), c);
+				tile_x = (tile_x + 4) & (mTileSize - 1);
+			}
+		}
+#endif
+		for (; x < width; ++x) {
+			for (size_t k=0; k<4; ++k) {
+				const int		v = static_cast<int>(in[x*4+k]) + add[tile_x*4+k] - sub[tile_x*4+k];
+				out[x*4+k] = static_cast<uint8_t>(std::max(0, std::min(v, 255)));
+			}
+			tile_x = (tile_x + 1) & (mTileSize - 1);
+		}
+	}
+
+	size_t						wrap(const int64_t v) const {
+		return static_cast<size_t>(v & static_cast<int64_t>(mTileSize - 1));
+	}
+
+	// Classic recursive Bayer matrix: the bits of x^y and y, interleaved and reversed.
+	void						makeBayer(std::vector<uint32_t> &tile) {
+		mTileSize = 1<<BAYER_BITS;
+		tile.resize(mTileSize * mTileSize);
+		for (size_t y=0; y<mTileSize; ++y) {
+			for (size_t x=0; x<mTileSize; ++x) {
+				uint32_t		v = 0;
+				for (size_t bit=0; bit<BAYER_BITS; ++bit) {
+					v = (v << 2) | ((((x ^ y) >> bit) & 1) << 1) | ((y >> bit) & 1);
+				}
+				tile[y * mTileSize + x] = v;
+			}
+		}
+	}
+
+	// Rank every position by repeatedly filling the largest void, measured with
+	// a gaussian that wraps around the tile. Far cheaper than storing a tile.
+	void						makeBlueNoise(std::vector<uint32_t> &tile) {
+		mTileSize = BLUE_NOISE_SIZE;
+		const size_t			count = mTileSize * mTileSize;
+		const float				sigma = 1.5f;
+		std::vector<float>		kernel(count), energy(count, 0.0f);
+		for (size_t y=0; y<mTileSize; ++y) {
+			for (size_t x=0; x<mTileSize; ++x) {
+				const float		dx = static_cast<float>(std::min(x, mTileSize - x));
+				const float		dy = static_cast<float>(std::min(y, mTileSize - y));
+				kernel[y * mTileSize + x] = std::exp(-(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+			}
+		}
+		tile.assign(count, 0);
+		std::vector<bool>		placed(count, false);
+		for (uint32_t rank=0; rank<count; ++rank) {
+			size_t				best = count;
+			for (size_t k=0; k<count; ++k) {
+				if (!placed[k] && (best == count || energy[k] < energy[best])) best = k;
+			}
+			placed[best] = true;
+			tile[best] = rank;
+			const size_t		bx = best % mTileSize, by = best / mTileSize;
+			for (size_t y=0; y<mTileSize; ++y) {
+				const size_t	ky = ((y + mTileSize - by) & (mTileSize - 1)) * mTileSize;
+				for (size_t x=0; x<mTileSize; ++x) {
+					energy[y * mTileSize + x] += kernel[ky + ((x + mTileSize - bx) & (mTileSize - 1))];
+				}
+			}
+		}
+	}
+
+	const uint32_t				mThreadCount;
+	size_t						mTileSize = 0;
+	std::vector<uint8_t>		mAdd, mSub;
+	int32_t						mOriginX = 0,
+								mOriginY = 0;
+};
+
+const float ToPalettedBitmapOrdered::MAX_STRENGTH = 4.0f;
+
+/**
+ * @class gif::ToPalettedBitmap
+ */
+bool ToPalettedBitmap::convert(const gif::BitmapView &view, const gif::ToColorIndexRef &tci, gif::PalettedBitmap &pbm) {
+	gif::Bitmap		bm;
+	view.copyTo(bm);
+	return convert(bm, tci, pbm);
+}
+
+ToPalettedBitmapRef ToPalettedBitmap::create(const uint32_t thread_count) {
+	return std::make_shared<ToPalettedBitmapT<ToColorIndexInverseMap>>(thread_count);
+}
+
+ToPalettedBitmapRef ToPalettedBitmap::createOrdered(const OrderedDither pattern, const float strength, const uint32_t thread_count) {
+	return std::make_shared<ToPalettedBitmapOrdered>(pattern, strength, thread_count);
+}
+
+/**
+ * @func gif::parallel_ranges()
+ */
+size_t		parallel_ranges(const size_t count, const size_t min_per_range, const uint32_t thread_count) {
+	const size_t			threads = (thread_count > 0 ? thread_count : std::max<uint32_t>(1, std::thread::hardware_concurrency()));
+	return std::max<size_t>(1, std::min<size_t>(threads, count / std::max<size_t>(1, min_per_range)));
+}
+
+/**
+ * @func gif::parallel_for()
+ */
+void		parallel_for(	const size_t count, const size_t ranges,
+							const std::function<void(const size_t begin, const size_t end, const size_t range)> &fn) {
+	if (ranges <= 1) {
+		fn(0, count, 0);
+		return;
+	}
+
+	const size_t				chunk = count / ranges;
+	std::vector<std::thread>	workers;
+	std::vector<std::exception_ptr>
+								errors(ranges);
+	workers.reserve(ranges - 1);
+	for (size_t k=1; k<ranges; ++k) {
+		const size_t			begin = k * chunk;
+		const size_t			end = (k+1 == ranges ? count : begin + chunk);
+		std::exception_ptr*		error = &errors[k];
+		workers.push_back(std::thread([&fn, begin, end, k, error]() {
+			try {
+				fn(begin, end, k);
+			} catch (...) {
+				*error = std::current_exception();
+			}
+		}));
+	}
+	try {
+		fn(0, chunk, 0);
+	} catch (...) {
+		errors[0] = std::current_exception();
+	}
+	for (auto& w : workers) w.join();
+	for (const auto& e : errors) {
+		if (e) std::rethrow_exception(e);
+	}
+}
+
+namespace {
+
+const size_t		RESIZE_PIXELS_PER_THREAD(1<<15);
+
+// The source pixels one destination pixel covers along an axis, and how much of each.
+class ResizeSpan {
+public:
+	int32_t				mBegin = 0;
+	std::vector<float>	mWeights;
+};
+
+std::vector<ResizeSpan>	resize_spans(const int32_t src_size, const int32_t dst_size) {
+	std::vector<ResizeSpan>	spans(dst_size);
+	const double			scale = static_cast<double>(src_size) / static_cast<double>(dst_size);
+	for (int32_t d=0; d<dst_size; ++d) {
+		ResizeSpan&			span(spans[d]);
+		if (scale <= 1.0) {
+			span.mBegin = std::min(src_size - 1, static_cast<int32_t>((d + 0.5) * scale));
+			span.mWeights.push_back(1.0f);
+			continue;
+		}
+		const double		lo = d * scale,
+							hi = (d + 1) * scale;
+		span.mBegin = static_cast<int32_t>(lo);
+		for (int32_t s=span.mBegin; s<src_size && s<hi; ++s) {
+			const double	cover = std::min(hi, s + 1.0) - std::max(lo, static_cast<double>(s));
+			span.mWeights.push_back(static_cast<float>(cover / scale));
+		}
+	}
+	return spans;
+}
+
+}
+
+/**
+ * @func gif::resize_bitmap()
+ */
+void		resize_bitmap(	const gif::BitmapView &src, const int32_t width, const int32_t height,
+							gif::Bitmap &dst, const uint32_t thread_count) {
+	if (src.empty() || width < 1 || height < 1) throw std::runtime_error("resize_bitmap() source and size can't be empty");
+	dst.setTo(width, height);
+	const std::vector<ResizeSpan>	columns = resize_spans(src.mWidth, width),
+									rows = resize_spans(src.mHeight, height);
+	const size_t			ranges = std::min<size_t>(height, parallel_ranges(dst.mPixels.size(), RESIZE_PIXELS_PER_THREAD, thread_count));
+	parallel_for(height, ranges, [&](const size_t begin, const size_t end, const size_t) {
+		std::vector<gif::ColorA8u>	scratch(src.mWidth);
+		// Each source row is first shrunk across, then rows are summed down.
+		std::vector<float>	across(static_cast<size_t>(width) * 4), sum(static_cast<size_t>(width) * 4);
+		for (size_t y=begin; y<end; ++y) {
+			const ResizeSpan&	row_span(rows[y]);
+			std::fill(sum.begin(), sum.end(), 0.0f);
+			for (size_t k=0; k<row_span.mWeights.size(); ++k) {
+				const gif::ColorA8u*	row = src.row(row_span.mBegin + static_cast<int32_t>(k), scratch.data());
+				float*			a = across.data();
+				for (const auto& span : columns) {
+					float		r = 0.0f, g = 0.0f, b = 0.0f, al = 0.0f;
+					const gif::ColorA8u*	c = row + span.mBegin;
+					for (const auto w : span.mWeights) {
+						r += w * c->r;
+						g += w * c->g;
+						b += w * c->b;
+						al += w * c->a;
+						++c;
+					}
+					*a++ = r;
+					*a++ = g;
+					*a++ = b;
+					*a++ = al;
+				}
+				const float		w = row_span.mWeights[k];
+				for (size_t i=0; i<sum.size(); ++i) sum[i] += w * across[i];
+			}
+			gif::ColorA8u*		out = dst.mPixels.data() + y * static_cast<size_t>(width);
+			for (int32_t x=0; x<width; ++x) {
+				const float*	v = sum.data() + x * 4;
+				out[x] = gif::ColorA8u(	static_cast<uint8_t>(std::min(255.0f, v[0] + 0.5f)),
+										static_cast<uint8_t>(std::min(255.0f, v[1] + 0.5f)),
+										static_cast<uint8_t>(std::min(255.0f, v[2] + 0.5f)),
+										static_cast<uint8_t>(std::min(255.0f, v[3] + 0.5f)));
+			}
+		}
+	});
+}
+
+namespace {
+
+// Results in HSV of H=[0,360], S=[0,1], V=[0,1]
+// if S == 0 then H = -1 (undefined)
+void		rgb_to_hsv(const gif::ColorA8u &c, double &_h, double &_s, double &_v) {
+	const double			r = static_cast<double>(c.r) / 255.0,
+							g = static_cast<double>(c.g) / 255.0,
+							b = static_cast<double>(c.b) / 255.0;
+	const double			max = std::max<double>(r, std::max<double>(g, b));
+	const double			min = std::min<double>(r, std::min<double>(g, b));
+	const double			delta = max-min;
+	_v = max;
+
+	// gray
+	if (min == max) {
+		_h = -1.0;
+		_s = 0.0;
+		return;
+	}
+
+	if (max != 0.0) {
+		_s = delta / max;
+	} else {
+		_s = 0.0;
+		_h = -1;
+		return;
+	}
+
+	if (r == max)			_h = (g-b) / delta;
+	else if (g == max)		_h = 2 + (b-r) / delta;
+	else					_h = 4 + (r-g) / delta;
+	_h *= 60.0;
+	if (_h < 0.0)			_h += 360;				
+}
+
+}
+
+} // namespace gif
@@ -1,74 +1,209 @@
-#ifndef GIFIO_GIFALGORITHM_H_
-#define GIFIO_GIFALGORITHM_H_
-
-#include <memory>
-#include "gif_bitmap.h"
-
-/**
- * Collection of abstract objects that can be plugged into the framework.
- * This is intendend to localize all subjective algorithms, i.e. anything
- * that might vary based on context or perception, from all deterministic
- * algorithms, which will only be right or wrong.
- */
-
-namespace gif {
-class BitmapToPalette;
-using BitmapToPaletteRef = std::shared_ptr<BitmapToPalette>;
-class ToColorIndex;
-using ToColorIndexRef = std::shared_ptr<ToColorIndex>;
-class ToPalettedBitmap;
-using ToPalettedBitmapRef = std::shared_ptr<ToPalettedBitmap>;
-
-/**
- * @class gif::BitmapToPalette
- * @brief Convert an RGBA bitmap to a palette.
- */
-class BitmapToPalette {
-protected:
-	BitmapToPalette() { }
-public:
-	virtual ~BitmapToPalette() { }
-
-	// @param max_size is the maximum allowed size of the final palette.
-	virtual void				convert(const gif::Bitmap&, const size_t max_size, gif::Palette&) = 0;
-
-	// Implementations
-	static BitmapToPaletteRef	create();
-};
-
-/**
- * @class gif::ToColorIndex
- * @brief Given a palette, find the nearest color match to each incoming color.
- */
-class ToColorIndex {
-protected:
-	ToColorIndex() { }
-public:
-	virtual ~ToColorIndex() { }
-
-	virtual void				setTo(const gif::Palette&) = 0;
-	virtual size_t				match(const gif::ColorA8u&) const = 0;
-
-	// Implementations
-	static ToColorIndexRef		create();
-};
-
-/**
- * @class gif::ToPalettedBitmap
- * @brief Convert an RGBA bitmap to a paletted bitmap.
- */
-class ToPalettedBitmap {
-protected:
-	ToPalettedBitmap() { }
-public:
-	virtual ~ToPalettedBitmap() { }
-
-	virtual bool				convert(const gif::Bitmap&, const gif::ToColorIndexRef&, gif::PalettedBitmap &pbm) = 0;
-
-	// Implementations
-	static ToPalettedBitmapRef	create();
-};
-
-} // namespace gif
-
-#endif
+#ifndef GIFIO_GIFALGORITHM_H_
+#define GIFIO_GIFALGORITHM_H_
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include "gif_bitmap.h"
+
+/**
+ * Collection of abstract objects that can be plugged into the framework.
+ * This is intendend to localize all subjective algorithms, i.e. anything
+ * that might vary based on context or perception, from all deterministic
+ * algorithms, which will only be right or wrong.
+ */
+
+namespace gif {
+class BitmapToPalette;
+using BitmapToPaletteRef = std::shared_ptr<BitmapToPalette>;
+class ToColorIndex;
+using ToColorIndexRef = std::shared_ptr<ToColorIndex>;
+class ToPalettedBitmap;
+using ToPalettedBitmapRef = std::shared_ptr<ToPalettedBitmap>;
+
+/**
+ * @class gif::BitmapToPalette
+ * @brief Convert an RGBA bitmap to a palette.
+ */
+class BitmapToPalette {
+protected:
+	BitmapToPalette() { }
+public:
+	virtual ~BitmapToPalette() { }
+
+	// @param max_size is the maximum allowed size of the final palette.
+	virtual void				convert(const gif::Bitmap&, const size_t max_size, gif::Palette&) = 0;
+	// Read the view in place. The default copies it into a bitmap.
+	virtual void				convert(const gif::BitmapView&, const size_t max_size, gif::Palette&);
+
+	// Build a single palette from any number of bitmaps. Call begin(), add() each
+	// bitmap, then end() to generate the palette. Only the color statistics are
+	// retained, not the bitmaps. Implementations that can't accumulate throw.
+	virtual void				begin();
+	virtual void				add(const gif::Bitmap&);
+	virtual void				add(const gif::BitmapView&);
+	virtual void				end(const size_t max_size, gif::Palette&);
+
+	// Answer true if the palette doesn't depend on the bitmaps, so clients
+	// mustn't replace it with one built from their colors.
+	virtual bool				isFixed() const { return false; }
+
+	// Implementations
+	// Median cut over a 5 bit per channel histogram. Time doesn't depend on the number
+	// of unique colors, and large bitmaps build the histogram on multiple threads.
+	// @param thread_count is the maximum number of threads, 0 for the hardware concurrency.
+	static BitmapToPaletteRef	create(const uint32_t thread_count = 0);
+	// Keep the most frequently used colors. Exact when there are few colors,
+	// but drops rare colors and slows down as the number of unique colors grows.
+	static BitmapToPaletteRef	createMostUsed();
+	// Always answer the same palette, ignoring the bitmaps, so no histogram is built.
+	// Pair with a matching ToColorIndex, i.e. createWebSafe() with web_safe_palette().
+	// The palette is clipped to max_size; frame differencing reserves an entry, so
+	// palettes used with it should have at most 255 colors.
+	static BitmapToPaletteRef	createFixed(const gif::Palette&);
+};
+
+/**
+ * @class gif::ToColorIndex
+ * @brief Given a palette, find the nearest color match to each incoming color.
+ * Once the palette is set, match() and matchSpan() can be called from
+ * multiple threads at once.
+ */
+class ToColorIndex {
+protected:
+	ToColorIndex() { }
+public:
+	virtual ~ToColorIndex() { }
+
+	virtual void				setTo(const gif::Palette&) = 0;
+	virtual size_t				match(const gif::ColorA8u&) const = 0;
+	// Match size colors from src into dst. The default calls match() for each;
+	// implementations should override to avoid the per-pixel virtual call.
+	virtual void				matchSpan(const gif::ColorA8u *src, uint8_t *dst, const size_t size) const;
+
+	// Implementations
+	// Nearest RGB match through a lazily filled inverse color map. Thread safe.
+	static ToColorIndexRef		create();
+	// Nearest RGB match by comparing against every palette entry.
+	static ToColorIndexRef		createLinear();
+	// Computed indexes for the fixed palettes below, with no search. Any other
+	// palette falls back to create(). Web safe is the exact nearest match;
+	// grayscale matches on luminance.
+	static ToColorIndexRef		createWebSafe();
+	static ToColorIndexRef		createGrayscale(const size_t levels);
+	// For a palette trained ahead of time, see gif::ToColorIndexTable.
+};
+
+// Fixed palettes.
+// The 6x6x6 web safe color cube, 216 entries, red major.
+gif::Palette	web_safe_palette();
+// Evenly spaced grays from black to white, 2 to 256 levels.
+gif::Palette	grayscale_palette(const size_t levels);
+
+// Threshold tiles for ordered dithering.
+enum class OrderedDither {	kBayer,			// 8x8 Bayer matrix, a regular crosshatch
+							kBlueNoise };	// 32x32 blue noise, less structured grain
+
+/**
+ * @class gif::ToPalettedBitmap
+ * @brief Convert an RGBA bitmap to a paletted bitmap.
+ */
+class ToPalettedBitmap {
+protected:
+	ToPalettedBitmap() { }
+public:
+	virtual ~ToPalettedBitmap() { }
+
+	virtual bool				convert(const gif::Bitmap&, const gif::ToColorIndexRef&, gif::PalettedBitmap &pbm) = 0;
+	// Read the view in place. The default copies it into a bitmap.
+	virtual bool				convert(const gif::BitmapView&, const gif::ToColorIndexRef&, gif::PalettedBitmap &pbm);
+	// Position of the next bitmaps within the frame, for implementations whose
+	// result depends on position.
+	virtual void				setOrigin(const int32_t /*x*/, const int32_t /*y*/) { }
+
+	// Implementations
+	// Nearest color, with rows split across threads.
+	// @param thread_count is the maximum number of threads, 0 for the hardware concurrency.
+	static ToPalettedBitmapRef	create(const uint32_t thread_count = 0);
+	// Nearest color after offsetting each pixel by an ordered threshold, which trades
+	// banding on gradients for a fine pattern. Costs about the same as create().
+	// @param strength scales the offsets, from 0 (none) to 4. 1 suits a 256 color palette.
+	static ToPalettedBitmapRef	createOrdered(	const OrderedDither = OrderedDither::kBayer, const float strength = 1.0f,
+												const uint32_t thread_count = 0);
+};
+
+// Answer how many ranges parallel_for() should split count items into, given a minimum
+// number of items per range and a maximum thread count (0 for the hardware concurrency).
+size_t		parallel_ranges(const size_t count, const size_t min_per_range, const uint32_t thread_count);
+// Split [0, count) into contiguous ranges and call fn(begin, end, range) for each, the
+// first on the calling thread and the rest on their own threads. Rethrow any exception.
+void		parallel_for(	const size_t count, const size_t ranges,
+							const std::function<void(const size_t begin, const size_t end, const size_t range)>&);
+
+// Resample src into dst at width x height. Shrinking averages the source pixels
+// under each destination pixel, weighted by how much of them it covers, so any
+// scale is smooth. Enlarging picks the nearest pixel. Rows are split across threads.
+// @param thread_count is the maximum number of threads, 0 for the hardware concurrency.
+void		resize_bitmap(	const gif::BitmapView &src, const int32_t width, const int32_t height,
+							gif::Bitmap &dst, const uint32_t thread_count = 0);
+
+/**
+ * @class gif::ToPalettedBitmapT
+ * @brief Convert to the nearest color with the matcher bound at compile time.
+ * @description When the ToColorIndex is an M, its match() is called directly,
+ * so it can be inlined into the conversion loop. Any other ToColorIndex is
+ * handled through matchSpan(). Rows are split across threads either way.
+ */
+template <typename M>
+class ToPalettedBitmapT : public ToPalettedBitmap {
+public:
+	ToPalettedBitmapT(const uint32_t thread_count = 0) : mThreadCount(thread_count) { }
+
+	bool						convert(const gif::Bitmap&, const gif::ToColorIndexRef&, gif::PalettedBitmap &pbm) override;
+	bool						convert(const gif::BitmapView&, const gif::ToColorIndexRef&, gif::PalettedBitmap &pbm) override;
+
+private:
+	// Threads aren't worth starting for less work than this.
+	static const size_t			MIN_PIXELS_PER_THREAD = 1<<15;
+	const uint32_t				mThreadCount;
+};
+
+/**
+ * @class gif::ToPalettedBitmapT IMPLEMENTATION
+ */
+template <typename M>
+bool ToPalettedBitmapT<M>::convert(const gif::Bitmap &bm, const gif::ToColorIndexRef &tci, gif::PalettedBitmap &pbm) {
+	return convert(gif::BitmapView(bm), tci, pbm);
+}
+
+template <typename M>
+bool ToPalettedBitmapT<M>::convert(const gif::BitmapView &bm, const gif::ToColorIndexRef &tci, gif::PalettedBitmap &pbm) {
+	pbm.clear();
+	if (bm.empty() || !tci) return false;
+	pbm.setTo(bm.mWidth, bm.mHeight);
+	if (bm.size() != pbm.mPixels.size()) return false;
+
+	const M*					bound = dynamic_cast<const M*>(tci.get());
+	const gif::ToColorIndex*	any = tci.get();
+	const size_t				width = static_cast<size_t>(bm.mWidth);
+	uint8_t*					dst = pbm.mPixels.data();
+	const size_t				height = static_cast<size_t>(bm.mHeight);
+	const size_t				ranges = std::min(height, parallel_ranges(bm.size(), MIN_PIXELS_PER_THREAD, mThreadCount));
+	parallel_for(height, ranges, [=, &bm](const size_t begin, const size_t end, const size_t) {
+		std::vector<gif::ColorA8u>	scratch(width);
+		for (size_t y=begin; y<end; ++y) {
+			const gif::ColorA8u*	src = bm.row(static_cast<int32_t>(y), scratch.data());
+			uint8_t*				row_dst = dst + y * width;
+			if (bound) {
+				for (size_t x=0; x<width; ++x) row_dst[x] = static_cast<uint8_t>(bound->M::match(src[x]));
+			} else {
+				any->matchSpan(src, row_dst, width);
+			}
+		}
+	});
+	return true;
+}
+
+} // namespace gif
+
+#endif
@@ -0,0 +1,135 @@
+#include "gif_async_file.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace gif {
+
+namespace {
+const size_t		MIN_BUFFER_SIZE(1<<12);
+const size_t		MIN_BUFFER_COUNT(2);
+}
+
+/**
+ * @class gif::AsyncFileBuffer
+ */
+AsyncFileBuffer::~AsyncFileBuffer() {
+	close();
+}
+
+void AsyncFileBuffer::setBuffers(const size_t size, const size_t count) {
+	mBufferSize = std::max(size, MIN_BUFFER_SIZE);
+	mBufferCount = std::max(count, MIN_BUFFER_COUNT);
+}
+
+bool AsyncFileBuffer::open(const std::string &path) {
+	close();
+	mFile = std::fopen(path.c_str(), "wb");
+	if (!mFile) return false;
+	// The buffers are already large, so each one goes straight to the system.
+	std::setvbuf(mFile, nullptr, _IONBF, 0);
+
+	if (mBuffers.size() != mBufferCount || mBuffers.front().size() != mBufferSize) {
+		mBuffers.assign(mBufferCount, std::vector<char>(mBufferSize));
+	}
+	mFree.clear();
+	mFull.clear();
+	for (size_t k=1; k<mBuffers.size(); ++k) mFree.push_back(k);
+	mCurrent = 0;
+	setp(mBuffers[0].data(), mBuffers[0].data() + mBuffers[0].size());
+	mHandedOff = 0;
+	mStop = false;
+	mFailed = false;
+	mThread = std::thread([this]() { run(); });
+	return true;
+}
+
+bool AsyncFileBuffer::close() {
+	if (!mFile) return true;
+	{
+		std::lock_guard<std::mutex>		lock(mMutex);
+		const size_t					size = static_cast<size_t>(pptr() - pbase());
+		if (size > 0 && !mFailed) mFull.push_back(std::make_pair(mCurrent, size));
+		mStop = true;
+		mChanged.notify_all();
+	}
+	mThread.join();
+	bool					ok = !mFailed;
+	if (std::fclose(mFile) != 0) ok = false;
+	mFile = nullptr;
+	setp(nullptr, nullptr);
+	return ok;
+}
+
+AsyncFileBuffer::int_type AsyncFileBuffer::overflow(int_type c) {
+	if (!mFile || !handOff()) return traits_type::eof();
+	if (!traits_type::eq_int_type(c, traits_type::eof())) {
+		*pptr() = traits_type::to_char_type(c);
+		pbump(1);
+	}
+	return traits_type::not_eof(c);
+}
+
+std::streamsize AsyncFileBuffer::xsputn(const char *s, std::streamsize n) {
+	if (!mFile) return 0;
+	std::streamsize			done = 0;
+	while (done < n) {
+		const size_t		room = static_cast<size_t>(epptr() - pptr());
+		if (room < 1) {
+			if (!handOff()) break;
+			continue;
+		}
+		const size_t		size = std::min(room, static_cast<size_t>(n - done));
+		std::memcpy(pptr(), s + done, size);
+		pbump(static_cast<int>(size));
+		done += static_cast<std::streamsize>(size);
+	}
+	return done;
+}
+
+AsyncFileBuffer::pos_type AsyncFileBuffer::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) {
+	if (!mFile || off != 0 || dir != std::ios_base::cur || (which & std::ios_base::out) == 0) return pos_type(off_type(-1));
+	return pos_type(static_cast<off_type>(mHandedOff + static_cast<uint64_t>(pptr() - pbase())));
+}
+
+int AsyncFileBuffer::sync() {
+	std::lock_guard<std::mutex>		lock(mMutex);
+	return mFailed ? -1 : 0;
+}
+
+bool AsyncFileBuffer::handOff() {
+	const size_t			size = static_cast<size_t>(pptr() - pbase());
+	std::unique_lock<std::mutex>	lock(mMutex);
+	if (mFailed) return false;
+	if (size > 0) {
+		mFull.push_back(std::make_pair(mCurrent, size));
+		mHandedOff += size;
+		mChanged.notify_all();
+		mChanged.wait(lock, [this]() { return mFailed || !mFree.empty(); });
+		if (mFailed) return false;
+		mCurrent = mFree.front();
+		mFree.pop_front();
+	}
+	std::vector<char>&		b = mBuffers[mCurrent];
+	setp(b.data(), b.data() + b.size());
+	return true;
+}
+
+void AsyncFileBuffer::run() {
+	std::unique_lock<std::mutex>	lock(mMutex);
+	while (true) {
+		mChanged.wait(lock, [this]() { return mStop || !mFull.empty(); });
+		if (mFull.empty()) return;
+		const std::pair<size_t, size_t>	b = mFull.front();
+		mFull.pop_front();
+		const bool			skip = mFailed;
+		lock.unlock();
+		const bool			ok = skip || std::fwrite(mBuffers[b.first].data(), 1, b.second, mFile) == b.second;
+		lock.lock();
+		if (!ok) mFailed = true;
+		mFree.push_back(b.first);
+		mChanged.notify_all();
+	}
+}
+
+} // namespace gif
@@ -0,0 +1,76 @@
+#ifndef GIFIO_GIFASYNCFILE_H_
+#define GIFIO_GIFASYNCFILE_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace gif {
+
+/**
+ * @class gif::AsyncFileBuffer
+ * @brief A stream buffer that writes its file on a dedicated thread.
+ * @description Output fills one of a fixed pool of large buffers. Each full
+ * buffer is handed to the I/O thread, which writes it with a single call and
+ * returns it to the pool, so nothing is allocated after open(). When every
+ * buffer is in flight the stream waits, which bounds the memory in use. Once
+ * a write fails, further output fails too, and close() reports it.
+ */
+class AsyncFileBuffer : public std::streambuf {
+public:
+	AsyncFileBuffer() { }
+	AsyncFileBuffer(const AsyncFileBuffer&) = delete;
+	AsyncFileBuffer& operator=(const AsyncFileBuffer&) = delete;
+	~AsyncFileBuffer();
+
+	// The pool for the next open(), at least 2 buffers of at least 4 KB.
+	void					setBuffers(const size_t size, const size_t count);
+	// Answer false if the file can't be opened.
+	bool					open(const std::string &path);
+	bool					is_open() const { return mFile != nullptr; }
+	// Write anything buffered, wait for the I/O thread and close the file.
+	// Answer false if any write failed.
+	bool					close();
+
+protected:
+	int_type				overflow(int_type) override;
+	std::streamsize			xsputn(const char*, std::streamsize) override;
+	// Only answers the current position, for tellp().
+	pos_type				seekoff(off_type, std::ios_base::seekdir, std::ios_base::openmode) override;
+	int						sync() override;
+
+private:
+	// Queue the current buffer and continue in a free one, waiting for one if
+	// needed. Answer false after a write error.
+	bool					handOff();
+	void					run();
+
+	std::FILE*				mFile = nullptr;
+	size_t					mBufferSize = 1<<18,
+							mBufferCount = 4;
+	std::vector<std::vector<char>>
+							mBuffers;
+	size_t					mCurrent = 0;
+	// Bytes handed to the I/O thread so far.
+	uint64_t				mHandedOff = 0;
+	std::thread				mThread;
+	std::mutex				mMutex;
+	std::condition_variable	mChanged;
+	// Buffer indexes, and the ones waiting to be written with their sizes.
+	std::deque<size_t>		mFree;
+	std::deque<std::pair<size_t, size_t>>
+							mFull;
+	bool					mStop = false,
+							mFailed = false;
+};
+
+} // namespace gif
+
+#endif
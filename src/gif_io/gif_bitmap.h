@@ -1,63 +1,147 @@
-#ifndef GIFIO_GIFBITMAP_H_
-#define GIFIO_GIFBITMAP_H_
-
-#include <vector>
-#include "gif_color.h"
-
-namespace gif {
-
-/**
- * @class gif::Bitmap
- * @brief A local bitmap definition, an array of colours.
- */
-class Bitmap {
-public:
-	Bitmap() { }
-	Bitmap(const int32_t w, const int32_t h) { setTo(w, h); }
-
-	bool						empty() const { return mWidth < 1 || mHeight < 1; }
-	void						setTo(const int32_t w, const int32_t h) {
-		if (w == mWidth && h == mHeight) return;
-		mWidth = w;
-		mHeight = h;
-		mPixels.clear();
-		if (w > 0 && h > 0) mPixels.resize(w * h);
-	}
-
-	int32_t						mWidth = 0,
-								mHeight = 0;
-	std::vector<gif::ColorA8u>	mPixels;
-};
-
-/**
- * @class gif::PalettedBitmap
- * @brief A bitmap converted to palette codes.
- */
-class PalettedBitmap {
-public:
-	PalettedBitmap() { }
-	PalettedBitmap(const int32_t w, const int32_t h) { setTo(w, h); }
-
-	bool						empty() const { return mWidth < 1 || mHeight < 1; }
-
-	void						clear() {
-		mWidth = mHeight = 0;
-		mPixels.clear();
-	}
-
-	void						setTo(const int32_t w, const int32_t h) {
-		if (w == mWidth && h == mHeight) return;
-		mWidth = w;
-		mHeight = h;
-		mPixels.clear();
-		if (w > 0 && h > 0) mPixels.resize(w * h);
-	}
-
-	int32_t						mWidth = 0,
-								mHeight = 0;
-	std::vector<uint8_t>		mPixels;
-};
-
-} // namespace gif
-
-#endif
+#ifndef GIFIO_GIFBITMAP_H_
+#define GIFIO_GIFBITMAP_H_
+
+#include <cstring>
+#include <vector>
+#include "gif_color.h"
+
+namespace gif {
+
+/**
+ * @class gif::Bitmap
+ * @brief A local bitmap definition, an array of colours.
+ */
+class Bitmap {
+public:
+	Bitmap() { }
+	Bitmap(const int32_t w, const int32_t h) { setTo(w, h); }
+
+	bool						empty() const { return mWidth < 1 || mHeight < 1; }
+	void						setTo(const int32_t w, const int32_t h) {
+		if (w == mWidth && h == mHeight) return;
+		mWidth = w;
+		mHeight = h;
+		mPixels.clear();
+		if (w > 0 && h > 0) mPixels.resize(w * h);
+	}
+
+	int32_t						mWidth = 0,
+								mHeight = 0;
+	std::vector<gif::ColorA8u>	mPixels;
+};
+
+/**
+ * @class gif::PalettedBitmap
+ * @brief A bitmap converted to palette codes.
+ */
+class PalettedBitmap {
+public:
+	PalettedBitmap() { }
+	PalettedBitmap(const int32_t w, const int32_t h) { setTo(w, h); }
+
+	bool						empty() const { return mWidth < 1 || mHeight < 1; }
+
+	void						clear() {
+		mWidth = mHeight = 0;
+		mPixels.clear();
+	}
+
+	void						setTo(const int32_t w, const int32_t h) {
+		if (w == mWidth && h == mHeight) return;
+		mWidth = w;
+		mHeight = h;
+		mPixels.clear();
+		if (w > 0 && h > 0) mPixels.resize(w * h);
+	}
+
+	int32_t						mWidth = 0,
+								mHeight = 0;
+	std::vector<uint8_t>		mPixels;
+};
+
+// How the channels of a pixel are laid out in memory. X is an unused byte.
+enum class PixelLayout { kRGBA, kBGRA, kRGBX, kBGRX, kRGB, kBGR };
+
+/**
+ * @class gif::BitmapView
+ * @brief A non-owning view of pixels in client memory, rows stride bytes apart.
+ * @description Lets the writer read frames in place instead of copying them into
+ * a Bitmap first. Algorithms read a row at a time: an RGBA view answers its own
+ * memory, anything else is converted a row at a time into a scratch buffer.
+ * The memory must remain valid for as long as the view is in use.
+ */
+class BitmapView {
+public:
+	BitmapView() { }
+	BitmapView(const void *data, const int32_t w, const int32_t h, const size_t stride, const PixelLayout layout = PixelLayout::kRGBA)
+			: mData(static_cast<const uint8_t*>(data)), mWidth(w), mHeight(h), mStride(stride), mLayout(layout) { }
+	BitmapView(const Bitmap &bm)
+			: mData(reinterpret_cast<const uint8_t*>(bm.mPixels.data())), mWidth(bm.mWidth), mHeight(bm.mHeight)
+			, mStride(sizeof(gif::ColorA8u) * static_cast<size_t>(bm.mWidth > 0 ? bm.mWidth : 0)) { }
+
+	bool						empty() const { return mWidth < 1 || mHeight < 1 || !mData; }
+	size_t						size() const { return empty() ? 0 : static_cast<size_t>(mWidth) * static_cast<size_t>(mHeight); }
+	// Answer true if this views the memory of the bitmap.
+	bool						isOf(const Bitmap &bm) const { return mData == reinterpret_cast<const uint8_t*>(bm.mPixels.data()); }
+
+	// Answer row y as RGBA, either in place or converted into scratch, which needs room for mWidth pixels.
+	const gif::ColorA8u*		row(const int32_t y, gif::ColorA8u *scratch) const;
+	gif::ColorA8u				pixel(const int32_t x, const int32_t y) const;
+	void						copyTo(Bitmap&) const;
+
+	const uint8_t*				mData = nullptr;
+	int32_t						mWidth = 0,
+								mHeight = 0;
+	size_t						mStride = 0;
+	PixelLayout					mLayout = PixelLayout::kRGBA;
+
+private:
+	size_t						pixelBytes() const { return (mLayout == PixelLayout::kRGB || mLayout == PixelLayout::kBGR) ? 3 : 4; }
+};
+
+/**
+ * @class gif::BitmapView IMPLEMENTATION
+ */
+inline const gif::ColorA8u* BitmapView::row(const int32_t y, gif::ColorA8u *scratch) const {
+	const uint8_t*				src = mData + static_cast<size_t>(y) * mStride;
+	if (mLayout == PixelLayout::kRGBA) return reinterpret_cast<const gif::ColorA8u*>(src);
+
+	// One layout test per row keeps the loops simple.
+	const size_t				step = pixelBytes();
+	const bool					bgr = (mLayout == PixelLayout::kBGRA || mLayout == PixelLayout::kBGRX || mLayout == PixelLayout::kBGR);
+	const bool					alpha = (mLayout == PixelLayout::kBGRA);
+	const size_t				ri = (bgr ? 2 : 0), bi = (bgr ? 0 : 2);
+	gif::ColorA8u*				dst = scratch;
+	for (int32_t x=0; x<mWidth; ++x) {
+		*dst++ = gif::ColorA8u(src[ri], src[1], src[bi], alpha ? src[3] : 255);
+		src += step;
+	}
+	return scratch;
+}
+
+inline gif::ColorA8u BitmapView::pixel(const int32_t x, const int32_t y) const {
+	const uint8_t*				src = mData + static_cast<size_t>(y) * mStride + static_cast<size_t>(x) * pixelBytes();
+	switch (mLayout) {
+		case PixelLayout::kRGBA:	return gif::ColorA8u(src[0], src[1], src[2], src[3]);
+		case PixelLayout::kBGRA:	return gif::ColorA8u(src[2], src[1], src[0], src[3]);
+		case PixelLayout::kRGBX:
+		case PixelLayout::kRGB:		return gif::ColorA8u(src[0], src[1], src[2], 255);
+		default:					return gif::ColorA8u(src[2], src[1], src[0], 255);
+	}
+}
+
+inline void BitmapView::copyTo(Bitmap &bm) const {
+	if (isOf(bm)) return;
+	bm.setTo(mWidth, mHeight);
+	if (bm.empty()) return;
+	gif::ColorA8u*				dst = bm.mPixels.data();
+	for (int32_t y=0; y<mHeight; ++y) {
+		const gif::ColorA8u*	src = row(y, dst);
+		if (src != dst) std::memcpy(dst, src, sizeof(gif::ColorA8u) * static_cast<size_t>(mWidth));
+		dst += mWidth;
+	}
+}
+
+} // namespace gif
+
+#endif
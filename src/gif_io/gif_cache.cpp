@@ -0,0 +1,516 @@
+#include "gif_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include "gif_file.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+namespace gif {
+
+namespace {
+
+// A cache file is a FileHeader, the palettes and index planes, then a
+// FrameRecord per frame. Offsets are from the start of the file and 8 byte
+// aligned. Values are in the machine's byte order: the cache is local.
+const uint32_t		MAGIC(0x43464947);	// "GIFC"
+const uint32_t		VERSION(1);
+const uint64_t		ALIGNMENT(8);
+const char*			EXTENSION(".gifc");
+const int32_t		INTERLACE_START[] = { 0, 4, 2, 1 };
+const int32_t		INTERLACE_STEP[] = { 8, 8, 4, 2 };
+
+struct FileHeader {
+	uint32_t		mMagic = MAGIC,
+					mVersion = VERSION;
+	uint64_t		mSourceHash = 0,
+					mSourceSize = 0;
+	int32_t			mWidth = 0,
+					mHeight = 0;
+	uint32_t		mFrameCount = 0,
+					mReserved = 0;
+	uint64_t		mFrameTable = 0,
+					mFileSize = 0;
+};
+
+struct FrameRecord {
+	int32_t			mLeft = 0,
+					mTop = 0,
+					mWidth = 0,
+					mHeight = 0;
+	uint64_t		mIndexes = 0,
+					mDecoded = 0,
+					mPalette = 0;
+	uint32_t		mColorCount = 0;
+	int32_t			mTransparentIndex = -1;
+	uint32_t		mInterlaced = 0,
+					mReserved = 0;
+	double			mDelay = 0.0;
+};
+
+// Answer the position of row y in the order an image stores its rows.
+size_t				row_position(const int32_t y, const int32_t height, const bool interlaced) {
+	if (!interlaced) return static_cast<size_t>(y);
+	size_t			position = 0;
+	for (size_t pass=0; pass<4; ++pass) {
+		const int32_t	start = INTERLACE_START[pass],
+						step = INTERLACE_STEP[pass];
+		if (y >= start && (y - start) % step == 0) return position + static_cast<size_t>((y - start) / step);
+		if (height > start) position += static_cast<size_t>((height - start + step - 1) / step);
+	}
+	return position;
+}
+
+// Answer true if [offset, offset + size) lies in a file of file_size bytes.
+bool				in_file(const uint64_t offset, const uint64_t size, const uint64_t file_size) {
+	return offset <= file_size && size <= file_size - offset;
+}
+
+uint64_t			rotate_left(const uint64_t v, const int bits) {
+	return (v << bits) | (v >> (64 - bits));
+}
+
+uint64_t			mix(uint64_t h) {
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+uint64_t			palette_key(const gif::ColorA8u *colors, const size_t count) {
+	uint64_t		h = 14695981039346656037ULL ^ count;
+	for (size_t k=0; k<count; ++k) {
+		const uint8_t	bytes[4] = { colors[k].r, colors[k].g, colors[k].b, colors[k].a };
+		for (const auto b : bytes) {
+			h ^= b;
+			h *= 1099511628211ULL;
+		}
+	}
+	return h;
+}
+
+std::string			unique_suffix() {
+	static std::atomic<uint32_t>	counter(0);
+#if defined(_WIN32)
+	const uint64_t	pid = static_cast<uint64_t>(_getpid());
+#else
+	const uint64_t	pid = static_cast<uint64_t>(getpid());
+#endif
+	const uint64_t	v = mix(pid ^ std::hash<std::thread::id>()(std::this_thread::get_id())
+							^ static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count())
+							^ (static_cast<uint64_t>(++counter) << 48));
+	char			buf[24];
+	std::snprintf(buf, sizeof(buf), ".%016llx", static_cast<unsigned long long>(v));
+	return buf;
+}
+
+class CacheEntry {
+public:
+	std::string		mPath;
+	uint64_t		mSize = 0;
+	int64_t			mTime = 0;
+};
+
+void				list_entries(const std::string &directory, std::vector<CacheEntry> &out) {
+	const size_t	extension_size = std::strlen(EXTENSION);
+#if defined(_WIN32)
+	WIN32_FIND_DATAA	data;
+	HANDLE			find = FindFirstFileA((directory + "\\*" + EXTENSION).c_str(), &data);
+	if (find == INVALID_HANDLE_VALUE) return;
+	do {
+		CacheEntry	e;
+		e.mPath = directory + "/" + data.cFileName;
+		e.mSize = (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+		e.mTime = static_cast<int64_t>((static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime);
+		out.push_back(e);
+	} while (FindNextFileA(find, &data));
+	FindClose(find);
+#else
+	DIR*			dir = opendir(directory.c_str());
+	if (!dir) return;
+	while (dirent *d = readdir(dir)) {
+		const size_t	name_size = std::strlen(d->d_name);
+		if (name_size <= extension_size || std::strcmp(d->d_name + name_size - extension_size, EXTENSION) != 0) continue;
+		CacheEntry	e;
+		e.mPath = directory + "/" + d->d_name;
+		struct stat	st;
+		if (stat(e.mPath.c_str(), &st) != 0) continue;
+		e.mSize = static_cast<uint64_t>(st.st_size);
+		e.mTime = static_cast<int64_t>(st.st_mtime);
+		out.push_back(e);
+	}
+	closedir(dir);
+#endif
+}
+
+/**
+ * Builder
+ * Write a cache file as the reader hands over each image. Only the current
+ * image is held; palettes are written once and shared by every frame using them.
+ */
+class Builder : public gif::ListConstructor {
+public:
+	Builder(std::ostream &out) : mOut(out) {
+		FileHeader		header;
+		write(&header, sizeof(header));
+	}
+
+	bool				wantsImages() const override { return true; }
+	void				addImage(const gif::IndexedImage&) override;
+	void				addFrame(const gif::Bitmap &bm, const double) override {
+		mWidth = bm.mWidth;
+		mHeight = bm.mHeight;
+	}
+
+	// Write the frame table and the real header.
+	void				finish(const uint64_t hash, const uint64_t source_size);
+
+private:
+	uint64_t			write(const void *data, const size_t size);
+	uint64_t			writePalette(const gif::ColorA8u *colors, const size_t count);
+
+	std::ostream&		mOut;
+	uint64_t			mPosition = 0;
+	int32_t				mWidth = 0,
+						mHeight = 0;
+	std::vector<FrameRecord>	mRecords;
+	// Palettes written so far, by key, as their offset and colors.
+	std::unordered_multimap<uint64_t, std::pair<uint64_t, std::vector<gif::ColorA8u>>>
+						mPalettes;
+	std::vector<uint8_t>		mPlane;
+};
+
+void Builder::addImage(const gif::IndexedImage &image) {
+	FrameRecord			r;
+	r.mLeft = image.mLeft;
+	r.mTop = image.mTop;
+	r.mWidth = image.mWidth;
+	r.mHeight = image.mHeight;
+	r.mDecoded = image.mIndexCount;
+	r.mInterlaced = image.mInterlaced ? 1 : 0;
+	r.mColorCount = static_cast<uint32_t>(image.mColorCount);
+	r.mTransparentIndex = image.mTransparentIndex;
+	r.mDelay = image.mDelay;
+	r.mPalette = writePalette(image.mColors, image.mColorCount);
+
+	// Store rows top to bottom. Indices past the image's area are dropped.
+	const size_t		w = static_cast<size_t>(std::max(0, image.mWidth)),
+						area = w * static_cast<size_t>(std::max(0, image.mHeight));
+	if (!image.mInterlaced && image.mIndexCount >= area) {
+		r.mIndexes = write(image.mIndexes, area);
+	} else {
+		mPlane.assign(area, 0);
+		for (int32_t y=0; y<image.mHeight; ++y) {
+			const size_t	from = row_position(y, image.mHeight, image.mInterlaced) * w;
+			if (from >= image.mIndexCount) continue;
+			std::memcpy(mPlane.data() + static_cast<size_t>(y) * w, image.mIndexes + from, std::min(w, image.mIndexCount - from));
+		}
+		r.mIndexes = write(mPlane.data(), mPlane.size());
+	}
+	mRecords.push_back(r);
+}
+
+void Builder::finish(const uint64_t hash, const uint64_t source_size) {
+	FileHeader			header;
+	header.mSourceHash = hash;
+	header.mSourceSize = source_size;
+	header.mWidth = mWidth;
+	header.mHeight = mHeight;
+	header.mFrameCount = static_cast<uint32_t>(mRecords.size());
+	header.mFrameTable = write(mRecords.data(), mRecords.size() * sizeof(FrameRecord));
+	header.mFileSize = mPosition;
+	mOut.seekp(0);
+	mOut.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+uint64_t Builder::write(const void *data, const size_t size) {
+	const uint64_t		at = mPosition;
+	if (size > 0) mOut.write(static_cast<const char*>(data), size);
+	mPosition += size;
+	const char			pad[ALIGNMENT] = { 0 };
+	const uint64_t		padding = (ALIGNMENT - mPosition % ALIGNMENT) % ALIGNMENT;
+	if (padding > 0) mOut.write(pad, padding);
+	mPosition += padding;
+	return at;
+}
+
+uint64_t Builder::writePalette(const gif::ColorA8u *colors, const size_t count) {
+	const uint64_t		key = palette_key(colors, count);
+	auto				range = mPalettes.equal_range(key);
+	for (auto it = range.first; it != range.second; ++it) {
+		const std::vector<gif::ColorA8u>&	c(it->second.second);
+		if (c.size() == count && std::equal(c.begin(), c.end(), colors)) return it->second.first;
+	}
+	const uint64_t		at = write(colors, count * sizeof(gif::ColorA8u));
+	mPalettes.insert(std::make_pair(key, std::make_pair(at, std::vector<gif::ColorA8u>(colors, colors + count))));
+	return at;
+}
+
+}
+
+/**
+ * @class gif::CachedGif::Frame
+ */
+int32_t CachedGif::Frame::decodedWidth(const int32_t y) const {
+	const size_t		from = row_position(y, mHeight, mInterlaced) * static_cast<size_t>(mWidth);
+	if (from >= mDecoded) return 0;
+	return static_cast<int32_t>(std::min(static_cast<size_t>(mWidth), mDecoded - from));
+}
+
+/**
+ * @class gif::CachedGif
+ */
+CachedGif::~CachedGif() {
+	if (!mMap) return;
+#if defined(_WIN32)
+	UnmapViewOfFile(mMap);
+	CloseHandle(static_cast<HANDLE>(mMapHandle));
+#else
+	munmap(mMap, mMapSize);
+#endif
+}
+
+const CachedGif::Frame* CachedGif::getFrame(const size_t index) const {
+	if (index >= mFrames.size()) return nullptr;
+	return &mFrames[index];
+}
+
+void CachedGif::read(gif::ListConstructor &constructor) const {
+	gif::Bitmap			screen(mWidth, mHeight);
+	for (const auto& f : mFrames) {
+		for (int32_t y=0; y<f.mHeight; ++y) {
+			const int32_t	sy = f.mTop + y;
+			if (sy >= mHeight) break;
+			const int32_t	w = std::min(f.decodedWidth(y), mWidth - f.mLeft);
+			const uint8_t*	src = f.row(y);
+			gif::ColorA8u*	dst = screen.mPixels.data() + static_cast<size_t>(sy) * mWidth + f.mLeft;
+			for (int32_t x=0; x<w; ++x) {
+				const uint8_t	i = src[x];
+				if (i == f.mTransparentIndex) continue;
+				dst[x] = (i < f.mColorCount ? f.mColors[i] : gif::ColorA8u(0, 0, 0, 0));
+			}
+		}
+		constructor.addFrame(screen, f.mDelay);
+		if (!constructor.wantsMoreFrames()) break;
+	}
+	constructor.readerFinished();
+}
+
+bool CachedGif::map(const std::string &path, const uint64_t hash, const uint64_t source_size) {
+#if defined(_WIN32)
+	HANDLE				file = CreateFileA(	path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+											OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER		size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart < static_cast<LONGLONG>(sizeof(FileHeader))) {
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE				mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (!mapping) return false;
+	mMap = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!mMap) {
+		CloseHandle(mapping);
+		return false;
+	}
+	mMapHandle = mapping;
+	mMapSize = static_cast<size_t>(size.QuadPart);
+#else
+	const int			fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return false;
+	struct stat			st;
+	if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(FileHeader))) {
+		::close(fd);
+		return false;
+	}
+	void*				m = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (m == MAP_FAILED) return false;
+	mMap = m;
+	mMapSize = static_cast<size_t>(st.st_size);
+#endif
+
+	// Check everything the frames will point at, then fix up the pointers.
+	const uint8_t*		base = static_cast<const uint8_t*>(mMap);
+	FileHeader			header;
+	std::memcpy(&header, base, sizeof(header));
+	if (	header.mMagic != MAGIC || header.mVersion != VERSION || header.mSourceHash != hash
+			|| header.mSourceSize != source_size || header.mFileSize != mMapSize
+			|| header.mWidth < 0 || header.mHeight < 0
+			|| !in_file(header.mFrameTable, static_cast<uint64_t>(header.mFrameCount) * sizeof(FrameRecord), mMapSize)) {
+		return false;
+	}
+	mHash = hash;
+	mWidth = header.mWidth;
+	mHeight = header.mHeight;
+	mFrames.resize(header.mFrameCount);
+	for (size_t k=0; k<mFrames.size(); ++k) {
+		FrameRecord		r;
+		std::memcpy(&r, base + header.mFrameTable + k * sizeof(FrameRecord), sizeof(r));
+		const uint64_t	area = static_cast<uint64_t>(std::max(0, r.mWidth)) * static_cast<uint64_t>(std::max(0, r.mHeight));
+		if (	r.mLeft < 0 || r.mTop < 0 || r.mWidth < 0 || r.mHeight < 0 || r.mColorCount > 256
+				|| !in_file(r.mIndexes, area, mMapSize)
+				|| !in_file(r.mPalette, static_cast<uint64_t>(r.mColorCount) * sizeof(gif::ColorA8u), mMapSize)) {
+			mFrames.clear();
+			return false;
+		}
+		Frame&			f(mFrames[k]);
+		f.mLeft = r.mLeft;
+		f.mTop = r.mTop;
+		f.mWidth = r.mWidth;
+		f.mHeight = r.mHeight;
+		f.mIndexes = base + r.mIndexes;
+		f.mDecoded = static_cast<size_t>(r.mDecoded);
+		f.mInterlaced = (r.mInterlaced != 0);
+		f.mColors = reinterpret_cast<const gif::ColorA8u*>(base + r.mPalette);
+		f.mColorCount = r.mColorCount;
+		f.mTransparentIndex = r.mTransparentIndex;
+		f.mDelay = r.mDelay;
+	}
+	return true;
+}
+
+/**
+ * @class gif::FrameCache
+ */
+FrameCache::FrameCache(const std::string &directory, const uint64_t max_bytes)
+		: mDirectory(directory)
+		, mMaxBytes(max_bytes)
+		, mHits(0)
+		, mMisses(0) {
+#if defined(_WIN32)
+	_mkdir(mDirectory.c_str());
+#else
+	mkdir(mDirectory.c_str(), 0755);
+#endif
+}
+
+CachedGifRef FrameCache::open(const std::string &path) {
+	std::vector<char>	bytes;
+	{
+		std::ifstream	input(path, std::ios::binary | std::ios::ate);
+		if (!input.is_open()) throw std::runtime_error("gif::FrameCache::open() can't read " + path);
+		bytes.resize(static_cast<size_t>(input.tellg()));
+		input.seekg(0);
+		input.read(bytes.data(), bytes.size());
+	}
+	const uint64_t		h = hash(bytes.data(), bytes.size()),
+						source_size = bytes.size();
+	CachedGifRef		found = find(h, source_size);
+	if (found) {
+		++mHits;
+		return found;
+	}
+	++mMisses;
+	bytes = std::vector<char>();
+	add(path, h, source_size);
+	found = find(h, source_size);
+	if (!found) throw std::runtime_error("gif::FrameCache::open() can't map the cache file for " + path);
+	trim();
+	return found;
+}
+
+CachedGifRef FrameCache::find(const uint64_t hash, const uint64_t source_size) {
+	const std::string	path = pathFor(hash);
+	std::shared_ptr<CachedGif>	gif(new CachedGif());
+	if (!gif->map(path, hash, source_size)) return nullptr;
+	// The modification time is the last use, for trim().
+#if defined(_WIN32)
+	_utime(path.c_str(), nullptr);
+#else
+	utime(path.c_str(), nullptr);
+#endif
+	return gif;
+}
+
+void FrameCache::trim() {
+	std::lock_guard<std::mutex>		lock(mTrimMutex);
+	std::vector<CacheEntry>			entries;
+	list_entries(mDirectory, entries);
+	uint64_t			total = 0;
+	for (const auto& e : entries) total += e.mSize;
+	if (total <= mMaxBytes) return;
+	std::sort(entries.begin(), entries.end(), [](const CacheEntry &a, const CacheEntry &b) { return a.mTime < b.mTime; });
+	for (const auto& e : entries) {
+		if (total <= mMaxBytes) break;
+		// Mapped files can't be deleted on Windows; they go on a later trim.
+		if (std::remove(e.mPath.c_str()) == 0) total -= e.mSize;
+	}
+}
+
+uint64_t FrameCache::hash(const char *data, const size_t size) {
+	// Four independent lanes of 8 byte words keep this well ahead of reading the file.
+	const uint64_t		P1(0x9e3779b185ebca87ULL),
+						P2(0xc2b2ae3d27d4eb4fULL);
+	uint64_t			lanes[4] = { P1, P2, ~P1, ~P2 };
+	size_t				k = 0;
+	for (; k + 32 <= size; k += 32) {
+		for (size_t l=0; l<4; ++l) {
+			uint64_t	w;
+			std::memcpy(&w, data + k + l * 8, 8);
+			lanes[l] = rotate_left(lanes[l] + w * P2, 31) * P1;
+		}
+	}
+	uint64_t			h = static_cast<uint64_t>(size) * P1;
+	for (size_t l=0; l<4; ++l) h = (h ^ mix(lanes[l])) * P1;
+	for (; k<size; ++k) h = (h ^ static_cast<uint8_t>(data[k])) * P2;
+	return mix(h);
+}
+
+std::string FrameCache::pathFor(const uint64_t hash) const {
+	char				name[24];
+	std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+	return mDirectory + "/" + name + EXTENSION;
+}
+
+void FrameCache::add(const std::string &source, const uint64_t hash, const uint64_t source_size) {
+	const std::string	path = pathFor(hash),
+						temp = path + unique_suffix();
+	{
+		std::ofstream	out(temp, std::ios::binary | std::ios::trunc);
+		if (!out) throw std::runtime_error("gif::FrameCache can't create " + temp);
+		Builder			builder(out);
+		gif::Reader		reader;
+		if (!reader.read(source, builder)) {
+			out.close();
+			std::remove(temp.c_str());
+			throw std::runtime_error("gif::FrameCache::open() can't decode " + source);
+		}
+		builder.finish(hash, source_size);
+		out.close();
+		if (!out) {
+			std::remove(temp.c_str());
+			throw std::runtime_error("gif::FrameCache can't write " + temp);
+		}
+	}
+	// Readers only ever see a finished file. If another writer got there first
+	// (Windows won't rename over it), theirs is the same and is kept.
+	if (std::rename(temp.c_str(), path.c_str()) != 0) std::remove(temp.c_str());
+}
+
+} // namespace gif
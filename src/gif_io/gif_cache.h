@@ -0,0 +1,129 @@
+#ifndef GIFIO_GIFCACHE_H_
+#define GIFIO_GIFCACHE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "gif_list.h"
+
+namespace gif {
+class CachedGif;
+using CachedGifRef = std::shared_ptr<const CachedGif>;
+
+/**
+ * @class gif::CachedGif
+ * @brief A decoded GIF file, mapped from a cache file. Frames are the images
+ * as stored, i.e. color indices and their table, read in place from the
+ * mapping; nothing is copied until they're drawn. Immutable, so any number
+ * of threads can share one.
+ */
+class CachedGif {
+public:
+	class Frame {
+	public:
+		Frame() { }
+
+		// Answer the number of pixels decoded at the start of row y, which is
+		// mWidth unless the file's data ran short.
+		int32_t					decodedWidth(const int32_t y) const;
+		const uint8_t*			row(const int32_t y) const { return mIndexes + static_cast<size_t>(y) * mWidth; }
+
+		// The image's area of the screen.
+		int32_t					mLeft = 0,
+								mTop = 0,
+								mWidth = 0,
+								mHeight = 0;
+		// mWidth * mHeight color indices, rows top to bottom.
+		const uint8_t*			mIndexes = nullptr;
+		// How many indices the file had, in its order (interlaced rows in pass order).
+		size_t					mDecoded = 0;
+		bool					mInterlaced = false;
+		const gif::ColorA8u*	mColors = nullptr;
+		size_t					mColorCount = 0;
+		// -1 if there's no transparent index.
+		int32_t					mTransparentIndex = -1;
+		double					mDelay = 0.0;
+	};
+
+public:
+	~CachedGif();
+
+	bool					empty() const { return mFrames.empty(); }
+	size_t					size() const { return mFrames.size(); }
+	const Frame*			getFrame(const size_t index) const;
+	int32_t					getWidth() const { return mWidth; }
+	int32_t					getHeight() const { return mHeight; }
+	// The content hash of the source file.
+	uint64_t				getHash() const { return mHash; }
+
+	// Draw the frames onto a screen the way gif::Reader does, and hand each to
+	// the constructor. Indices past an image's area or the screen are dropped.
+	void					read(gif::ListConstructor&) const;
+
+private:
+	friend class FrameCache;
+	CachedGif() { }
+	// Map the file and point my frames into it. Answer false if it's missing,
+	// invalid, or not for the given hash and size.
+	bool					map(const std::string &path, const uint64_t hash, const uint64_t source_size);
+
+	void*					mMap = nullptr;
+	size_t					mMapSize = 0;
+#if defined(_WIN32)
+	void*					mMapHandle = nullptr;
+#endif
+	uint64_t				mHash = 0;
+	int32_t					mWidth = 0,
+							mHeight = 0;
+	std::vector<Frame>		mFrames;
+};
+
+/**
+ * @class gif::FrameCache
+ * @brief A directory of decoded GIF files, keyed by a hash of each source
+ * file's contents, so a file that's opened again (under any name) is mapped
+ * instead of decoded. Cache files are written to a temporary name and renamed
+ * into place, and never change after, so any number of threads and processes
+ * can share a directory. The least recently opened files are deleted to keep
+ * it under a size; ones still mapped stay readable until they're released.
+ */
+class FrameCache {
+public:
+	FrameCache(const std::string &directory, const uint64_t max_bytes = 256ULL<<20);
+
+	// The most the cache files may total, checked after each file is added.
+	FrameCache&				setMaxBytes(const uint64_t v) { mMaxBytes = v; return *this; }
+	const std::string&		getDirectory() const { return mDirectory; }
+
+	// Answer the decoded file, from the cache if it's there, otherwise decoded
+	// and added. Throw on error.
+	CachedGifRef			open(const std::string &path);
+	// Answer the cached file with the given hash and source size, or nullptr.
+	CachedGifRef			find(const uint64_t hash, const uint64_t source_size);
+	// Delete the least recently opened files until they fit in the maximum size.
+	void					trim();
+
+	// Answer the content hash open() keys files by.
+	static uint64_t			hash(const char *data, const size_t size);
+
+	uint64_t				getHits() const { return mHits; }
+	uint64_t				getMisses() const { return mMisses; }
+
+private:
+	std::string				pathFor(const uint64_t hash) const;
+	// Decode the source into a new cache file for the hash.
+	void					add(const std::string &source, const uint64_t hash, const uint64_t source_size);
+
+	const std::string		mDirectory;
+	uint64_t				mMaxBytes;
+	std::mutex				mTrimMutex;
+	std::atomic<uint64_t>	mHits,
+							mMisses;
+};
+
+} // namespace gif
+
+#endif
@@ -0,0 +1,108 @@
+#include "gif_color_census.h"
+
+#include <algorithm>
+
+namespace gif {
+
+/**
+ * @class gif::ColorCensus
+ */
+const size_t ColorCensus::MAX_COLORS;
+
+ColorCensus::ColorCensus()
+		: mKeys(SLOT_COUNT, 0)
+		, mIndices(SLOT_COUNT, 0) {
+	mColors.reserve(MAX_COLORS);
+}
+
+void ColorCensus::clear() {
+	if (mColors.empty()) return;
+	std::fill(mKeys.begin(), mKeys.end(), 0);
+	mColors.clear();
+}
+
+bool ColorCensus::add(const gif::BitmapView &bm, const size_t max_size) {
+	if (bm.empty()) return true;
+	const size_t				limit = std::min(max_size, MAX_COLORS);
+	mScratch.resize(bm.mWidth);
+	// Flat areas repeat the same color, which skips the table.
+	uint32_t					last = 0;
+	for (int32_t y=0; y<bm.mHeight; ++y) {
+		const gif::ColorA8u*	row = bm.row(y, mScratch.data());
+		for (int32_t x=0; x<bm.mWidth; ++x) {
+			const gif::ColorA8u&	c = row[x];
+			const uint32_t		k = key(c);
+			if (k == last) continue;
+			last = k;
+			const size_t		s = probe(k);
+			if (mKeys[s] == k) continue;
+			if (mColors.size() >= limit) return false;
+			mKeys[s] = k;
+			mIndices[s] = static_cast<uint8_t>(mColors.size());
+			mColors.push_back(gif::ColorA8u(c.r, c.g, c.b, 255));
+		}
+	}
+	return true;
+}
+
+void ColorCensus::setTo(const gif::Palette &p) {
+	clear();
+	const size_t				count = std::min(p.size(), MAX_COLORS);
+	for (size_t k=0; k<count; ++k) {
+		const gif::ColorA8u&	c = p.mColors[k];
+		const uint32_t			kk = key(c);
+		const size_t			s = probe(kk);
+		if (mKeys[s] != kk) {
+			mKeys[s] = kk;
+			mIndices[s] = static_cast<uint8_t>(k);
+		}
+		mColors.push_back(gif::ColorA8u(c.r, c.g, c.b, 255));
+	}
+}
+
+int32_t ColorCensus::find(const gif::ColorA8u &c) const {
+	const uint32_t				k = key(c);
+	const size_t				s = probe(k);
+	return (mKeys[s] == k ? mIndices[s] : -1);
+}
+
+bool ColorCensus::contains(const ColorCensus &o) const {
+	for (const auto& c : o.mColors) {
+		if (find(c) < 0) return false;
+	}
+	return true;
+}
+
+bool ColorCensus::convert(const gif::BitmapView &bm, gif::PalettedBitmap &pbm) const {
+	if (mColors.empty() || bm.empty()) return false;
+	pbm.setTo(bm.mWidth, bm.mHeight);
+	if (bm.size() != pbm.mPixels.size()) return false;
+
+	mScratch.resize(bm.mWidth);
+	uint32_t					last = 0;
+	uint8_t						index = 0;
+	uint8_t*					dst = pbm.mPixels.data();
+	for (int32_t y=0; y<bm.mHeight; ++y) {
+		const gif::ColorA8u*	row = bm.row(y, mScratch.data());
+		for (int32_t x=0; x<bm.mWidth; ++x) {
+			const uint32_t		k = key(row[x]);
+			if (k != last) {
+				const size_t	s = probe(k);
+				if (mKeys[s] != k) return false;
+				last = k;
+				index = mIndices[s];
+			}
+			*dst++ = index;
+		}
+	}
+	return true;
+}
+
+size_t ColorCensus::probe(const uint32_t k) const {
+	size_t						s = slot(k);
+	// Never full, so this always finds the key or an empty slot.
+	while (mKeys[s] != 0 && mKeys[s] != k) s = (s + 1) & (SLOT_COUNT - 1);
+	return s;
+}
+
+} // namespace gif
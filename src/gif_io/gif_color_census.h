@@ -0,0 +1,71 @@
+#ifndef GIFIO_GIFCOLORCENSUS_H_
+#define GIFIO_GIFCOLORCENSUS_H_
+
+#include <cstdint>
+#include <vector>
+#include "gif_bitmap.h"
+
+namespace gif {
+
+/**
+ * @class gif::ColorCensus
+ * @brief The set of unique colors in a bitmap, when there are few enough to
+ * fit a color table, with each color's exact index.
+ * @description Colors are kept in a small open addressed hash table, so
+ * counting and mapping never compare color distances. Alpha is ignored,
+ * as it is by the writer.
+ */
+class ColorCensus {
+public:
+	ColorCensus();
+
+	bool						empty() const { return mColors.empty(); }
+	size_t						size() const { return mColors.size(); }
+	// The unique colors in the order they were found, which is also their index.
+	const std::vector<gif::ColorA8u>&
+								colors() const { return mColors; }
+
+	void						clear();
+	// Add the bitmap's colors. Answer false as soon as there are more than
+	// max_size unique colors, at which point the census is incomplete.
+	bool						add(const gif::BitmapView&, const size_t max_size);
+	// Replace the census with the palette's colors, each at its palette
+	// index. Duplicate colors keep the first index.
+	void						setTo(const gif::Palette&);
+
+	// Answer the index of the color, or -1 if it isn't present.
+	int32_t						find(const gif::ColorA8u&) const;
+	// Answer true if every color in the other census is present in this one.
+	bool						contains(const ColorCensus&) const;
+	// Map every pixel to its index. Answer false at the first color that isn't present.
+	bool						convert(const gif::BitmapView&, gif::PalettedBitmap&) const;
+
+private:
+	// 1024 slots for at most 256 colors keeps probe sequences short.
+	static const uint32_t		SLOT_BITS = 10;
+	static const size_t			SLOT_COUNT = 1<<SLOT_BITS;
+	static const size_t			MAX_COLORS = 1<<8;
+	// Marks a slot as used, so black can be stored.
+	static const uint32_t		USED_F = 1<<24;
+
+	static uint32_t				key(const gif::ColorA8u &c) {
+		return USED_F | (static_cast<uint32_t>(c.r) << 16) | (static_cast<uint32_t>(c.g) << 8) | c.b;
+	}
+	// Multiplicative hashing; the packed RGB bits alone cluster badly.
+	static size_t				slot(const uint32_t key) {
+		return static_cast<size_t>((key * 0x9E3779B1u) >> (32 - SLOT_BITS));
+	}
+	// Answer the slot holding key, or the empty slot where it belongs.
+	size_t						probe(const uint32_t key) const;
+
+	std::vector<uint32_t>		mKeys;
+	std::vector<uint8_t>		mIndices;
+	std::vector<gif::ColorA8u>	mColors;
+	// Rows of views that aren't RGBA are converted here.
+	mutable std::vector<gif::ColorA8u>
+								mScratch;
+};
+
+} // namespace gif
+
+#endif
@@ -0,0 +1,274 @@
+#include "gif_color_index.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GIFIO_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace gif {
+
+/**
+ * @class gif::ToColorIndexInverseMap
+ */
+ToColorIndexInverseMap::ToColorIndexInverseMap()
+		: mCellState(new std::atomic<uint8_t>[CELL_COUNT]) {
+	mCells.resize(CELL_COUNT);
+	for (size_t k=0; k<CELL_COUNT; ++k) mCellState[k] = CELL_EMPTY;
+}
+
+void ToColorIndexInverseMap::setTo(const gif::Palette &pal) {
+	const size_t		size = std::min<size_t>(pal.size(), 256);
+	// Pad to the SIMD width with entries too distant to ever match.
+	const size_t		padded = (size + LANES - 1) / LANES * LANES;
+	mSize = size;
+	mR.assign(padded, static_cast<int16_t>(FAR_CHANNEL));
+	mG.assign(padded, static_cast<int16_t>(FAR_CHANNEL));
+	mB.assign(padded, static_cast<int16_t>(FAR_CHANNEL));
+	for (size_t k=0; k<size; ++k) {
+		mR[k] = pal.mColors[k].r;
+		mG[k] = pal.mColors[k].g;
+		mB[k] = pal.mColors[k].b;
+	}
+	for (size_t k=0; k<CELL_COUNT; ++k) mCellState[k].store(CELL_EMPTY, std::memory_order_relaxed);
+}
+
+void ToColorIndexInverseMap::matchSpan(const gif::ColorA8u *src, uint8_t *dst, const size_t size) const {
+	for (size_t k=0; k<size; ++k) dst[k] = static_cast<uint8_t>(match(src[k]));
+}
+
+size_t ToColorIndexInverseMap::matchSlow(const gif::ColorA8u &c, const size_t ci) const {
+	if (mSize < 1) return 0;
+	uint8_t				state = mCellState[ci].load(std::memory_order_acquire);
+	if (state == CELL_EMPTY) {
+		uint8_t			expected = CELL_EMPTY;
+		if (mCellState[ci].compare_exchange_strong(expected, CELL_BUILDING, std::memory_order_acquire)) {
+			buildCell(ci, mCells[ci]);
+			state = (mCells[ci].mCount > 0 ? CELL_READY : CELL_EXHAUSTIVE);
+			mCellState[ci].store(state, std::memory_order_release);
+		} else {
+			state = expected;
+		}
+	}
+	if (state == CELL_READY) return matchCandidates(c, mCells[ci]);
+	if (state == CELL_BUILDING) {
+		// Another thread is filling this cell, so answer without it.
+		Cell			cell;
+		buildCell(ci, cell);
+		if (cell.mCount > 0) return matchCandidates(c, cell);
+	}
+	return matchExhaustive(c);
+}
+
+void ToColorIndexInverseMap::buildCell(const size_t ci, Cell &cell) const {
+	const int32_t			mask = (1<<CELL_BITS) - 1;
+	const int32_t			extent = (1<<CELL_SHIFT) - 1;
+	const int16_t			r0 = static_cast<int16_t>((ci >> (2*CELL_BITS)) << CELL_SHIFT), r1 = r0 + extent,
+							g0 = static_cast<int16_t>(((ci >> CELL_BITS) & mask) << CELL_SHIFT), g1 = g0 + extent,
+							b0 = static_cast<int16_t>((ci & mask) << CELL_SHIFT), b1 = b0 + extent;
+
+	// Nearest and furthest distance from each entry to the cell.
+	int16_t					near_d[256], far_d[256];
+	const size_t			padded = mR.size();
+#if defined(GIFIO_SSE2)
+	const __m128i			zero = _mm_setzero_si128();
+	const __m128i			vr0 = _mm_set1_epi16(r0), vr1 = _mm_set1_epi16(r1),
+							vg0 = _mm_set1_epi16(g0), vg1 = _mm_set1_epi16(g1),
+							vb0 = _mm_set1_epi16(b0), vb1 = _mm_set1_epi16(b1);
+	for (size_t k=0; k<padded; k+=LANES) {
+		const __m128i		r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mR.data() + k));
+		const __m128i		g = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mG.data() + k));
+		const __m128i		b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mB.data() + k));
+		const __m128i		fd = _mm_add_epi16(	_mm_add_epi16(	_mm_max_epi16(_mm_sub_epi16(r, vr0), _mm_sub_epi16(vr1, r)),
+																_mm_max_epi16(_mm_sub_epi16(g, vg0), _mm_sub_epi16(vg1, g))),
+												_mm_max_epi16(_mm_sub_epi16(b, vb0), _mm_sub_epi16(vb1, b)));
+		const __m128i		nd = _mm_add_epi16(	_mm_add_epi16(	_mm_max_epi16(zero, _mm_max_epi16(_mm_sub_epi16(vr0, r), _mm_sub_epi16(r, vr1))),
+																_mm_max_epi16(zero, _mm_max_epi16(_mm_sub_epi16(vg0, g), _mm_sub_epi16(g, vg1)))),
+												_mm_max_epi16(zero, _mm_max_epi16(_mm_sub_epi16(vb0, b), _mm_sub_epi16(b, vb1))));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(far_d + k), fd);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(near_d + k), nd);
+	}
+#else
+	for (size_t k=0; k<padded; ++k) {
+		const int16_t		r = mR[k], g = mG[k], b = mB[k];
+		far_d[k] = static_cast<int16_t>(	std::max<int16_t>(r - r0, r1 - r)
+											+ std::max<int16_t>(g - g0, g1 - g)
+											+ std::max<int16_t>(b - b0, b1 - b));
+		near_d[k] = static_cast<int16_t>(	std::max<int16_t>(0, std::max<int16_t>(r0 - r, r - r1))
+											+ std::max<int16_t>(0, std::max<int16_t>(g0 - g, g - g1))
+											+ std::max<int16_t>(0, std::max<int16_t>(b0 - b, b - b1)));
+	}
+#endif
+	int16_t					best_far = std::numeric_limits<int16_t>::max();
+	for (size_t k=0; k<mSize; ++k) best_far = std::min(best_far, far_d[k]);
+
+	cell.mCount = 0;
+	for (size_t k=0; k<mSize; ++k) {
+		if (near_d[k] > best_far) continue;
+		if (cell.mCount >= MAX_CANDIDATES) {
+			cell.mCount = 0;
+			return;
+		}
+		cell.mCandidates[cell.mCount++] = static_cast<uint8_t>(k);
+	}
+}
+
+size_t ToColorIndexInverseMap::matchExhaustive(const gif::ColorA8u &c) const {
+	const size_t			padded = mR.size();
+#if defined(GIFIO_SSE2)
+	// Eight 16 bit distances at a time. Each lane keeps its first minimum,
+	// then the lanes are reduced to the lowest index of the smallest distance.
+	const __m128i			zero = _mm_setzero_si128();
+	const __m128i			cr = _mm_set1_epi16(c.r), cg = _mm_set1_epi16(c.g), cb = _mm_set1_epi16(c.b);
+	const __m128i			step = _mm_set1_epi16(static_cast<int16_t>(LANES));
+	__m128i					index = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7);
+	__m128i					best_d = _mm_set1_epi16(std::numeric_limits<int16_t>::max());
+	__m128i					best_i = zero;
+	for (size_t k=0; k<padded; k+=LANES) {
+		const __m128i		dr = _mm_sub_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(mR.data() + k)), cr);
+		const __m128i		dg = _mm_sub_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(mG.data() + k)), cg);
+		const __m128i		db = _mm_sub_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(mB.data() + k)), cb);
+		const __m128i		d = _mm_add_epi16(	_mm_add_epi16(	_mm_max_epi16(dr, _mm_sub_epi16(zero, dr)),
+																_mm_max_epi16(dg, _mm_sub_epi16(zero, dg))),
+												_mm_max_epi16(db, _mm_sub_epi16(zero, db)));
+		const __m128i		lt = _mm_cmplt_epi16(d, best_d);
+		best_d = _mm_min_epi16(d, best_d);
+		best_i = _mm_or_si128(_mm_and_si128(lt, index), _mm_andnot_si128(lt, best_i));
+		index = _mm_add_epi16(index, step);
+	}
+	int16_t					lane_d[LANES], lane_i[LANES];
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(lane_d), best_d);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(lane_i), best_i);
+	int32_t					d = lane_d[0];
+	size_t					i = static_cast<size_t>(lane_i[0]);
+	for (size_t k=1; k<LANES; ++k) {
+		if (lane_d[k] < d || (lane_d[k] == d && static_cast<size_t>(lane_i[k]) < i)) {
+			d = lane_d[k];
+			i = static_cast<size_t>(lane_i[k]);
+		}
+	}
+	return i;
+#else
+	int32_t					best_d = std::numeric_limits<int32_t>::max();
+	size_t					best_i = 0;
+	for (size_t k=0; k<padded; ++k) {
+		const int32_t		d = std::abs(mR[k] - c.r) + std::abs(mG[k] - c.g) + std::abs(mB[k] - c.b);
+		if (d < best_d) {
+			best_d = d;
+			best_i = k;
+		}
+	}
+	return best_i;
+#endif
+}
+
+/**
+ * @class gif::ToColorIndexTable
+ */
+namespace {
+const char			TABLE_MAGIC[8] = { 'G', 'I', 'F', 'I', 'O', 'T', 'B', 'L' };
+}
+
+ToColorIndexTableRef ToColorIndexTable::build(const gif::Palette &p, const uint32_t bits) {
+	if (p.empty() || p.size() > 256) throw std::runtime_error("gif::ToColorIndexTable::build() palette must have 1 to 256 colors");
+	if (bits < MIN_BITS || bits > MAX_BITS) throw std::runtime_error("gif::ToColorIndexTable::build() bits must be 4 to 8");
+
+	ToColorIndexTableRef		ans(new ToColorIndexTable());
+	ans->mPalette = p;
+	ans->mBits = bits;
+	ans->mShift = 8 - bits;
+	ans->mTable.resize(static_cast<size_t>(1) << (3 * bits));
+
+	// Each entry is the nearest match for the center of its block of colors.
+	ToColorIndexInverseMap		search;
+	search.setTo(p);
+	const size_t				side = static_cast<size_t>(1) << bits;
+	const uint32_t				center = (1 << ans->mShift) >> 1;
+	const uint32_t				shift = ans->mShift;
+	uint8_t*					table = ans->mTable.data();
+	parallel_for(side, parallel_ranges(side, 1, 0), [&search, side, center, shift, table](const size_t begin, const size_t end, const size_t) {
+		for (size_t r=begin; r<end; ++r) {
+			for (size_t g=0; g<side; ++g) {
+				uint8_t*		dst = table + (r * side + g) * side;
+				for (size_t b=0; b<side; ++b) {
+					const gif::ColorA8u	c(	static_cast<uint8_t>((r << shift) + center),
+											static_cast<uint8_t>((g << shift) + center),
+											static_cast<uint8_t>((b << shift) + center));
+					dst[b] = static_cast<uint8_t>(search.match(c));
+				}
+			}
+		}
+	});
+	return ans;
+}
+
+ToColorIndexTableRef ToColorIndexTable::load(const std::string &path) {
+	std::ifstream				in(path, std::ios::in | std::ios::binary);
+	if (!in) throw std::runtime_error("gif::ToColorIndexTable::load() can't open " + path);
+
+	char						magic[8];
+	uint8_t						header[4];
+	in.read(magic, sizeof(magic));
+	in.read(reinterpret_cast<char*>(header), sizeof(header));
+	if (!in || std::memcmp(magic, TABLE_MAGIC, sizeof(magic)) != 0) throw std::runtime_error("gif::ToColorIndexTable::load() not a table file " + path);
+	if (header[0] != FILE_VERSION) throw std::runtime_error("gif::ToColorIndexTable::load() unsupported version in " + path);
+	const uint32_t				bits = header[1];
+	const size_t				count = static_cast<size_t>(header[2]) | (static_cast<size_t>(header[3]) << 8);
+	if (bits < MIN_BITS || bits > MAX_BITS || count < 1 || count > 256) throw std::runtime_error("gif::ToColorIndexTable::load() bad header in " + path);
+
+	ToColorIndexTableRef		ans(new ToColorIndexTable());
+	ans->mBits = bits;
+	ans->mShift = 8 - bits;
+	std::vector<uint8_t>		rgb(count * 3);
+	in.read(reinterpret_cast<char*>(rgb.data()), rgb.size());
+	ans->mPalette.mColors.reserve(count);
+	for (size_t k=0; k<count; ++k) ans->mPalette.mColors.push_back(gif::ColorA8u(rgb[k*3], rgb[k*3+1], rgb[k*3+2]));
+	ans->mTable.resize(static_cast<size_t>(1) << (3 * bits));
+	in.read(reinterpret_cast<char*>(ans->mTable.data()), ans->mTable.size());
+	if (!in) throw std::runtime_error("gif::ToColorIndexTable::load() file is truncated " + path);
+	for (const auto i : ans->mTable) {
+		if (i >= count) throw std::runtime_error("gif::ToColorIndexTable::load() bad index in " + path);
+	}
+	return ans;
+}
+
+void ToColorIndexTable::save(const std::string &path) const {
+	std::ofstream				out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out) throw std::runtime_error("gif::ToColorIndexTable::save() can't open " + path);
+
+	const size_t				count = mPalette.size();
+	const uint8_t				header[4] = {	FILE_VERSION, static_cast<uint8_t>(mBits),
+												static_cast<uint8_t>(count & 0xff), static_cast<uint8_t>(count >> 8) };
+	out.write(TABLE_MAGIC, sizeof(TABLE_MAGIC));
+	out.write(reinterpret_cast<const char*>(header), sizeof(header));
+	for (const auto& c : mPalette.mColors) {
+		const uint8_t			rgb[3] = { c.r, c.g, c.b };
+		out.write(reinterpret_cast<const char*>(rgb), sizeof(rgb));
+	}
+	out.write(reinterpret_cast<const char*>(mTable.data()), mTable.size());
+	out.close();
+	if (out.fail()) throw std::runtime_error("gif::ToColorIndexTable::save() failed writing " + path);
+}
+
+void ToColorIndexTable::setTo(const gif::Palette &p) {
+	// Alpha isn't saved, so only compare RGB.
+	mFixed = (p.size() == mPalette.size());
+	for (size_t k=0; mFixed && k<p.size(); ++k) {
+		const gif::ColorA8u&	a = p.mColors[k];
+		const gif::ColorA8u&	b = mPalette.mColors[k];
+		mFixed = (a.r == b.r && a.g == b.g && a.b == b.b);
+	}
+	if (!mFixed) mFallback.setTo(p);
+}
+
+void ToColorIndexTable::matchSpan(const gif::ColorA8u *src, uint8_t *dst, const size_t size) const {
+	for (size_t k=0; k<size; ++k) dst[k] = static_cast<uint8_t>(match(src[k]));
+}
+
+} // namespace gif
@@ -0,0 +1,160 @@
+#ifndef GIFIO_GIFCOLORINDEX_H_
+#define GIFIO_GIFCOLORINDEX_H_
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include "gif_algorithm.h"
+
+namespace gif {
+
+/**
+ * @class gif::ToColorIndexInverseMap
+ * @brief Find the nearest color with the same metric as the linear search
+ * (sum of absolute RGB differences), but through an inverse color map.
+ * @description The RGB cube is divided into 32x32x32 cells. The first time
+ * a cell is hit, it stores every palette entry that could be the nearest
+ * match for some color in the cell; afterwards a match only compares those
+ * few candidates. Cells with too many candidates fall back to an exact
+ * search over the whole palette, stored as a structure of arrays so it can
+ * be done with SIMD. Cells are claimed atomically, so match() is safe to call
+ * from multiple threads.
+ *
+ * This is declared publicly so it can be bound at compile time, i.e.
+ * ToPalettedBitmapT<ToColorIndexInverseMap>, which inlines match().
+ */
+class ToColorIndexInverseMap final : public ToColorIndex {
+public:
+	ToColorIndexInverseMap();
+
+	void						setTo(const gif::Palette&) override;
+	inline size_t				match(const gif::ColorA8u&) const override;
+	void						matchSpan(const gif::ColorA8u*, uint8_t*, const size_t size) const override;
+
+private:
+	static const uint32_t		CELL_BITS = 5;
+	static const uint32_t		CELL_SHIFT = 8 - CELL_BITS;
+	static const size_t			CELL_COUNT = 1<<(3*CELL_BITS);
+	static const size_t			MAX_CANDIDATES = 31;
+	static const size_t			LANES = 8;
+	static const int16_t		FAR_CHANNEL = 10000;
+	static const uint8_t		CELL_EMPTY = 0, CELL_BUILDING = 1, CELL_READY = 2, CELL_EXHAUSTIVE = 3;
+
+	struct Cell {
+		uint8_t					mCount = 0;
+		uint8_t					mCandidates[MAX_CANDIDATES];
+	};
+
+	static inline size_t		cell_index(const gif::ColorA8u &c) {
+		return	(static_cast<size_t>(c.r>>CELL_SHIFT) << (2*CELL_BITS))
+				| (static_cast<size_t>(c.g>>CELL_SHIFT) << CELL_BITS)
+				| static_cast<size_t>(c.b>>CELL_SHIFT);
+	}
+
+	// Everything but a hit on a filled cell.
+	size_t						matchSlow(const gif::ColorA8u&, const size_t cell_index) const;
+	// Fill the cell with every entry that is possibly the nearest to some color
+	// in the cell. An entry is excluded if even its closest point in the cell is
+	// further away than the best worst-case distance of any entry. If there are
+	// too many candidates the cell is left empty.
+	void						buildCell(const size_t ci, Cell&) const;
+	// Candidates are in palette order, so ties resolve to the lowest index, same as a linear search.
+	inline size_t				matchCandidates(const gif::ColorA8u&, const Cell&) const;
+	size_t						matchExhaustive(const gif::ColorA8u&) const;
+
+	size_t						mSize = 0;
+	// Palette as a structure of arrays, padded to a multiple of LANES.
+	std::vector<int16_t>		mR, mG, mB;
+	// The lazily filled inverse map. Cells are only written by the thread
+	// that claims them, and only read once published.
+	mutable std::vector<Cell>	mCells;
+	std::unique_ptr<std::atomic<uint8_t>[]>
+								mCellState;
+};
+
+class ToColorIndexTable;
+using ToColorIndexTableRef = std::shared_ptr<ToColorIndexTable>;
+
+/**
+ * @class gif::ToColorIndexTable
+ * @brief A complete inverse map for one palette: the nearest entry for every
+ * color at reduced precision, so a match is a single lookup.
+ * @description Building the table takes a while, so the intent is to build it
+ * once for a palette trained ahead of time (BitmapToPalette::begin(), add()
+ * across a corpus, end()), save() it, and have every encoder load() it with
+ * no setup cost:
+ *     auto table = gif::ToColorIndexTable::load(path);
+ *     writer.setBitmapToPalette(gif::BitmapToPalette::createFixed(table->palette()))
+ *           .setToColorIndex(table);
+ * Precision is in bits per channel. At 6, the default, the table is 256 KB and
+ * each entry is the nearest match for the center of a 4x4x4 block of colors;
+ * at 8 it's exact but 16 MB. Any palette other than its own is matched through
+ * an inverse map instead.
+ */
+class ToColorIndexTable final : public ToColorIndex {
+public:
+	// Throw on error.
+	static ToColorIndexTableRef	build(const gif::Palette&, const uint32_t bits = 6);
+	static ToColorIndexTableRef	load(const std::string &path);
+	void						save(const std::string &path) const;
+
+	const gif::Palette&			palette() const { return mPalette; }
+	uint32_t					bits() const { return mBits; }
+
+	void						setTo(const gif::Palette&) override;
+	inline size_t				match(const gif::ColorA8u&) const override;
+	void						matchSpan(const gif::ColorA8u*, uint8_t*, const size_t size) const override;
+
+private:
+	ToColorIndexTable() { }
+
+	static const uint32_t		MIN_BITS = 4;
+	static const uint32_t		MAX_BITS = 8;
+	static const uint8_t		FILE_VERSION = 1;
+
+	gif::Palette				mPalette;
+	uint32_t					mBits = 0,
+								mShift = 0;
+	std::vector<uint8_t>		mTable;
+	bool						mFixed = false;
+	ToColorIndexInverseMap		mFallback;
+};
+
+/**
+ * @class gif::ToColorIndexInverseMap IMPLEMENTATION
+ */
+inline size_t ToColorIndexInverseMap::match(const gif::ColorA8u &c) const {
+	const size_t			ci = cell_index(c);
+	if (mCellState[ci].load(std::memory_order_acquire) == CELL_READY) return matchCandidates(c, mCells[ci]);
+	return matchSlow(c, ci);
+}
+
+inline size_t ToColorIndexInverseMap::matchCandidates(const gif::ColorA8u &c, const Cell &cell) const {
+	int32_t					best_d = 0x7fffffff;
+	size_t					best_i = 0;
+	for (uint8_t k=0; k<cell.mCount; ++k) {
+		const size_t		i = cell.mCandidates[k];
+		const int32_t		dr = mR[i] - c.r, dg = mG[i] - c.g, db = mB[i] - c.b;
+		const int32_t		d = (dr < 0 ? -dr : dr) + (dg < 0 ? -dg : dg) + (db < 0 ? -db : db);
+		if (d < best_d) {
+			best_d = d;
+			best_i = i;
+		}
+	}
+	return best_i;
+}
+
+/**
+ * @class gif::ToColorIndexTable IMPLEMENTATION
+ */
+inline size_t ToColorIndexTable::match(const gif::ColorA8u &c) const {
+	if (!mFixed) return mFallback.match(c);
+	return mTable[	(static_cast<size_t>(c.r >> mShift) << (2 * mBits))
+					| (static_cast<size_t>(c.g >> mShift) << mBits)
+					| static_cast<size_t>(c.b >> mShift)];
+}
+
+} // namespace gif
+
+#endif
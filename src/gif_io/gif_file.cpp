@@ -1,519 +1,1642 @@
-#include "gif_file.h"
-
-#include <algorithm>
-#include <cmath>
-#include <cstdint>
-#include <iostream>
-#include <memory>
-#include <sstream>
-
-#include <unordered_map>
-#include <vector>
-#include "gif_list.h"
-#include "lzw_reader.h"
-
-namespace gif {
-
-namespace {
-
-const std::string	SIG("GIF");
-enum class Version { kMissing, k87a, k89a };
-const uint8_t		IMAGE_DESCRIPTOR_LABEL(0x2C);
-
-size_t				color_count(const size_t encoded) {
-	return static_cast<size_t>(std::pow(2, encoded+1));
-}
-
-int32_t				read_2_byte_int(const std::vector<char> &buffer, size_t &position) {
-	uint8_t		a = buffer[position++],
-				b = buffer[position++];
-	return (b<<8) | a;
-}
-
-uint8_t				count_bits(const uint8_t value) {
-	uint8_t			ans = 0;
-	for (size_t k=0; k<8; ++k) {
-		if ((value&(1<<k)) != 0) ++ans;
-	}
-	return ans;
-}
-
-void				write_2_byte_int(const int16_t value, std::ostream &output) {
-	uint8_t			a = static_cast<uint8_t>(value&0xff),
-					b = static_cast<uint8_t>((value>>8)&0xff);
-	output << a << b;
-}
-
-std::string			read_string(const std::vector<char> &buffer, const size_t size, size_t &position) {
-	std::stringstream	buf;
-	for (size_t k=0; k<size; ++k) buf << buffer[position++];
-	return buf.str();
-}
-
-struct ColorTable {
-	std::vector<gif::ColorA8u>	mColors;
-
-	void			from(const gif::Bitmap &src, const size_t max_size = (1<<8)) {
-		mColors.clear();
-		if (src.empty()) return;
-
-		// Simple utility to find all colors and eliminate based on a similarity until we're down to our max size.
-		std::unordered_map<gif::ColorA8u, size_t>	ct;
-		for (const auto& pix : src.mPixels) ct[pix]++;
-
-		// For now, just clip based the most-used colors. CLEARLY THIS NEEDS TO CHANGE
-		using Counter = std::pair<gif::ColorA8u, size_t>;
-		std::vector<Counter>						vec;
-		for (const auto& p : ct) vec.push_back(Counter(p.first, p.second));
-		std::sort(vec.begin(), vec.end(), [](const Counter &a, const Counter &b)->bool{return a.second > b.second;});
-		if (vec.size() > max_size) vec.resize(max_size);
-		mColors.reserve(max_size);
-		for (const auto& p : vec) mColors.push_back(p.first);
-	}
-
-	size_t			read(const std::vector<char> &buffer, const size_t count, size_t position) {
-		for (size_t k=0; k<count; ++k) {
-			const uint8_t	r = buffer[position++],
-							g = buffer[position++],
-							b = buffer[position++];
-			mColors.push_back(gif::ColorA8u(r, g, b));
-		}
-		return position;
-	}
-
-	void			write(std::ostream &output) const {
-		write(mColors, output);
-	}
-
-	void			write(const std::vector<gif::ColorA8u> &clrs, std::ostream &output) const {
-		for (const auto& c : clrs) {
-			output << c.r << c.g << c.b;
-		}
-	}
-};
-
-// A place to stuff common read info, as well as any scratch data
-struct BlockReadArgs {
-	BlockReadArgs() = delete;
-	BlockReadArgs(const BlockReadArgs&) = delete;
-	BlockReadArgs(const int32_t screen_w, const int32_t screen_h, const ColorTable &global_ct, gif::ListConstructor &lc)
-			: mScreenWidth(screen_w), mScreenHeight(screen_h), mGlobalColorTable(global_ct), mConstructor(lc) { }
-
-	// Create the table and initialize the bitmap
-	// Provide the target area within the bitmap.
-	void						startLzwDecode(const int32_t left, const int32_t top, const int32_t width, const int32_t height) {
-		mBitmap.mWidth = mScreenWidth;
-		mBitmap.mHeight = mScreenHeight;
-		mBitmap.mPixels.resize(mScreenWidth * mScreenHeight);
-		mBitmapIndexX = left;
-		mBitmapIndexY = top;
-		mLeft = left;
-		mTop = top;
-		mRight = left + width;
-		mBottom = top + height;
-	}
-
-	// A little annoying but this is defined later in the file because the Graphic Control Extension
-	// is not declared at this point.
-	void						addPixels(const std::vector<uint8_t> &indexes, const ColorTable &t);
-
-	const int32_t				mScreenWidth,
-								mScreenHeight;
-	const ColorTable&			mGlobalColorTable;
-
-	// Decoding
-	gif::LzwReader				mDecoder;
-
-	// A single bitmap is constructed and maintained through each successive image,
-	// since the spec lets additional image data blocks leave pixels unmodified.
-	gif::Bitmap					mBitmap;
-	int32_t						mBitmapIndexX = 0,
-								mBitmapIndexY = 0;
-	// Target area, exclusive
-	int32_t						mLeft = 0, mTop = 0, mRight = 0, mBottom = 0;
-
-	// Will be cached from any GCE block before the current image block
-	GraphicControlExtensionRef	mGceRef;
-
-	// Output
-	gif::ListConstructor&		mConstructor;
-};
-
-// HEADER
-struct Header {
-	Header() { }
-	Header(const std::string &sig, const Version &v) : mSig(sig), mVersion(v) { }
-
-	std::string		mSig;
-	Version			mVersion = Version::kMissing;
-
-	bool			isGif() const { return mSig == SIG; }
-
-	size_t			read(const std::vector<char> &buffer, size_t position) {
-		mSig = read_string(buffer, 3, position);
-
-		std::string	v = read_string(buffer, 3, position);
-		if (v == "87a") mVersion = Version::k87a;
-		else if (v == "89a") mVersion = Version::k89a;
-
-		return position;
-	}
-
-	void			write(std::ostream &buf) {
-		buf << mSig;
-		if (mVersion == Version::k87a) buf << "87a";
-		else if (mVersion == Version::k89a) buf << "89a";
-	}
-};
-
-// LOGICAL-SCREEN
-struct LogicalScreen {
-	static const uint32_t	GLOBAL_COLOR_TABLE_F = (1<<0);
-	static const uint32_t	SORT_F = (1<<1);
-
-	int32_t			mScreenWidth = 0, mScreenHeight = 0;
-	uint32_t		mFlags = 0;
-	uint8_t			mColorResolution = 0,
-					mSizeOfGlobalColorTable = 0,
-					mBackgroundColorIndex = 0,
-					mPixelAspectRatio = 0;
-
-	bool			hasGlobalColorTable() const { return (mFlags&GLOBAL_COLOR_TABLE_F) != 0; }
-
-	size_t			read(const std::vector<char> &buffer, size_t position) {
-		// Screen size
-		mScreenWidth = read_2_byte_int(buffer, position);
-		mScreenHeight = read_2_byte_int(buffer, position);
-
-		// Flags
-		uint8_t		a = buffer[position++];
-		if ((a&(1<<7)) != 0) mFlags |= GLOBAL_COLOR_TABLE_F;
-		mColorResolution = (a>>4)&0x7;
-		if ((a&(1<<3)) != 0) mFlags |= SORT_F;
-		mSizeOfGlobalColorTable = (a&0x7);
-
-		// Background color index
-		mBackgroundColorIndex = buffer[position++];
-		
-		// Aspect ratio
-		mPixelAspectRatio = buffer[position++];
-
-		return position;
-	}
-
-	void			write(std::ostream &output, const size_t global_ct_size) {
-		// Screen size
-		write_2_byte_int(static_cast<int16_t>(mScreenWidth), output);
-		write_2_byte_int(static_cast<int16_t>(mScreenHeight), output);
-
-		// Flags
-		uint8_t			f = 0;
-		if ((mFlags&GLOBAL_COLOR_TABLE_F) != 0) {
-			// Has global color table flag
-			f |= 1<<7;
-			// Size of global color table
-			uint8_t		bits = 1;
-			size_t		size = global_ct_size;
-			while (size > 4) {
-				size /= 2;
-				++bits;
-			}
-			f |= bits;
-		}
-		// XXX Ideally this is based on an analysis of the original image,
-		// but I'm really not sure how this is ever used
-		f |= 0x7 << 4;	// color resolution
-		output << f;
-
-		// Background color index
-		output << mBackgroundColorIndex;
-
-		// Aspect ratio
-		output << mPixelAspectRatio;
-	}
-};
-
-class ImageData : public Block {
-public:
-	static const uint32_t	LOCAL_COLOR_TABLE_F = (1<<0);
-	static const uint32_t	INTERLACE_F = (1<<1);
-	static const uint32_t	SORT_F = (1<<2);
-
-	ImageData() { }
-
-	int32_t					mLeftPosition = 0,
-							mTopPosition = 0,
-							mWidth = 0,
-							mHeight = 0;
-	uint32_t				mFlags = 0;
-	uint8_t					mSizeOfLocalColorTable = 0;
-	ColorTable				mColorTable;
-
-	// We are past the image separator byte here
-	size_t					read(const std::vector<char> &buffer, size_t position, BlockReadArgs &bra) {
-		const ColorTable*	ct = &bra.mGlobalColorTable;
-
-		// Image descriptor
-		mLeftPosition = read_2_byte_int(buffer, position);
-		mTopPosition = read_2_byte_int(buffer, position);
-		mWidth = read_2_byte_int(buffer, position);
-		mHeight = read_2_byte_int(buffer, position);
-		
-		uint8_t		fields = buffer[position++];
-		if ((fields&(1<<7)) != 0) mFlags |= LOCAL_COLOR_TABLE_F;
-		if ((fields&(1<<6)) != 0) mFlags |= INTERLACE_F;
-		if ((fields&(1<<5)) != 0) mFlags |= SORT_F;
-		mSizeOfLocalColorTable = (fields&0x7);
-
-		// Optional local color table
-		if ((mFlags&LOCAL_COLOR_TABLE_F) != 0) {
-			position = mColorTable.read(buffer, color_count(mSizeOfLocalColorTable), position);
-			ct = &mColorTable;
-		}
-
-		// Image data
-		uint8_t			lzw_code_size = buffer[position++],
-						block_size = 0;
-		bra.startLzwDecode(mLeftPosition, mTopPosition, mWidth, mHeight);
-		gif::LzwReader&	decoder(bra.mDecoder);
-		auto			flush_fn = [&bra, &ct](const std::vector<uint8_t> &data) { bra.addPixels(data, *ct); };
-		decoder.begin(lzw_code_size, flush_fn);
-		while ( (block_size = buffer[position++]) != 0) {
-			decoder.decode(buffer.begin()+position, buffer.begin()+(position+block_size));
-			position += block_size;
-		}
-		const double	delay = (bra.mGceRef ? bra.mGceRef->mDelay : 0.0);
-		bra.mConstructor.addFrame(bra.mBitmap, delay);
-		return position;
-	}
-};
-
-class AppExtension : public Block {
-public:
-	AppExtension() { }
-
-	// We are past the introducer and app bytes here
-	size_t			read(const std::vector<char> &buffer, size_t position) {
-		uint8_t		block_size = buffer[position++];
-		if (block_size != 11) throw std::runtime_error("AppExtension has illegal Block Size");
-
-		// identifier
-		for (size_t k=0; k<8; ++k) ++position;
-
-		// authentication
-		for (size_t k=0; k<3; ++k) ++position;
-
-		return readSubBlocks(buffer, position);
-	}
-};
-
-class BlockList {
-public:
-	BlockList() { }
-
-	size_t			read(const uint8_t byte1, const std::vector<char> &buffer, size_t position, BlockReadArgs &bra) {
-		// Select between:
-		//		Image Descriptor				- 0x2c (image)
-		//		Graphic Control Extension		- 0x21 (extension), 0xf9 (graphic control)
-		//		Application Extension			- 0x21 (extension), 0xff (application)
-		//		Comment Extension				- 0x21 (extension), 0xfe (comment)
-		//		Plain Text Extension			- 0x21 (extension), 0x01 (plain text)
-		if (byte1 == 0x21) {
-			uint8_t		byte2 = buffer[position++];
-			// text
-			if (byte2 == 0x01) {
-				// XXX unimplemented, don't have any examples
-				std::cout << "text block unimplemented" << std::endl;
-				throw std::runtime_error("text block unimplemented");
-			// commment
-			} else if (byte2 == 0xfe) {
-				// XXX unimplemented, don't have any examples
-				std::cout << "comment block unimplemented" << std::endl;
-				throw std::runtime_error("comment block unimplemented");
-			// graphic control
-			} else if (byte2 == 0xf9) {
-				std::shared_ptr<GraphicControlExtension>	block = std::make_shared<GraphicControlExtension>();
-				position = block->read(buffer, position);
-				// Provide me to the next image block
-				bra.mGceRef = block;
-				mBlocks.push_back(block);
-			// application
-			} else if (byte2 == 0xff) {
-				std::shared_ptr<AppExtension>				block = std::make_shared<AppExtension>();
-				position = block->read(buffer, position);
-				mBlocks.push_back(block);
-			} else {
-				throw std::runtime_error("Read block on invalid extension byte");
-			}
-		// Image
-		} else if (byte1 == IMAGE_DESCRIPTOR_LABEL) {
-			std::shared_ptr<ImageData>						block = std::make_shared<ImageData>();
-			position = block->read(buffer, position, bra);
-			mBlocks.push_back(block);
-			// Clear out my associated GCE
-			bra.mGceRef.reset();
-		} else {
-			throw std::runtime_error("Read block on invalid introducer byte");
-		}
-		return position;
-	}
-
-	std::vector<BlockRef>	mBlocks;
-};
-
-/**
- * BlockReadArgs
- * Need to implement a function after the Graphic Control Extension block is defined.
- */
-void BlockReadArgs::addPixels(const std::vector<uint8_t> &indexes, const ColorTable &t) {
-	const bool				has_transparent = (mGceRef && mGceRef->hasTransparentColor());
-
-	for (const auto& it : indexes) {
-		const size_t		bi = static_cast<size_t>((mBitmapIndexY * mScreenWidth) + mBitmapIndexX);
-		if (bi >= mBitmap.mPixels.size()) return;
-		if (++mBitmapIndexX >= mRight) {
-			mBitmapIndexX = mLeft;
-			++mBitmapIndexY;
-		}
-		if (has_transparent && it == mGceRef->mTransparencyIndex) continue;
-
-		if (it < t.mColors.size()) {
-			mBitmap.mPixels[bi] = t.mColors[it];
-		} else {
-			// error
-			mBitmap.mPixels[bi] = gif::ColorA8u(0, 0, 0, 0);
-		}
-	}
-}
-
-}
-
-/**
- * @class gif::Reader
- */
-Reader::Reader(std::string path)
-		: mPath(path) {
-}
-
-bool Reader::read(gif::ListConstructor &constructor) {
-	try {
-		std::ifstream		input(mPath, std::ios::binary);
-		std::vector<char>	buffer(	(std::istreambuf_iterator<char>(input)), 
-									(std::istreambuf_iterator<char>()));
-		input.close();
-
-		Header				header;
-		LogicalScreen		screen;
-		ColorTable			globalColorTable;
-		BlockList			blocks;
-
-		size_t				pos = 0;
-
-		// Header
-		if (buffer.size() < 6) throw std::runtime_error("No header");
-		pos = header.read(buffer, pos);
-		if (!header.isGif()) throw std::runtime_error("Header signature is not GIF");
-		if (header.mVersion == Version::kMissing) throw std::runtime_error("Header has no version");
-
-		// Logical Screen
-		pos = screen.read(buffer, pos);
-
-		// Global color table
-		if (screen.hasGlobalColorTable()) {
-			pos = globalColorTable.read(buffer, color_count(screen.mSizeOfGlobalColorTable), pos);
-		}
-
-		BlockReadArgs		bra(screen.mScreenWidth, screen.mScreenHeight, globalColorTable, constructor);
-		while (pos < buffer.size()) {
-			const uint8_t	byte1 = buffer[pos++];
-			if (byte1 == 0x3b) {
-				// Trailer, success
-				constructor.readerFinished();
-				return true;
-			} else {
-				pos = blocks.read(byte1, buffer, pos, bra);
-			}
-		}
-		constructor.readerFinished();
-	} catch (std::exception const &ex) {
-		std::cout << "Error in gif::Reader::read()=" << ex.what() << std::endl;
-	}
-	return false;
-}
-
-/**
- * @class gif::WriterSettings
- */
-void WriterSettings::makeGlobalTable(const gif::Bitmap &bm) {
-	if (!mBitmapToPalette) throw std::runtime_error("makeGlobalTable() missing BitmapToPalette algorithm");
-	const size_t		max_size = 1<<8;
-	mBitmapToPalette->convert(bm, max_size, mGlobalPalette);
-	mGlobalPalette.clip(max_size);
-}
-
-/**
- * @class gif::Writer
- */
-Writer::Writer(std::string path)
-		: base([this](const gif::Bitmap &src, gif::Bitmap &dst){convert(src, dst);}, path) {
-}
-
-void Writer::convert(const gif::Bitmap &src, gif::Bitmap &dst) const {
-	dst = src;
-}
-
-/**
- * @func gif::write_header()
- * &brief Write the grammar for "Header <Logical Screen>"
- */
-void		write_header(const gif::WriterSettings &s, std::ostream &output) {
-	// Header
-	Header				header(SIG, Version::k89a);
-	header.write(output);
-
-	// Logical screen
-	LogicalScreen		screen;
-	screen.mScreenWidth = s.mWidth;
-	screen.mScreenHeight = s.mHeight;
-	screen.mBackgroundColorIndex = s.mBackgroundColorIndex;
-	if (s.mGlobalPalette.size() > 0) {
-		screen.mFlags |= LogicalScreen::GLOBAL_COLOR_TABLE_F;
-	}
-	screen.write(output, s.mGlobalPalette.size());
-
-	// Global color table
-	if (s.mGlobalPalette.size() > 0) {
-		ColorTable().write(s.mGlobalPalette.mColors, output);
-	}
-}
-
-/**
- * @func gif::write_table_based_image()
- * &brief Write the grammar for "<Table-Based Image>"
- */
-void		write_table_based_image(const gif::WriterSettings &s, const gif::Bitmap &bm, const PalettedBitmap &pbm,
-									LzwWriter &lzw, WriterBuffer &wb, std::ostream &output) {
-		const gif::Palette*		ct = &s.mGlobalPalette;
-
-		// Image descriptor. Currently don't support subareas
-		output << IMAGE_DESCRIPTOR_LABEL;
-
-		write_2_byte_int(0, output);	// left
-		write_2_byte_int(0, output);	// top
-		write_2_byte_int(static_cast<uint16_t>(s.mWidth), output);
-		write_2_byte_int(static_cast<uint16_t>(s.mHeight), output);
-
-		// Currently don't support local color tables, interlacing or sorting		
-		uint8_t					fields = 0;
-		output << fields;
-
-		// Image data
-		const uint8_t				lzw_code_size = count_bits(static_cast<uint8_t>(ct->size()-1));
-		output << lzw_code_size;
-		wb.clear();
-		lzw.begin(lzw_code_size, [&wb](const std::vector<uint8_t> &data){wb.write(data);});
-		lzw.encode(pbm.mPixels);
-		wb.terminate();
-}
-
-} // namespace gif
+#include "gif_file.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <unordered_map>
+
+#include <vector>
+#include "gif_list.h"
+#include "lzw_reader.h"
+
+namespace gif {
+
+namespace {
+
+const std::string	SIG("GIF");
+enum class Version { kMissing, k87a, k89a };
+const uint8_t		IMAGE_DESCRIPTOR_LABEL(0x2C);
+// Interlaced images are stored in four passes, each starting at a row and
+// stepping down the image.
+const int32_t		INTERLACE_START[] = { 0, 4, 2, 1 };
+const int32_t		INTERLACE_STEP[] = { 8, 8, 4, 2 };
+// Palette reuse: a local table is kept while a frame's match error stays within
+// this ratio (plus slack, for tables that fit their own frame almost exactly).
+const double		REUSE_ERROR_RATIO(1.15);
+const double		REUSE_ERROR_SLACK(2.0);
+const size_t		MATCH_ERROR_SAMPLES(4096);
+
+// Rate control levels, from full quality down. Size is the expected bytes per
+// frame as a fraction of full quality, including the frames dropped.
+class RateLevel {
+public:
+	uint32_t		mQuality;
+	size_t			mMaxColors,
+					mKeepEvery;
+	double			mSize;
+};
+const RateLevel		RATE_LEVELS[] = {	{ 100, 256, 1, 1.0 },
+										{ 90, 256, 1, 0.8 },
+										{ 80, 256, 1, 0.6 },
+										{ 70, 128, 1, 0.43 },
+										{ 60, 128, 1, 0.37 },
+										{ 50, 64, 1, 0.29 },
+										{ 40, 64, 2, 0.13 },
+										{ 30, 32, 2, 0.1 },
+										{ 20, 32, 3, 0.063 },
+										{ 0, 16, 4, 0.035 } };
+const size_t		RATE_LEVEL_COUNT(sizeof(RATE_LEVELS) / sizeof(RATE_LEVELS[0]));
+// Before any frame is written, expect this many bytes per pixel at full quality,
+// and frame differencing to change this fraction of each frame after the first.
+const double		RATE_PRIOR_BYTES_PER_PIXEL(0.5);
+const double		RATE_PRIOR_CHANGED_AREA(0.25);
+// Bytes of each image that don't depend on its pixels or table: the graphic
+// control extension, image descriptor, code size and block framing.
+const double		RATE_FIXED_BYTES(24.0);
+// How much each written frame moves the estimate.
+const double		RATE_SMOOTHING(0.5);
+// The share of what's left of the budget held back, since frames come out over
+// their estimate about as often as under it.
+const double		RATE_HEADROOM(0.05);
+
+size_t				color_count(const size_t encoded) {
+	return static_cast<size_t>(std::pow(2, encoded+1));
+}
+
+int32_t				read_2_byte_int(const std::vector<char> &buffer, size_t &position) {
+	uint8_t		a = buffer[position++],
+				b = buffer[position++];
+	return (b<<8) | a;
+}
+
+uint8_t				count_bits(const uint8_t value) {
+	uint8_t			ans = 0;
+	for (size_t k=0; k<8; ++k) {
+		if ((value&(1<<k)) != 0) ++ans;
+	}
+	return ans;
+}
+
+// Answer the packed size field for a color table, where size = 2^(bits+1).
+uint8_t				table_size_bits(const size_t table_size) {
+	uint8_t			bits = 0;
+	size_t			size = table_size;
+	while (size > 2) {
+		size /= 2;
+		++bits;
+	}
+	return bits;
+}
+
+// FNV-1a over the colors.
+uint64_t			palette_hash(const gif::Palette &p) {
+	uint64_t		h = 14695981039346656037ULL;
+	for (const auto& c : p.mColors) {
+		const uint8_t	bytes[4] = { c.r, c.g, c.b, c.a };
+		for (const auto b : bytes) {
+			h ^= b;
+			h *= 1099511628211ULL;
+		}
+	}
+	return h;
+}
+
+void				write_2_byte_int(const int16_t value, std::ostream &output) {
+	uint8_t			a = static_cast<uint8_t>(value&0xff),
+					b = static_cast<uint8_t>((value>>8)&0xff);
+	output << a << b;
+}
+
+std::string			read_string(const std::vector<char> &buffer, const size_t size, size_t &position) {
+	std::stringstream	buf;
+	for (size_t k=0; k<size; ++k) buf << buffer[position++];
+	return buf.str();
+}
+
+struct ColorTable {
+	std::vector<gif::ColorA8u>	mColors;
+
+	size_t			read(const std::vector<char> &buffer, const size_t count, size_t position) {
+		for (size_t k=0; k<count; ++k) {
+			const uint8_t	r = buffer[position++],
+							g = buffer[position++],
+							b = buffer[position++];
+			mColors.push_back(gif::ColorA8u(r, g, b));
+		}
+		return position;
+	}
+
+	void			write(std::ostream &output) const {
+		write(mColors, output);
+	}
+
+	void			write(const std::vector<gif::ColorA8u> &clrs, std::ostream &output) const {
+		for (const auto& c : clrs) {
+			output << c.r << c.g << c.b;
+		}
+	}
+};
+
+// Answer the position past the sub-blocks' terminator.
+size_t				skip_sub_blocks(const std::vector<char> &buffer, size_t position) {
+	while (position < buffer.size()) {
+		const uint8_t	block_size = buffer[position++];
+		if (block_size == 0) return position;
+		position += block_size;
+	}
+	throw std::runtime_error("Data sub-blocks are truncated");
+}
+
+// Write the image separator, descriptor and local table, if there is one.
+void				write_image_descriptor(	const int32_t left, const int32_t top, const int32_t width, const int32_t height,
+											const bool interlaced, const gif::Palette *local_table, std::ostream &output) {
+	output << IMAGE_DESCRIPTOR_LABEL;
+
+	write_2_byte_int(static_cast<uint16_t>(left), output);
+	write_2_byte_int(static_cast<uint16_t>(top), output);
+	write_2_byte_int(static_cast<uint16_t>(width), output);
+	write_2_byte_int(static_cast<uint16_t>(height), output);
+
+	// Currently don't support sorting
+	uint8_t			fields = 0;
+	if (interlaced) fields |= (1<<6);
+	if (local_table) {
+		fields |= (1<<7);
+		fields |= table_size_bits(local_table->size());
+	}
+	output << fields;
+
+	// Local color table
+	if (local_table) {
+		ColorTable().write(local_table->mColors, output);
+	}
+}
+
+// Write the NETSCAPE2.0 application extension that makes viewers repeat the
+// animation, 0 being forever.
+void				write_loop_extension(const int32_t count, std::ostream &output) {
+	output << static_cast<uint8_t>(0x21) << static_cast<uint8_t>(0xff) << static_cast<uint8_t>(11) << "NETSCAPE2.0";
+	output << static_cast<uint8_t>(3) << static_cast<uint8_t>(1);
+	write_2_byte_int(static_cast<uint16_t>(std::max(0, std::min(count, 0xffff))), output);
+	output << static_cast<uint8_t>(0);
+}
+
+// Index-domain optimizing. Colors get ids in the order they're first seen, so
+// frames drawn from any table composite into one canvas of ids.
+const uint16_t		ID_TRANSPARENT(0);
+const uint16_t		ID_KEEP_F(0x8000);
+const size_t		ID_LIMIT(0x8000);
+const uint16_t		ID_UNDECODED(0xffff);
+
+// An area of the screen, right and bottom exclusive.
+class Area {
+public:
+	int32_t			mLeft = 0, mTop = 0, mRight = 0, mBottom = 0;
+
+	bool			empty() const { return mRight <= mLeft || mBottom <= mTop; }
+	int32_t			width() const { return mRight - mLeft; }
+	int32_t			height() const { return mBottom - mTop; }
+
+	void			add(const Area &a) {
+		if (a.empty()) return;
+		if (empty()) {
+			*this = a;
+			return;
+		}
+		mLeft = std::min(mLeft, a.mLeft);
+		mTop = std::min(mTop, a.mTop);
+		mRight = std::max(mRight, a.mRight);
+		mBottom = std::max(mBottom, a.mBottom);
+	}
+};
+
+// Answer the bounding area of the pixels where fn(a, b) is true.
+template <typename Fn>
+Area				find_area(	const std::vector<uint16_t> &a, const std::vector<uint16_t> &b,
+								const int32_t width, const int32_t height, Fn fn) {
+	Area			area;
+	area.mLeft = width;
+	area.mTop = height;
+	for (int32_t y=0; y<height; ++y) {
+		const uint16_t*	ra = a.data() + y*width;
+		const uint16_t*	rb = b.data() + y*width;
+		for (int32_t x=0; x<width; ++x) {
+			if (!fn(ra[x], rb[x])) continue;
+			area.mLeft = std::min(area.mLeft, x);
+			area.mRight = std::max(area.mRight, x+1);
+			area.mTop = std::min(area.mTop, y);
+			area.mBottom = y+1;
+		}
+	}
+	if (area.empty()) area = Area();
+	return area;
+}
+
+// An optimized frame, before its table is chosen.
+class IdFrame {
+public:
+	Area					mArea;
+	double					mDelay = 0.0;
+	bool					mDisposeToBackground = false;
+	// The ids across my area, with ID_KEEP_F where the screen already shows them.
+	std::vector<uint16_t>	mIds;
+	// The ids I draw, ascending.
+	std::vector<uint16_t>	mColors;
+	// The ids I keep, which could be drawn instead of made transparent.
+	std::vector<uint16_t>	mKeptColors;
+	bool					mHasKept = false;
+
+	// Fill my area from what the screen shows before and after me.
+	void					finish(const std::vector<uint16_t> &before, const std::vector<uint16_t> &after, const int32_t screen_width) {
+		std::vector<bool>	drawn(ID_LIMIT, false), kept(ID_LIMIT, false);
+		mIds.resize(static_cast<size_t>(mArea.width()) * mArea.height());
+		uint16_t*			dst = mIds.data();
+		for (int32_t y=mArea.mTop; y<mArea.mBottom; ++y) {
+			const size_t	row = static_cast<size_t>(y) * screen_width;
+			for (int32_t x=mArea.mLeft; x<mArea.mRight; ++x) {
+				const uint16_t	id = after[row+x];
+				if (id == before[row+x]) {
+					*dst++ = id | ID_KEEP_F;
+					kept[id] = true;
+					mHasKept = true;
+				} else {
+					*dst++ = id;
+					drawn[id] = true;
+				}
+			}
+		}
+		for (size_t k=0; k<ID_LIMIT; ++k) {
+			if (drawn[k]) mColors.push_back(static_cast<uint16_t>(k));
+			if (kept[k]) mKeptColors.push_back(static_cast<uint16_t>(k));
+		}
+	}
+};
+
+// A place to stuff common read info, as well as any scratch data
+struct BlockReadArgs {
+	BlockReadArgs() = delete;
+	BlockReadArgs(const BlockReadArgs&) = delete;
+	BlockReadArgs(	const int32_t screen_w, const int32_t screen_h, const ColorTable &global_ct, gif::ListConstructor &lc,
+					gif::LzwReader &decoder, gif::Bitmap &bitmap, std::vector<uint8_t> &indexes)
+			: mScreenWidth(screen_w), mScreenHeight(screen_h), mGlobalColorTable(global_ct)
+			, mDecoder(decoder), mBitmap(bitmap), mIndexes(indexes), mKeepIndexes(lc.wantsImages()), mConstructor(lc) { }
+
+	// Create the table and initialize the bitmap
+	// Provide the target area within the bitmap.
+	void						startLzwDecode(	const int32_t left, const int32_t top, const int32_t width, const int32_t height,
+												const bool interlaced) {
+		mBitmap.mWidth = mScreenWidth;
+		mBitmap.mHeight = mScreenHeight;
+		mBitmap.mPixels.resize(mScreenWidth * mScreenHeight);
+		mBitmapIndexX = left;
+		mBitmapIndexY = top;
+		mLeft = left;
+		mTop = top;
+		mRight = left + width;
+		mBottom = top + height;
+		mInterlaced = interlaced;
+		mInterlacePass = 0;
+	}
+
+	// A little annoying but this is defined later in the file because the Graphic Control Extension
+	// is not declared at this point.
+	void						addPixels(const std::vector<uint8_t> &indexes, const ColorTable &t);
+
+	const int32_t				mScreenWidth,
+								mScreenHeight;
+	const ColorTable&			mGlobalColorTable;
+
+	// Decoding, owned by the reader so it can be reused.
+	gif::LzwReader&				mDecoder;
+
+	// A single bitmap is constructed and maintained through each successive image,
+	// since the spec lets additional image data blocks leave pixels unmodified.
+	gif::Bitmap&				mBitmap;
+	int32_t						mBitmapIndexX = 0,
+								mBitmapIndexY = 0;
+	// Each image's indices, when the constructor wants them.
+	std::vector<uint8_t>&		mIndexes;
+	const bool					mKeepIndexes;
+	// Target area, exclusive
+	int32_t						mLeft = 0, mTop = 0, mRight = 0, mBottom = 0;
+	// Rows of interlaced images arrive in four passes.
+	bool						mInterlaced = false;
+	size_t						mInterlacePass = 0;
+
+	// Will be cached from any GCE block before the current image block
+	GraphicControlExtensionRef	mGceRef;
+
+	// Output
+	gif::ListConstructor&		mConstructor;
+};
+
+// HEADER
+struct Header {
+	Header() { }
+	Header(const std::string &sig, const Version &v) : mSig(sig), mVersion(v) { }
+
+	std::string		mSig;
+	Version			mVersion = Version::kMissing;
+
+	bool			isGif() const { return mSig == SIG; }
+
+	size_t			read(const std::vector<char> &buffer, size_t position) {
+		mSig = read_string(buffer, 3, position);
+
+		std::string	v = read_string(buffer, 3, position);
+		if (v == "87a") mVersion = Version::k87a;
+		else if (v == "89a") mVersion = Version::k89a;
+
+		return position;
+	}
+
+	void			write(std::ostream &buf) {
+		buf << mSig;
+		if (mVersion == Version::k87a) buf << "87a";
+		else if (mVersion == Version::k89a) buf << "89a";
+	}
+};
+
+// LOGICAL-SCREEN
+struct LogicalScreen {
+	static const uint32_t	GLOBAL_COLOR_TABLE_F = (1<<0);
+	static const uint32_t	SORT_F = (1<<1);
+
+	int32_t			mScreenWidth = 0, mScreenHeight = 0;
+	uint32_t		mFlags = 0;
+	uint8_t			mColorResolution = 0,
+					mSizeOfGlobalColorTable = 0,
+					mBackgroundColorIndex = 0,
+					mPixelAspectRatio = 0;
+
+	bool			hasGlobalColorTable() const { return (mFlags&GLOBAL_COLOR_TABLE_F) != 0; }
+
+	size_t			read(const std::vector<char> &buffer, size_t position) {
+		// Screen size
+		mScreenWidth = read_2_byte_int(buffer, position);
+		mScreenHeight = read_2_byte_int(buffer, position);
+
+		// Flags
+		uint8_t		a = buffer[position++];
+		if ((a&(1<<7)) != 0) mFlags |= GLOBAL_COLOR_TABLE_F;
+		mColorResolution = (a>>4)&0x7;
+		if ((a&(1<<3)) != 0) mFlags |= SORT_F;
+		mSizeOfGlobalColorTable = (a&0x7);
+
+		// Background color index
+		mBackgroundColorIndex = buffer[position++];
+		
+		// Aspect ratio
+		mPixelAspectRatio = buffer[position++];
+
+		return position;
+	}
+
+	void			write(std::ostream &output, const size_t global_ct_size) {
+		// Screen size
+		write_2_byte_int(static_cast<int16_t>(mScreenWidth), output);
+		write_2_byte_int(static_cast<int16_t>(mScreenHeight), output);
+
+		// Flags
+		uint8_t			f = 0;
+		if ((mFlags&GLOBAL_COLOR_TABLE_F) != 0) {
+			// Has global color table flag
+			f |= 1<<7;
+			// Size of global color table
+			f |= table_size_bits(global_ct_size);
+		}
+		// XXX Ideally this is based on an analysis of the original image,
+		// but I'm really not sure how this is ever used
+		f |= 0x7 << 4;	// color resolution
+		output << f;
+
+		// Background color index
+		output << mBackgroundColorIndex;
+
+		// Aspect ratio
+		output << mPixelAspectRatio;
+	}
+};
+
+class ImageData : public Block {
+public:
+	static const uint32_t	LOCAL_COLOR_TABLE_F = (1<<0);
+	static const uint32_t	INTERLACE_F = (1<<1);
+	static const uint32_t	SORT_F = (1<<2);
+
+	ImageData() { }
+
+	int32_t					mLeftPosition = 0,
+							mTopPosition = 0,
+							mWidth = 0,
+							mHeight = 0;
+	uint32_t				mFlags = 0;
+	uint8_t					mSizeOfLocalColorTable = 0;
+	ColorTable				mColorTable;
+
+	bool					hasLocalColorTable() const { return (mFlags&LOCAL_COLOR_TABLE_F) != 0; }
+	bool					isInterlaced() const { return (mFlags&INTERLACE_F) != 0; }
+
+	// We are past the image separator byte here
+	size_t					read(const std::vector<char> &buffer, size_t position, BlockReadArgs &bra) {
+		position = readDescriptor(buffer, position);
+		const ColorTable*	ct = (hasLocalColorTable() ? &mColorTable : &bra.mGlobalColorTable);
+
+		// Image data
+		uint8_t			lzw_code_size = buffer[position++],
+						block_size = 0;
+		bra.startLzwDecode(mLeftPosition, mTopPosition, mWidth, mHeight, isInterlaced());
+		gif::LzwReader&	decoder(bra.mDecoder);
+		auto			flush_fn = [&bra, &ct](const std::vector<uint8_t> &data) {
+			if (bra.mKeepIndexes) bra.mIndexes.insert(bra.mIndexes.end(), data.begin(), data.end());
+			bra.addPixels(data, *ct);
+		};
+		bra.mIndexes.clear();
+		decoder.begin(lzw_code_size, flush_fn);
+		while ( (block_size = buffer[position++]) != 0) {
+			decoder.decode(buffer.begin()+position, buffer.begin()+(position+block_size));
+			position += block_size;
+		}
+		const double	delay = (bra.mGceRef ? bra.mGceRef->mDelay : 0.0);
+		if (bra.mKeepIndexes) {
+			gif::IndexedImage	image;
+			image.mLeft = mLeftPosition;
+			image.mTop = mTopPosition;
+			image.mWidth = mWidth;
+			image.mHeight = mHeight;
+			image.mInterlaced = isInterlaced();
+			image.mIndexes = bra.mIndexes.data();
+			image.mIndexCount = bra.mIndexes.size();
+			image.mColors = ct->mColors.data();
+			image.mColorCount = ct->mColors.size();
+			if (bra.mGceRef && bra.mGceRef->hasTransparentColor()) image.mTransparentIndex = bra.mGceRef->mTransparencyIndex;
+			image.mDelay = delay;
+			bra.mConstructor.addImage(image);
+		}
+		bra.mConstructor.addFrame(bra.mBitmap, delay);
+		return position;
+	}
+
+	// Read the image descriptor and any local color table, stopping at the image data.
+	size_t					readDescriptor(const std::vector<char> &buffer, size_t position) {
+		// Image descriptor
+		mLeftPosition = read_2_byte_int(buffer, position);
+		mTopPosition = read_2_byte_int(buffer, position);
+		mWidth = read_2_byte_int(buffer, position);
+		mHeight = read_2_byte_int(buffer, position);
+		
+		uint8_t		fields = buffer[position++];
+		if ((fields&(1<<7)) != 0) mFlags |= LOCAL_COLOR_TABLE_F;
+		if ((fields&(1<<6)) != 0) mFlags |= INTERLACE_F;
+		if ((fields&(1<<5)) != 0) mFlags |= SORT_F;
+		mSizeOfLocalColorTable = (fields&0x7);
+
+		// Optional local color table
+		if (hasLocalColorTable()) {
+			position = mColorTable.read(buffer, color_count(mSizeOfLocalColorTable), position);
+		}
+		return position;
+	}
+};
+
+class AppExtension : public Block {
+public:
+	AppExtension() { }
+
+	// We are past the introducer and app bytes here
+	size_t			read(const std::vector<char> &buffer, size_t position) {
+		uint8_t		block_size = buffer[position++];
+		if (block_size != 11) throw std::runtime_error("AppExtension has illegal Block Size");
+
+		// identifier and authentication
+		mIdentifier = read_string(buffer, 11, position);
+
+		return readSubBlocks(buffer, position);
+	}
+
+	// Answer the repeat count if I'm a looping extension, otherwise -1.
+	int32_t			loopCount() const {
+		if (mIdentifier != "NETSCAPE2.0" && mIdentifier != "ANIMEXTS1.0") return -1;
+		for (const auto& it : mSubBlocks) {
+			const std::vector<char>&	d(it->mData);
+			if (d.size() >= 3 && d[0] == 1) {
+				return static_cast<uint8_t>(d[1]) | (static_cast<uint8_t>(d[2])<<8);
+			}
+		}
+		return -1;
+	}
+
+	// Identifier and authentication code, i.e. "NETSCAPE2.0"
+	std::string		mIdentifier;
+};
+
+class BlockList {
+public:
+	BlockList() { }
+
+	size_t			read(const uint8_t byte1, const std::vector<char> &buffer, size_t position, BlockReadArgs &bra) {
+		// Select between:
+		//		Image Descriptor				- 0x2c (image)
+		//		Graphic Control Extension		- 0x21 (extension), 0xf9 (graphic control)
+		//		Application Extension			- 0x21 (extension), 0xff (application)
+		//		Comment Extension				- 0x21 (extension), 0xfe (comment)
+		//		Plain Text Extension			- 0x21 (extension), 0x01 (plain text)
+		if (byte1 == 0x21) {
+			uint8_t		byte2 = buffer[position++];
+			// text
+			if (byte2 == 0x01) {
+				// XXX unimplemented, don't have any examples
+				std::cout << "text block unimplemented" << std::endl;
+				throw std::runtime_error("text block unimplemented");
+			// commment
+			} else if (byte2 == 0xfe) {
+				// XXX unimplemented, don't have any examples
+				std::cout << "comment block unimplemented" << std::endl;
+				throw std::runtime_error("comment block unimplemented");
+			// graphic control
+			} else if (byte2 == 0xf9) {
+				std::shared_ptr<GraphicControlExtension>	block = std::make_shared<GraphicControlExtension>();
+				position = block->read(buffer, position);
+				// Provide me to the next image block
+				bra.mGceRef = block;
+				mBlocks.push_back(block);
+			// application
+			} else if (byte2 == 0xff) {
+				std::shared_ptr<AppExtension>				block = std::make_shared<AppExtension>();
+				position = block->read(buffer, position);
+				mBlocks.push_back(block);
+			} else {
+				throw std::runtime_error("Read block on invalid extension byte");
+			}
+		// Image
+		} else if (byte1 == IMAGE_DESCRIPTOR_LABEL) {
+			std::shared_ptr<ImageData>						block = std::make_shared<ImageData>();
+			position = block->read(buffer, position, bra);
+			mBlocks.push_back(block);
+			// Clear out my associated GCE
+			bra.mGceRef.reset();
+		} else {
+			throw std::runtime_error("Read block on invalid introducer byte");
+		}
+		return position;
+	}
+
+	std::vector<BlockRef>	mBlocks;
+};
+
+/**
+ * BlockReadArgs
+ * Need to implement a function after the Graphic Control Extension block is defined.
+ */
+void BlockReadArgs::addPixels(const std::vector<uint8_t> &indexes, const ColorTable &t) {
+	const bool				has_transparent = (mGceRef && mGceRef->hasTransparentColor());
+
+	for (const auto& it : indexes) {
+		const size_t		bi = static_cast<size_t>((mBitmapIndexY * mScreenWidth) + mBitmapIndexX);
+		if (bi >= mBitmap.mPixels.size()) return;
+		if (++mBitmapIndexX >= mRight) {
+			mBitmapIndexX = mLeft;
+			if (!mInterlaced) {
+				++mBitmapIndexY;
+			} else {
+				mBitmapIndexY += INTERLACE_STEP[mInterlacePass];
+				while (mBitmapIndexY >= mBottom && mInterlacePass < 3) {
+					++mInterlacePass;
+					mBitmapIndexY = mTop + INTERLACE_START[mInterlacePass];
+				}
+			}
+		}
+		if (has_transparent && it == mGceRef->mTransparencyIndex) continue;
+
+		if (it < t.mColors.size()) {
+			mBitmap.mPixels[bi] = t.mColors[it];
+		} else {
+			// error
+			mBitmap.mPixels[bi] = gif::ColorA8u(0, 0, 0, 0);
+		}
+	}
+}
+
+}
+
+/**
+ * @class gif::Reader
+ */
+Reader::Reader(std::string path)
+		: mPath(path) {
+}
+
+bool Reader::read(gif::ListConstructor &constructor) {
+	return read(mPath, constructor);
+}
+
+bool Reader::read(const std::string &path, gif::ListConstructor &constructor) {
+	try {
+		std::vector<char>&	buffer(mBuffer);
+		buffer.clear();
+		{
+			std::ifstream	input(path, std::ios::binary | std::ios::ate);
+			if (input.is_open()) {
+				buffer.resize(static_cast<size_t>(input.tellg()));
+				input.seekg(0);
+				input.read(buffer.data(), buffer.size());
+			}
+		}
+		// Each file starts from a clear screen.
+		mBitmap.mPixels.clear();
+
+		Header				header;
+		LogicalScreen		screen;
+		ColorTable			globalColorTable;
+		BlockList			blocks;
+
+		size_t				pos = 0;
+
+		// Header
+		if (buffer.size() < 6) throw std::runtime_error("No header");
+		pos = header.read(buffer, pos);
+		if (!header.isGif()) throw std::runtime_error("Header signature is not GIF");
+		if (header.mVersion == Version::kMissing) throw std::runtime_error("Header has no version");
+
+		// Logical Screen
+		pos = screen.read(buffer, pos);
+
+		// Global color table
+		if (screen.hasGlobalColorTable()) {
+			pos = globalColorTable.read(buffer, color_count(screen.mSizeOfGlobalColorTable), pos);
+		}
+
+		BlockReadArgs		bra(screen.mScreenWidth, screen.mScreenHeight, globalColorTable, constructor, mDecoder, mBitmap, mIndexes);
+		while (pos < buffer.size()) {
+			const uint8_t	byte1 = buffer[pos++];
+			if (byte1 == 0x3b) {
+				// Trailer, success
+				constructor.readerFinished();
+				return true;
+			} else {
+				pos = blocks.read(byte1, buffer, pos, bra);
+				if (!constructor.wantsMoreFrames()) {
+					// The constructor has all it needs.
+					constructor.readerFinished();
+					return true;
+				}
+			}
+		}
+		constructor.readerFinished();
+	} catch (std::exception const &ex) {
+		std::cout << "Error in gif::Reader::read()=" << ex.what() << std::endl;
+	}
+	return false;
+}
+
+/**
+ * @class gif::Editor
+ */
+Editor& Editor::load(const std::string &path) {
+	std::vector<Frame>		frames;
+	int32_t					loop_count = NO_LOOP;
+	read(path, frames, loop_count);
+	mFrames.swap(frames);
+	mLoopCount = loop_count;
+	return *this;
+}
+
+Editor& Editor::append(const std::string &path) {
+	Editor					e;
+	return append(e.load(path));
+}
+
+Editor& Editor::append(const Editor &e) {
+	if (mFrames.empty()) mLoopCount = e.mLoopCount;
+	if (e.mFrames.empty()) return *this;
+	// Copied first in case I'm appending myself.
+	const std::vector<Frame>	frames(e.mFrames);
+	if (!mFrames.empty()) {
+		Frame&				last(mFrames.back());
+		last.mHasGce = true;
+		last.mGce.mDisposal = GraphicControlExtension::Disposal::kRestoreToBackgroundColor;
+	}
+	mFrames.insert(mFrames.end(), frames.begin(), frames.end());
+	return *this;
+}
+
+int32_t Editor::getWidth() const {
+	int32_t					w = 0;
+	for (const auto& f : mFrames) w = std::max(w, f.mSource->mWidth);
+	return w;
+}
+
+int32_t Editor::getHeight() const {
+	int32_t					h = 0;
+	for (const auto& f : mFrames) h = std::max(h, f.mSource->mHeight);
+	return h;
+}
+
+Editor& Editor::trim(const size_t begin, const size_t end) {
+	const size_t			e = std::min(end, mFrames.size()),
+							b = std::min(begin, e);
+	mFrames.erase(mFrames.begin()+e, mFrames.end());
+	mFrames.erase(mFrames.begin(), mFrames.begin()+b);
+	return *this;
+}
+
+double Editor::getDelay(const size_t frame) const {
+	if (frame >= mFrames.size()) throw std::runtime_error("gif::Editor::getDelay() frame out of range");
+	return mFrames[frame].mHasGce ? mFrames[frame].mGce.mDelay : 0.0;
+}
+
+Editor& Editor::setDelay(const size_t frame, const double delay) {
+	Frame&					f(frameAt(frame, "setDelay"));
+	f.mHasGce = true;
+	f.mGce.mDelay = delay;
+	return *this;
+}
+
+Editor& Editor::setDelays(const double delay) {
+	for (size_t k=0; k<mFrames.size(); ++k) setDelay(k, delay);
+	return *this;
+}
+
+Editor& Editor::scaleDelays(const double scale) {
+	for (auto& f : mFrames) {
+		if (f.mHasGce) f.mGce.mDelay *= scale;
+	}
+	return *this;
+}
+
+bool Editor::optimize(const LzwWriter::Effort effort) {
+	if (mFrames.empty()) return false;
+	int32_t					width = 0, height = 0;
+	for (const auto& f : mFrames) {
+		width = std::max(width, f.mSource->mWidth);
+		height = std::max(height, f.mSource->mHeight);
+	}
+	const size_t			pixels = static_cast<size_t>(width) * height;
+
+	// Composite the frames into ids, as a viewer shows them, and reduce each to
+	// what changed from the frame before.
+	std::unordered_map<uint32_t, uint16_t>	ids;
+	std::vector<uint32_t>	rgbs(1, 0);
+	std::vector<uint16_t>	screen(pixels, ID_TRANSPARENT), saved, shown, before, base, plane;
+	std::vector<IdFrame>	id_frames;
+	LzwReader				decoder;
+	for (const auto& f : mFrames) {
+		// Ids for my table. Indices past its end show as transparent.
+		const gif::Palette&	table(f.table());
+		uint16_t			lut[256];
+		for (size_t k=0; k<256; ++k) {
+			lut[k] = ID_TRANSPARENT;
+			if (k >= table.size()) continue;
+			const gif::ColorA8u&	c(table.mColors[k]);
+			const uint32_t	rgb = (static_cast<uint32_t>(c.r)<<16) | (static_cast<uint32_t>(c.g)<<8) | c.b;
+			auto			found = ids.find(rgb);
+			if (found == ids.end()) {
+				if (rgbs.size() >= ID_LIMIT) return false;
+				found = ids.insert(std::make_pair(rgb, static_cast<uint16_t>(rgbs.size()))).first;
+				rgbs.push_back(rgb);
+			}
+			lut[k] = found->second;
+		}
+
+		// Decode the indices. Pixels past the end of a short stream aren't drawn.
+		const std::vector<char>&	bytes(f.mSource->mBytes);
+		const uint8_t		code_size = bytes[f.mDataBegin];
+		if (code_size < 2 || code_size > 11) return false;
+		plane.assign(static_cast<size_t>(f.mWidth) * f.mHeight, ID_UNDECODED);
+		int32_t				x = 0, y = 0, pass = 0;
+		auto				flush_fn = [&](const std::vector<uint8_t> &data) {
+			for (const auto i : data) {
+				if (y >= f.mHeight) return;
+				plane[static_cast<size_t>(y)*f.mWidth + x] = i;
+				if (++x < f.mWidth) continue;
+				x = 0;
+				if (!f.mInterlaced) {
+					++y;
+				} else {
+					y += INTERLACE_STEP[pass];
+					while (y >= f.mHeight && pass < 3) y = INTERLACE_START[++pass];
+				}
+			}
+		};
+		decoder.begin(code_size, flush_fn);
+		size_t				pos = f.mDataBegin + 1;
+		uint8_t				block_size = 0;
+		try {
+			while ( (block_size = bytes[pos++]) != 0) {
+				decoder.decode(bytes.begin()+pos, bytes.begin()+(pos+block_size));
+				pos += block_size;
+			}
+		} catch (std::exception const&) {
+			return false;
+		}
+
+		// Draw
+		using Disposal = GraphicControlExtension::Disposal;
+		const Disposal		disposal = (f.mHasGce ? f.mGce.mDisposal : Disposal::kUnspecified);
+		const bool			has_transparent = (f.mHasGce && f.mGce.hasTransparentColor());
+		const int32_t		right = std::min(width, f.mLeft + f.mWidth),
+							bottom = std::min(height, f.mTop + f.mHeight);
+		if (disposal == Disposal::kRestoreToPrevious) saved = screen;
+		for (int32_t sy=f.mTop; sy<bottom; ++sy) {
+			const uint16_t*	src = plane.data() + static_cast<size_t>(sy-f.mTop)*f.mWidth;
+			uint16_t*		dst = screen.data() + static_cast<size_t>(sy)*width;
+			for (int32_t sx=f.mLeft; sx<right; ++sx) {
+				const uint16_t	i = src[sx-f.mLeft];
+				if (i == ID_UNDECODED || (has_transparent && i == f.mGce.mTransparencyIndex)) continue;
+				dst[sx] = lut[i];
+			}
+		}
+
+		// Plan the output. Identical frames merge into the one before.
+		const double		delay = (f.mHasGce ? f.mGce.mDelay : 0.0);
+		if (!id_frames.empty() && screen == shown) {
+			id_frames.back().mDelay += delay;
+		} else {
+			base.assign(pixels, ID_TRANSPARENT);
+			if (!id_frames.empty()) {
+				// Pixels that turn transparent can only be cleared by disposing
+				// of the previous frame, so its area grows to cover them.
+				IdFrame&	prev(id_frames.back());
+				const Area	clear = find_area(screen, shown, width, height,
+											[](const uint16_t a, const uint16_t b) { return a == ID_TRANSPARENT && b != ID_TRANSPARENT; });
+				base = shown;
+				if (!clear.empty()) {
+					prev.mArea.add(clear);
+					prev.mDisposeToBackground = true;
+					for (int32_t py=prev.mArea.mTop; py<prev.mArea.mBottom; ++py) {
+						std::fill_n(base.begin() + static_cast<size_t>(py)*width + prev.mArea.mLeft, prev.mArea.width(), ID_TRANSPARENT);
+					}
+				}
+				prev.finish(before, shown, width);
+			}
+			IdFrame			next;
+			next.mArea = find_area(screen, base, width, height, [](const uint16_t a, const uint16_t b) { return a != b; });
+			if (next.mArea.empty()) next.mArea.mRight = next.mArea.mBottom = 1;
+			next.mDelay = delay;
+			id_frames.push_back(next);
+			before.swap(base);
+			shown = screen;
+		}
+
+		// Dispose
+		if (disposal == Disposal::kRestoreToBackgroundColor) {
+			for (int32_t sy=f.mTop; sy<bottom; ++sy) {
+				for (int32_t sx=f.mLeft; sx<right; ++sx) screen[static_cast<size_t>(sy)*width + sx] = ID_TRANSPARENT;
+			}
+		} else if (disposal == Disposal::kRestoreToPrevious) {
+			screen.swap(saved);
+		}
+	}
+	id_frames.back().finish(before, shown, width);
+
+	// Pool colors into a global table, in frame order while they fit.
+	std::vector<int16_t>	global_index(ID_LIMIT, -1);
+	std::vector<uint16_t>	global_ids;
+	for (const auto& f : id_frames) {
+		size_t				added = 0;
+		for (const auto id : f.mColors) {
+			if (global_index[id] < 0) ++added;
+		}
+		if (global_ids.size() + added > 256) continue;
+		for (const auto id : f.mColors) {
+			if (global_index[id] >= 0) continue;
+			global_index[id] = static_cast<int16_t>(global_ids.size());
+			global_ids.push_back(id);
+		}
+	}
+
+	auto					to_palette = [&rgbs](const std::vector<uint16_t> &table_ids, gif::Palette &p) {
+		for (const auto id : table_ids) {
+			const uint32_t	rgb = rgbs[id];
+			p.mColors.push_back(gif::ColorA8u((rgb>>16)&0xff, (rgb>>8)&0xff, rgb&0xff));
+		}
+		p.clip();
+	};
+
+	std::shared_ptr<Source>	source = std::make_shared<Source>();
+	source->mWidth = width;
+	source->mHeight = height;
+	source->mHasGlobalTable = !global_ids.empty();
+	if (source->mHasGlobalTable) to_palette(global_ids, source->mGlobalTable);
+
+	// Encode
+	std::vector<Frame>		frames;
+	std::vector<int16_t>	local_index(ID_LIMIT, -1);
+	std::vector<uint16_t>	local_ids;
+	std::vector<uint8_t>	indices;
+	std::ostringstream		data;
+	WriterBuffer			wb(data);
+	LzwWriter				lzw;
+	lzw.setEffort(effort);
+	for (const auto& idf : id_frames) {
+		Frame				f;
+		f.mSource = source;
+		f.mLeft = idf.mArea.mLeft;
+		f.mTop = idf.mArea.mTop;
+		f.mWidth = idf.mArea.width();
+		f.mHeight = idf.mArea.height();
+		f.mHasGce = true;
+		f.mGce.mDelay = idf.mDelay;
+		f.mGce.mDisposal = (idf.mDisposeToBackground	? GraphicControlExtension::Disposal::kRestoreToBackgroundColor
+														: GraphicControlExtension::Disposal::kDoNotDispose);
+
+		// Kept pixels are transparent if there's an index to spare, otherwise
+		// they're drawn, which needs their colors and can't keep transparent ones.
+		const bool			can_draw_kept = idf.mKeptColors.empty() || idf.mKeptColors.front() != ID_TRANSPARENT;
+		const std::vector<int16_t>*	index = &global_index;
+		int32_t				transparent = -1;
+		bool				global = std::all_of(idf.mColors.begin(), idf.mColors.end(), [&global_index](const uint16_t id) { return global_index[id] >= 0; });
+		if (global && idf.mHasKept) {
+			for (size_t k=0; k<source->mGlobalTable.size() && transparent < 0; ++k) {
+				if (k >= global_ids.size() || !std::binary_search(idf.mColors.begin(), idf.mColors.end(), global_ids[k])) {
+					transparent = static_cast<int32_t>(k);
+				}
+			}
+			if (transparent < 0) {
+				global = can_draw_kept && std::all_of(	idf.mKeptColors.begin(), idf.mKeptColors.end(),
+														[&global_index](const uint16_t id) { return global_index[id] >= 0; });
+			}
+		}
+		if (!global) {
+			for (const auto id : local_ids) local_index[id] = -1;
+			local_ids = idf.mColors;
+			if (idf.mHasKept) {
+				if (local_ids.size() < 256) {
+					transparent = static_cast<int32_t>(local_ids.size());
+				} else if (can_draw_kept) {
+					for (const auto id : idf.mKeptColors) {
+						if (!std::binary_search(idf.mColors.begin(), idf.mColors.end(), id)) local_ids.push_back(id);
+					}
+					if (local_ids.size() > 256) return false;
+				} else {
+					return false;
+				}
+			}
+			for (size_t k=0; k<local_ids.size(); ++k) local_index[local_ids[k]] = static_cast<int16_t>(k);
+			index = &local_index;
+			f.mHasLocalTable = true;
+			to_palette(local_ids, f.mLocalTable);
+			// A spare index past the colors still has to be in the table.
+			if (transparent >= static_cast<int32_t>(f.mLocalTable.size())) {
+				f.mLocalTable.mColors.push_back(gif::ColorA8u());
+				f.mLocalTable.clip();
+			}
+		}
+		if (transparent >= 0) {
+			f.mGce.mFlags |= GraphicControlExtension::TRANSPARENT_COLOR_F;
+			f.mGce.mTransparencyIndex = static_cast<uint8_t>(transparent);
+		}
+
+		indices.resize(idf.mIds.size());
+		for (size_t k=0; k<idf.mIds.size(); ++k) {
+			const uint16_t	id = idf.mIds[k];
+			if ((id&ID_KEEP_F) != 0 && transparent >= 0) indices[k] = static_cast<uint8_t>(transparent);
+			else indices[k] = static_cast<uint8_t>((*index)[id&~ID_KEEP_F]);
+		}
+
+		// Image data, the same way the writer encodes it
+		const size_t		table_size = f.table().size();
+		const uint8_t		code_size = std::max<uint8_t>(2, count_bits(static_cast<uint8_t>(table_size-1)));
+		f.mDataBegin = static_cast<size_t>(data.tellp());
+		data << code_size;
+		wb.clear();
+		lzw.begin(code_size, [&wb](const std::vector<uint8_t> &d){wb.write(d);});
+		lzw.encode(indices.data(), static_cast<size_t>(f.mWidth), static_cast<size_t>(f.mHeight), false);
+		wb.terminate();
+		f.mDataEnd = static_cast<size_t>(data.tellp());
+		frames.push_back(f);
+	}
+	const std::string		encoded = data.str();
+	source->mBytes.assign(encoded.begin(), encoded.end());
+
+	// Keep whichever is smaller
+	Editor					optimized;
+	optimized.mFrames.swap(frames);
+	optimized.mLoopCount = mLoopCount;
+	if (optimized.encodedSize() >= encodedSize()) return false;
+	mFrames.swap(optimized.mFrames);
+	return true;
+}
+
+void Editor::save(const std::string &path) const {
+	if (mFrames.empty()) throw std::runtime_error("gif::Editor::save() has no frames");
+	const Source&			first(*mFrames.front().mSource);
+	const bool				has_global = first.mHasGlobalTable;
+
+	std::ofstream			output(path, std::ios::binary);
+	if (!output.is_open()) throw std::runtime_error("gif::Editor::save() can't open " + path);
+
+	// Header
+	Header					header(SIG, Version::k89a);
+	header.write(output);
+
+	// Logical screen, large enough for every file
+	LogicalScreen			screen;
+	screen.mScreenWidth = getWidth();
+	screen.mScreenHeight = getHeight();
+	screen.mBackgroundColorIndex = first.mBackgroundColorIndex;
+	if (has_global) screen.mFlags |= LogicalScreen::GLOBAL_COLOR_TABLE_F;
+	screen.write(output, first.mGlobalTable.size());
+	if (has_global) ColorTable().write(first.mGlobalTable.mColors, output);
+
+	if (mLoopCount >= 0) write_loop_extension(mLoopCount, output);
+
+	for (const auto& f : mFrames) {
+		if (f.mHasGce) f.mGce.write(output);
+		const bool			local = writesTable(f);
+		write_image_descriptor(f.mLeft, f.mTop, f.mWidth, f.mHeight, f.mInterlaced, (local ? &f.table() : nullptr), output);
+		output.write(f.mSource->mBytes.data() + f.mDataBegin, f.mDataEnd - f.mDataBegin);
+	}
+
+	// Trailer
+	output << static_cast<uint8_t>(0x3b);
+	if (!output) throw std::runtime_error("gif::Editor::save() failed writing " + path);
+}
+
+void Editor::read(const std::string &path, std::vector<Frame> &frames, int32_t &loop_count) const {
+	std::shared_ptr<Source>	source = std::make_shared<Source>();
+	std::vector<char>&		buffer(source->mBytes);
+	{
+		std::ifstream		input(path, std::ios::binary | std::ios::ate);
+		if (!input.is_open()) throw std::runtime_error("gif::Editor::load() can't open " + path);
+		buffer.resize(static_cast<size_t>(input.tellg()));
+		input.seekg(0);
+		input.read(buffer.data(), buffer.size());
+	}
+
+	Header					header;
+	LogicalScreen			screen;
+	size_t					pos = 0;
+
+	// Header, logical screen and global color table
+	if (buffer.size() < 13) throw std::runtime_error("gif::Editor::load() no header in " + path);
+	pos = header.read(buffer, pos);
+	if (!header.isGif() || header.mVersion == Version::kMissing) throw std::runtime_error("gif::Editor::load() not a GIF " + path);
+	pos = screen.read(buffer, pos);
+	source->mWidth = screen.mScreenWidth;
+	source->mHeight = screen.mScreenHeight;
+	source->mBackgroundColorIndex = screen.mBackgroundColorIndex;
+	if (screen.hasGlobalColorTable()) {
+		const size_t		count = color_count(screen.mSizeOfGlobalColorTable);
+		if (pos + count*3 > buffer.size()) throw std::runtime_error("gif::Editor::load() truncated " + path);
+		ColorTable			ct;
+		pos = ct.read(buffer, count, pos);
+		source->mHasGlobalTable = true;
+		source->mGlobalTable.mColors.swap(ct.mColors);
+	}
+
+	// Blocks. Only the structure is parsed; image data is located, not decoded.
+	// Comment and plain text extensions are dropped.
+	bool					has_gce = false;
+	GraphicControlExtension	gce;
+	while (pos < buffer.size()) {
+		const uint8_t		byte1 = buffer[pos++];
+		// Trailer
+		if (byte1 == 0x3b) break;
+		if (pos >= buffer.size()) throw std::runtime_error("gif::Editor::load() truncated " + path);
+
+		if (byte1 == 0x21) {
+			const uint8_t	byte2 = buffer[pos++];
+			// Find the end first, so the block is known to be complete.
+			const size_t	end = skip_sub_blocks(buffer, pos);
+			if (byte2 == 0xf9) {
+				gce = GraphicControlExtension();
+				gce.read(buffer, pos);
+				has_gce = true;
+			} else if (byte2 == 0xff) {
+				AppExtension	app;
+				app.read(buffer, pos);
+				if (app.loopCount() >= 0) loop_count = app.loopCount();
+			} else if (byte2 == 0x01) {
+				// Plain text uses up its control extension
+				has_gce = false;
+			}
+			pos = end;
+		} else if (byte1 == IMAGE_DESCRIPTOR_LABEL) {
+			// Descriptor and local table
+			if (pos + 9 > buffer.size()) throw std::runtime_error("gif::Editor::load() truncated " + path);
+			const uint8_t	fields = buffer[pos+8];
+			if ((fields&(1<<7)) != 0 && pos + 9 + color_count(fields&0x7)*3 > buffer.size()) {
+				throw std::runtime_error("gif::Editor::load() truncated " + path);
+			}
+			ImageData		desc;
+			pos = desc.readDescriptor(buffer, pos);
+			if (pos >= buffer.size()) throw std::runtime_error("gif::Editor::load() truncated " + path);
+
+			Frame			f;
+			f.mSource = source;
+			f.mHasGce = has_gce;
+			f.mGce = gce;
+			f.mLeft = desc.mLeftPosition;
+			f.mTop = desc.mTopPosition;
+			f.mWidth = desc.mWidth;
+			f.mHeight = desc.mHeight;
+			f.mInterlaced = desc.isInterlaced();
+			f.mHasLocalTable = desc.hasLocalColorTable();
+			f.mLocalTable.mColors.swap(desc.mColorTable.mColors);
+			// LZW code size, then the data
+			f.mDataBegin = pos;
+			pos = skip_sub_blocks(buffer, pos+1);
+			f.mDataEnd = pos;
+			frames.push_back(f);
+			has_gce = false;
+		} else {
+			throw std::runtime_error("gif::Editor::load() invalid block in " + path);
+		}
+	}
+}
+
+Editor::Frame& Editor::frameAt(const size_t frame, const char *fn) {
+	if (frame >= mFrames.size()) throw std::runtime_error(std::string("gif::Editor::") + fn + "() frame out of range");
+	return mFrames[frame];
+}
+
+bool Editor::writesTable(const Frame &f) const {
+	if (f.mHasLocalTable) return true;
+	// A frame drawn with another file's global table carries it along. It's the
+	// same size, so the image data's code size still fits.
+	const Source&			first(*mFrames.front().mSource);
+	return f.mSource->mHasGlobalTable && f.mSource.get() != &first
+			&& (!first.mHasGlobalTable || f.mSource->mGlobalTable.mColors != first.mGlobalTable.mColors);
+}
+
+size_t Editor::encodedSize() const {
+	if (mFrames.empty()) return 0;
+	const Source&			first(*mFrames.front().mSource);
+	// Header, logical screen, global table, loop extension and trailer
+	size_t					size = 6 + 7 + first.mGlobalTable.size()*3 + (mLoopCount >= 0 ? 19 : 0) + 1;
+	for (const auto& f : mFrames) {
+		if (f.mHasGce) size += 8;
+		size += 10 + (writesTable(f) ? f.table().size()*3 : 0) + (f.mDataEnd - f.mDataBegin);
+	}
+	return size;
+}
+
+/**
+ * @class gif::WriterSettings
+ */
+void WriterSettings::makeGlobalTable(const gif::BitmapView &bm) {
+	if (!mBitmapToPalette) throw std::runtime_error("makeGlobalTable() missing BitmapToPalette algorithm");
+	const size_t		max_size = mMaxColors;
+	mCensus.clear();
+	if (usesCensus() && mCensus.add(bm, availableSize(max_size))) {
+		mGlobalPalette.mColors = mCensus.colors();
+	} else {
+		mBitmapToPalette->convert(bm, availableSize(max_size), mGlobalPalette);
+	}
+	finishTable(max_size, mGlobalPalette);
+}
+
+void WriterSettings::makeGlobalTableFromAccumulated() {
+	if (!mBitmapToPalette) throw std::runtime_error("makeGlobalTableFromAccumulated() missing BitmapToPalette algorithm");
+	const size_t		max_size = mMaxColors;
+	mBitmapToPalette->end(availableSize(max_size), mGlobalPalette);
+	if (mAccumulatedExact) mGlobalPalette.mColors = mCensus.colors();
+	finishTable(max_size, mGlobalPalette);
+}
+
+void WriterSettings::setGlobalTable(const gif::Palette &p) {
+	if (p.empty() || p.size() > 256) throw std::runtime_error("setGlobalTable() palette must have 1 to 256 colors");
+	mGlobalPalette = p;
+	mGlobalPalette.clip();
+	mGlobalTableSet = true;
+	// Every entry belongs to the client, so none is reserved for frame differencing.
+	mMatchPalette = p;
+	mHasTransparentIndex = false;
+}
+
+bool WriterSettings::shareGlobalTable(const gif::Palette &colors) {
+	if (colors.empty() || colors.size() > availableSize(mMaxColors)) return false;
+	mGlobalPalette = colors;
+	finishTable(mMaxColors, mGlobalPalette);
+	mGlobalTableSet = true;
+	return true;
+}
+
+void WriterSettings::beginAccumulating() {
+	if (!mBitmapToPalette) throw std::runtime_error("beginAccumulating() missing BitmapToPalette algorithm");
+	mBitmapToPalette->begin();
+	mCensus.clear();
+	mAccumulatedExact = usesCensus();
+}
+
+void WriterSettings::accumulate(const gif::BitmapView &bm) {
+	if (!mBitmapToPalette) throw std::runtime_error("accumulate() missing BitmapToPalette algorithm");
+	mBitmapToPalette->add(bm);
+	// Once the frames have too many colors between them, stop counting.
+	if (mAccumulatedExact) mAccumulatedExact = mCensus.add(bm, availableSize(mMaxColors));
+}
+
+void WriterSettings::makeLocalTable(const gif::BitmapView &bm) {
+	if (!mBitmapToPalette) throw std::runtime_error("makeLocalTable() missing BitmapToPalette algorithm");
+	const size_t		max_size = mMaxColors;
+	// A table from before the maximum size was lowered can't be kept. Tables are
+	// padded to a power of 2, so compare the colors they were built with.
+	const bool			reuse = mPaletteReuse && mLocalTableError >= 0.0 && mToColorIndex && mMatchPalette.size() <= availableSize(max_size);
+	// Few enough colors to be exact. Keep the current table if it already has them all.
+	mCensus.clear();
+	if (usesCensus() && mCensus.add(bm, availableSize(max_size))) {
+		if (reuse) {
+			prepareMatch();
+			if (mMatchCensus.contains(mCensus)) return;
+		}
+		mLocalPalette.mColors = mCensus.colors();
+		finishTable(max_size, mLocalPalette);
+		mLocalTableError = 0.0;
+		return;
+	}
+
+	// Consecutive frames usually share most of their colors, so the previous table is kept
+	// unless the bitmap matches noticeably worse than the one the table was built for.
+	if (reuse) {
+		prepareMatch();
+		if (matchError(bm) <= mLocalTableError * REUSE_ERROR_RATIO + REUSE_ERROR_SLACK) return;
+	}
+
+	mBitmapToPalette->convert(bm, availableSize(max_size), mLocalPalette);
+	finishTable(max_size, mLocalPalette);
+	mLocalTableError = -1.0;
+	if (mPaletteReuse && mToColorIndex) {
+		prepareMatch();
+		mLocalTableError = matchError(bm);
+	}
+}
+
+void WriterSettings::prepareMatch() {
+	if (!mToColorIndex) throw std::runtime_error("prepareMatch() missing ToColorIndex algorithm");
+	const uint64_t		hash = palette_hash(mMatchPalette);
+	if (mPreparedFor == mToColorIndex.get() && mPreparedHash == hash
+			&& mPreparedPalette.mColors == mMatchPalette.mColors) {
+		return;
+	}
+	mToColorIndex->setTo(mMatchPalette);
+	mMatchCensus.setTo(mMatchPalette);
+	mPreparedFor = mToColorIndex.get();
+	mPreparedHash = hash;
+	mPreparedPalette = mMatchPalette;
+}
+
+bool WriterSettings::convertExact(const gif::BitmapView &bm, gif::PalettedBitmap &pbm) const {
+	if (!mExactColors) return false;
+	// Bails at the first color that isn't in the table, so this is cheap when it fails.
+	return mMatchCensus.convert(bm, pbm);
+}
+
+double WriterSettings::matchError(const gif::BitmapView &bm) const {
+	const size_t		size = bm.size();
+	if (size < 1 || mMatchPalette.empty()) return 0.0;
+	// An odd step spreads the samples across rows and columns.
+	const size_t		step = std::max<size_t>(1, size / MATCH_ERROR_SAMPLES) | 1;
+	const size_t		width = static_cast<size_t>(bm.mWidth);
+	uint64_t			sum = 0, count = 0;
+	for (size_t k=0; k<size; k+=step) {
+		const gif::ColorA8u		c = bm.pixel(static_cast<int32_t>(k % width), static_cast<int32_t>(k / width));
+		const size_t			index = mToColorIndex->match(c);
+		if (index >= mMatchPalette.size()) continue;
+		const gif::ColorA8u&	m = mMatchPalette.mColors[index];
+		sum += std::abs(c.r - m.r) + std::abs(c.g - m.g) + std::abs(c.b - m.b);
+		++count;
+	}
+	return (count > 0 ? static_cast<double>(sum) / static_cast<double>(count) : 0.0);
+}
+
+bool WriterSettings::usesCensus() const {
+	return mExactColors && !(mBitmapToPalette && mBitmapToPalette->isFixed());
+}
+
+size_t WriterSettings::availableSize(const size_t max_size) const {
+	// Frame differencing reserves the last entry for unchanged pixels.
+	return (mFrameDifferencing ? max_size - 1 : max_size);
+}
+
+void WriterSettings::finishTable(const size_t max_size, gif::Palette &p) {
+	mMatchPalette = p;
+	mHasTransparentIndex = mFrameDifferencing;
+	if (mHasTransparentIndex) {
+		mTransparentIndex = static_cast<uint8_t>(p.size());
+		p.mColors.push_back(gif::ColorA8u(0, 0, 0, 0));
+	}
+	p.clip(max_size);
+}
+
+/**
+ * @class gif::WriterSpool
+ */
+WriterSpool::~WriterSpool() {
+	end();
+}
+
+void WriterSpool::begin(const std::string &path, const int32_t width, const int32_t height) {
+	end();
+	mPath = path;
+	mWidth = width;
+	mHeight = height;
+	mFile.open(mPath, std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+	if (!mFile) throw std::runtime_error("gif::WriterSpool can't create " + mPath);
+	mRow.resize(static_cast<size_t>(mWidth) * 3);
+}
+
+void WriterSpool::push(const gif::BitmapView &bm, const double delay) {
+	if (bm.mWidth != mWidth || bm.mHeight != mHeight) throw std::runtime_error("gif::WriterSpool::push() frame size does not match");
+	mScratch.resize(mWidth);
+	for (int32_t y=0; y<mHeight; ++y) {
+		const gif::ColorA8u*	src = bm.row(y, mScratch.data());
+		char*				dst = mRow.data();
+		for (int32_t x=0; x<mWidth; ++x) {
+			*dst++ = static_cast<char>(src->r);
+			*dst++ = static_cast<char>(src->g);
+			*dst++ = static_cast<char>(src->b);
+			++src;
+		}
+		mFile.write(mRow.data(), mRow.size());
+	}
+	if (!mFile) throw std::runtime_error("gif::WriterSpool::push() failed writing " + mPath);
+	mDelays.push_back(delay);
+}
+
+void WriterSpool::rewind() {
+	mFile.flush();
+	mFile.seekg(0);
+	mReadIndex = 0;
+}
+
+bool WriterSpool::pop(gif::Bitmap &bm, double &delay) {
+	if (mReadIndex >= mDelays.size()) return false;
+	bm.setTo(mWidth, mHeight);
+	gif::ColorA8u*			dst = bm.mPixels.data();
+	for (int32_t y=0; y<mHeight; ++y) {
+		if (!mFile.read(mRow.data(), mRow.size())) throw std::runtime_error("gif::WriterSpool::pop() failed reading " + mPath);
+		const uint8_t*		src = reinterpret_cast<const uint8_t*>(mRow.data());
+		for (int32_t x=0; x<mWidth; ++x) {
+			*dst++ = gif::ColorA8u(src[0], src[1], src[2], 255);
+			src += 3;
+		}
+	}
+	delay = mDelays[mReadIndex++];
+	return true;
+}
+
+void WriterSpool::end() {
+	if (mFile.is_open()) {
+		mFile.close();
+		std::remove(mPath.c_str());
+	}
+	mDelays.clear();
+	mReadIndex = 0;
+}
+
+/**
+ * @class gif::Writer
+ */
+Writer::Writer(std::string path)
+		: base([this](const gif::Bitmap &src, gif::Bitmap &dst){convert(src, dst);}, path) {
+}
+
+void Writer::convert(const gif::Bitmap &src, gif::Bitmap &dst) const {
+	dst = src;
+}
+
+/**
+ * @class gif::MultiWriter
+ */
+MultiWriter::MultiWriter()
+		: base([](const gif::Bitmap &src, gif::Bitmap &dst){dst = src;}) {
+}
+
+/**
+ * @func gif::write_header()
+ * &brief Write the grammar for "Header <Logical Screen>"
+ */
+void		write_header(const gif::WriterSettings &s, std::ostream &output) {
+	// Header
+	Header				header(SIG, Version::k89a);
+	header.write(output);
+
+	// Logical screen
+	LogicalScreen		screen;
+	screen.mScreenWidth = s.mWidth;
+	screen.mScreenHeight = s.mHeight;
+	screen.mBackgroundColorIndex = s.mBackgroundColorIndex;
+	if (s.mGlobalPalette.size() > 0) {
+		screen.mFlags |= LogicalScreen::GLOBAL_COLOR_TABLE_F;
+	}
+	screen.write(output, s.mGlobalPalette.size());
+
+	// Global color table
+	if (s.mGlobalPalette.size() > 0) {
+		ColorTable().write(s.mGlobalPalette.mColors, output);
+	}
+}
+
+/**
+ * @class gif::RateControl
+ */
+void RateControl::setTarget(const size_t bytes, const size_t frame_count) {
+	mTarget = bytes;
+	mFrameCount = frame_count;
+	mFrameIndex = 0;
+	mLevel = 0;
+	mBytesPerPixel = -1.0;
+	mFramePixels = -1.0;
+}
+
+void RateControl::setLayout(const bool frame_differencing, const bool local_tables) {
+	mDifferencing = frame_differencing;
+	mLocalTables = local_tables;
+}
+
+bool RateControl::keep() {
+	const size_t		index = mFrameIndex++;
+	return (index % RATE_LEVELS[mLevel].mKeepEvery) == 0;
+}
+
+void RateControl::choose(const size_t written, const size_t pixels) {
+	mPixels = std::max<size_t>(1, pixels);
+	const double		bpp = (mBytesPerPixel >= 0.0 ? mBytesPerPixel : RATE_PRIOR_BYTES_PER_PIXEL);
+	if (mFramePixels < 0.0) mFramePixels = static_cast<double>(mPixels) * (mDifferencing ? RATE_PRIOR_CHANGED_AREA : 1.0);
+
+	// Share what's left by area between this frame and the rest, keeping a byte for the trailer.
+	const size_t		left = (mTarget > written + 1 ? mTarget - written - 1 : 0);
+	const double		spend = static_cast<double>(left) * (1.0 - RATE_HEADROOM);
+	const size_t		later = (mFrameCount > mFrameIndex ? mFrameCount - mFrameIndex : 0);
+	const double		area = static_cast<double>(mPixels);
+	const double		budget = spend * area / (area + static_cast<double>(later) * mFramePixels);
+	mLevel = RATE_LEVEL_COUNT - 1;
+	for (size_t k = 0; k < RATE_LEVEL_COUNT; ++k) {
+		const RateLevel&	level = RATE_LEVELS[k];
+		if (fixedSize(k) / static_cast<double>(level.mKeepEvery) + bpp * area * level.mSize <= budget) {
+			mLevel = k;
+			break;
+		}
+	}
+}
+
+void RateControl::wrote(const size_t bytes) {
+	// Undo the level's savings, except for dropping, which doesn't change a frame's size.
+	const RateLevel&	level = RATE_LEVELS[mLevel];
+	const double		pixel_bytes = std::max(0.0, static_cast<double>(bytes) - fixedSize(mLevel));
+	const double		bpp = pixel_bytes / (static_cast<double>(mPixels) * level.mSize * static_cast<double>(level.mKeepEvery));
+	const double		area = static_cast<double>(mPixels);
+	if (mBytesPerPixel < 0.0) {
+		mBytesPerPixel = bpp;
+	} else {
+		mBytesPerPixel += (bpp - mBytesPerPixel) * RATE_SMOOTHING;
+		// The first frame is always whole, so it says nothing about the changed areas.
+		mFramePixels += (area - mFramePixels) * RATE_SMOOTHING;
+	}
+}
+
+double RateControl::fixedSize(const size_t level) const {
+	return RATE_FIXED_BYTES + (mLocalTables ? 3.0 * static_cast<double>(RATE_LEVELS[level].mMaxColors) : 0.0);
+}
+
+uint32_t RateControl::quality() const {
+	return RATE_LEVELS[mLevel].mQuality;
+}
+
+size_t RateControl::maxColors() const {
+	return RATE_LEVELS[mLevel].mMaxColors;
+}
+
+/**
+ * @func gif::write_table_based_image()
+ * &brief Write the grammar for "<Table-Based Image>"
+ */
+void		write_table_based_image(const int32_t left, const int32_t top, const PalettedBitmap &pbm,
+									const gif::Palette &table, const bool local_table,
+									const gif::Palette &match_palette, const bool interlaced,
+									LzwWriter &lzw, WriterBuffer &wb, std::ostream &output) {
+		const gif::Palette*		ct = &table;
+
+		// Image descriptor
+		write_image_descriptor(left, top, pbm.mWidth, pbm.mHeight, interlaced, (local_table ? ct : nullptr), output);
+
+		// Image data. The spec requires a minimum code size of 2, even for tiny tables.
+		const uint8_t				lzw_code_size = std::max<uint8_t>(2, count_bits(static_cast<uint8_t>(ct->size()-1)));
+		output << lzw_code_size;
+		wb.clear();
+		lzw.begin(lzw_code_size, [&wb](const std::vector<uint8_t> &data){wb.write(data);}, &match_palette.mColors);
+		lzw.encode(pbm.mPixels.data(), static_cast<size_t>(pbm.mWidth), static_cast<size_t>(pbm.mHeight), interlaced);
+		wb.terminate();
+}
+
+/**
+ * @func gif::trim_to_size()
+ */
+void		trim_to_size(	const std::string &path, const size_t bytes, const std::vector<WrittenImage> &images,
+							std::vector<FrameStats> &stats) {
+	// The file ends with its last image and the trailer.
+	if (images.empty() || images.back().mEnd + 1 <= bytes) return;
+
+	// Keep the most images that fit, with an extension (8 bytes) added to the
+	// last if it needs one for the delay.
+	size_t					kept = images.size() - 1;
+	GraphicControlExtension	gce;
+	size_t					gce_bytes = 0;
+	for (; kept > 0; --kept) {
+		const WrittenImage&	last = images[kept - 1];
+		gce = last.mGce;
+		for (size_t k=kept; k<images.size(); ++k) gce.mDelay += images[k].mGce.mDelay;
+		gce_bytes = (last.mHasGce || gce.mDelay <= 0.0 ? 0 : 8);
+		if (kept == 1 || last.mEnd + gce_bytes + 1 <= bytes) break;
+	}
+	const WrittenImage&		last = images[kept - 1];
+
+	std::vector<char>		data(last.mEnd);
+	{
+		std::ifstream		input(path, std::ios::in | std::ios::binary);
+		if (!input.read(data.data(), data.size())) throw std::runtime_error("trim_to_size() can't read " + path);
+	}
+	std::ostringstream		patch;
+	if (last.mHasGce || gce_bytes > 0) gce.write(patch);
+	const std::string		gce_data = patch.str();
+	std::ofstream			output(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (last.mHasGce) {
+		std::copy(gce_data.begin(), gce_data.end(), data.begin() + last.mStart);
+		output.write(data.data(), data.size());
+	} else {
+		output.write(data.data(), last.mStart);
+		output.write(gce_data.data(), gce_data.size());
+		output.write(data.data() + last.mStart, data.size() - last.mStart);
+	}
+	output << static_cast<uint8_t>(0x3b);
+	output.close();
+	if (output.fail()) throw std::runtime_error("trim_to_size() failed writing " + path);
+
+	if (last.mStats < stats.size()) stats[last.mStats].mBytes += gce_bytes;
+	for (size_t k=last.mStats+1; k<stats.size(); ++k) {
+		stats[k].mBytes = 0;
+		stats[k].mDropped = true;
+	}
+}
+
+/**
+ * @func gif::indices_fit()
+ */
+bool		indices_fit(const PalettedBitmap &pbm, const size_t table_size) {
+	if (table_size >= 256) return true;
+	uint8_t					largest = 0;
+	for (const auto i : pbm.mPixels) largest = std::max(largest, i);
+	return largest < table_size;
+}
+
+/**
+ * @func gif::find_changed_area()
+ */
+bool		find_changed_area(	const gif::Bitmap &prev, const gif::Bitmap &cur,
+								int32_t &left, int32_t &top, int32_t &right, int32_t &bottom) {
+	if (prev.mWidth != cur.mWidth || prev.mHeight != cur.mHeight) throw std::runtime_error("find_changed_area() bitmaps are different sizes");
+	const int32_t			w = cur.mWidth, h = cur.mHeight;
+	const size_t			row_bytes = sizeof(gif::ColorA8u) * static_cast<size_t>(w);
+	const gif::ColorA8u*	a = prev.mPixels.data();
+	const gif::ColorA8u*	b = cur.mPixels.data();
+
+	// Whole rows are compared first, which finds the vertical extent and skips
+	// identical rows without looking at individual pixels.
+	top = 0;
+	while (top < h && std::memcmp(a + top*w, b + top*w, row_bytes) == 0) ++top;
+	if (top >= h) return false;
+	bottom = h;
+	while (bottom > top && std::memcmp(a + (bottom-1)*w, b + (bottom-1)*w, row_bytes) == 0) --bottom;
+
+	// Horizontal extent. Each row only needs to be scanned outside the area found so far.
+	left = w;
+	right = 0;
+	for (int32_t y=top; y<bottom; ++y) {
+		const gif::ColorA8u*	ra = a + y*w;
+		const gif::ColorA8u*	rb = b + y*w;
+		int32_t					x = 0;
+		while (x < left && ra[x] == rb[x]) ++x;
+		if (x < left) left = x;
+		x = w;
+		while (x > right && ra[x-1] == rb[x-1]) --x;
+		if (x > right) right = x;
+	}
+	return true;
+}
+
+/**
+ * @func gif::replace_unchanged()
+ */
+void		replace_unchanged(	const gif::Bitmap &prev, const gif::Bitmap &cur,
+								const int32_t left, const int32_t top, const uint8_t index,
+								PalettedBitmap &pbm) {
+	for (int32_t y=0; y<pbm.mHeight; ++y) {
+		const size_t			src_offset = (y+top)*cur.mWidth + left;
+		const gif::ColorA8u*	a = prev.mPixels.data() + src_offset;
+		const gif::ColorA8u*	b = cur.mPixels.data() + src_offset;
+		uint8_t*				dst = pbm.mPixels.data() + y*pbm.mWidth;
+		for (int32_t x=0; x<pbm.mWidth; ++x) {
+			if (a[x] == b[x]) dst[x] = index;
+		}
+	}
+}
+
+} // namespace gif
@@ -1,180 +1,1113 @@
-#ifndef GIFIO_GIFFILE_H_
-#define GIFIO_GIFFILE_H_
-
-#include <stdexcept>
-#include "gif_algorithm.h"
-#include "gif_block.h"
-#include "gif_list.h"
-#include "lzw_writer.h"
-
-namespace gif {
-
-// Decide how to create color table(s).
-// * kGlobalTableFromFirst -- create a global color table based solely on
-// the first frame of data. This is (potentially) the most memory-efficient
-// mode, as each frame can be written and then discarded.
-// * kGlobalTableFromAll -- create a global color table based on all frames.
-// This will likely result in the best balance of final output quality and
-// file size, but at an up-front memory cost of requiring to load all frames
-// of data.
-// * kLocalTable -- a local color table is created for each frame.
-enum class TableMode {	kGlobalTableFromFirst,
-						kGlobalTableFromAll,
-						kLocalTable };
-
-/**
- * @class gif::Reader
- * @brief Load a GIF file into a sequence of images.
- * GIF spec: http://www.w3.org/Graphics/GIF/spec-gif89a.txt
- */
-class Reader {
-public:
-	Reader(std::string path);
-
-	// Given a file path, load all frames of data to output.
-	// This peforms no validation that the file is valid.
-	// Answer false on error.
-	bool				read(gif::ListConstructor &output);
-
-private:
-	std::string			mPath;
-};
-
-/**
- * @class gif::WriterSettings
- * @brief Private internal class.
- */
-class WriterSettings {
-public:
-	WriterSettings() { }
-
-	void						makeGlobalTable(const gif::Bitmap&);
-
-	int32_t						mWidth = 0,
-								mHeight = 0;
-	uint8_t						mBackgroundColorIndex = 0;
-	TableMode					mTableMode = TableMode::kGlobalTableFromFirst;
-	gif::Palette				mGlobalPalette;
-
-	BitmapToPaletteRef			mBitmapToPalette;
-	ToColorIndexRef				mToColorIndex;
-	ToPalettedBitmapRef			mToPalettedBitmap;
-};
-
-/**
- * @class gif::WriterT
- * @brief Write image frames into a GIF file.
- * GIF spec: http://www.w3.org/Graphics/GIF/spec-gif89a.txt
- */
-template <typename T>
-class WriterT {
-public:
-	WriterT(std::function<void(const T&, gif::Bitmap&)>, std::string path);
-	virtual ~WriterT();
-
-	WriterT&				setTableMode(TableMode m) { mSettings.mTableMode = m; return *this; }
-	WriterT&				setBackgroundColorIndex(const uint8_t v) { mSettings.mBackgroundColorIndex = v; return *this; }
-
-	// Add the frame to the file. Throw on error.
-	void					writeFrame(const T&);
-
-	// Various pluggable algorithms. Ignore for defaults.
-
-	// Create a palette from a bitmap.
-	WriterT&				setBitmapToPalette(BitmapToPaletteRef a = nullptr) { mSettings.mBitmapToPalette = a; return *this; }
-	// When converting a bitmap into a paletted bitmap, this determines how to match the RGBA color
-	// to the nearest palette color.
-	WriterT&				setToColorIndex(ToColorIndexRef a = nullptr) { mSettings.mToColorIndex = a; return *this; }
-	// When converting a bitmap to a paletted bitmap, this determines how the full bitmap is processed.
-	WriterT&				setToPalettedBitmap(ToPalettedBitmapRef a = nullptr) { mSettings.mToPalettedBitmap = a; return *this; }
-
-private:
-	WriterSettings			mSettings;
-	std::function<void(const T&, gif::Bitmap&)>
-							mConvertFn;
-	std::string				mPath;
-	bool					mNeedsHeader = true;
-	TableMode				mTableMode = TableMode::kGlobalTableFromFirst;
-	gif::Bitmap				mPixels;
-	PalettedBitmap			mPalettedBitmap;
-	// Store the encoder so I can reuse memory
-	LzwWriter				mLzwWriter;
-	std::ofstream			mStream;
-	WriterBuffer			mBlockBuffer;
-};
-
-/**
- * @class gif::Writer
- * @brief A writer that specializes on the GIF bitmap storage class,
- * if you want to handle all the pixel wrangling yourself.
- */
-class Writer : public WriterT<gif::Bitmap> {
-public:
-	Writer(std::string path);
-
-private:
-	void					convert(const gif::Bitmap &src, gif::Bitmap &dst) const;
-
-	using base = WriterT<gif::Bitmap>;
-};
-
-/**
- * @class gif::WriterT IMPLEMENTATION
- */
-template <typename T>
-WriterT<T>::WriterT(std::function<void(const T&, gif::Bitmap&)> convert_fn, std::string path)
-		: mConvertFn(convert_fn)
-		, mPath(path)
-		, mBlockBuffer(mStream) {
-}
-
-template <typename T>
-WriterT<T>::~WriterT() {
-	if (mStream) {
-		// Ending trailer byte
-		mStream << 0x3b;
-	}
-}
-
-template <typename T>
-void WriterT<T>::writeFrame(const T &t) {
-	if (!mConvertFn) throw std::runtime_error("gif::Writer<T>::writeFrame() has no convert function");
-	mConvertFn(t, mPixels);
-	if (mPixels.empty()) throw std::runtime_error("gif::Writer<T>::writeFrame() conversion failed");
-
-	// Initialize my algorithms
-	if (!mSettings.mBitmapToPalette) mSettings.mBitmapToPalette = BitmapToPalette::create();
-	if (!mSettings.mToColorIndex) mSettings.mToColorIndex = ToColorIndex::create();
-	if (!mSettings.mToPalettedBitmap) mSettings.mToPalettedBitmap = ToPalettedBitmap::create();
-
-	// Delay the initial writing until I receive frame data as a convenience, so clients don't
-	// need to specify a screen size but instead it can just be pulled from the bitmap.
-	if (mNeedsHeader) {
-		mNeedsHeader = false;
-
-		mStream = std::ofstream(mPath, std::ios::out | std::ios::binary);
-
-		mSettings.mWidth = mPixels.mWidth;
-		mSettings.mHeight = mPixels.mHeight;
-		if (mSettings.mWidth >= 1<<16 || mSettings.mHeight >= 1<<16) throw std::runtime_error("gif::Writer<T>::writeFrame() image is too large");
-		if (mSettings.mTableMode == TableMode::kGlobalTableFromFirst) {
-			mSettings.makeGlobalTable(mPixels);
-		}
-		write_header(mSettings, mStream);
-	}
-
-	// Write the image data
-	mSettings.mToColorIndex->setTo(mSettings.mGlobalPalette);
-	mSettings.mToPalettedBitmap->convert(mPixels, mSettings.mToColorIndex, mPalettedBitmap);
-	if (mPalettedBitmap.empty()) throw std::runtime_error("gif::Writer<T>::writeFrame() failed to convert to paletted bitmap");
-	write_table_based_image(mSettings, mPixels, mPalettedBitmap, mLzwWriter, mBlockBuffer, mStream);
-}
-
-// Private writing API
-void		write_header(const gif::WriterSettings&, std::ostream &output);
-void		write_table_based_image(const gif::WriterSettings&, const gif::Bitmap&, const PalettedBitmap&,
-									LzwWriter&, WriterBuffer&, std::ostream &output);
-
-} // namespace gif
-
-#endif
+#ifndef GIFIO_GIFFILE_H_
+#define GIFIO_GIFFILE_H_
+
+#include <cmath>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include "gif_algorithm.h"
+#include "gif_async_file.h"
+#include "gif_block.h"
+#include "gif_color_census.h"
+#include "gif_list.h"
+#include "lzw_reader.h"
+#include "lzw_writer.h"
+
+namespace gif {
+
+// Decide how to create color table(s).
+// * kGlobalTableFromFirst -- create a global color table based solely on
+// the first frame of data. This is (potentially) the most memory-efficient
+// mode, as each frame can be written and then discarded.
+// * kGlobalTableFromAll -- create a global color table based on all frames.
+// This will likely result in the best balance of final output quality and
+// file size. Since the table has to be written before any frames, frames
+// are spooled to a temporary file next to the output and written on finish().
+// Memory is limited to the color statistics and a single frame.
+// * kLocalTable -- a local color table is created for each frame.
+enum class TableMode {	kGlobalTableFromFirst,
+						kGlobalTableFromAll,
+						kLocalTable };
+
+/**
+ * @class gif::Reader
+ * @brief Load a GIF file into a sequence of images.
+ * GIF spec: http://www.w3.org/Graphics/GIF/spec-gif89a.txt
+ */
+class Reader {
+public:
+	Reader() { }
+	Reader(std::string path);
+
+	// Given a file path, load all frames of data to output.
+	// This peforms no validation that the file is valid.
+	// Answer false on error.
+	bool				read(gif::ListConstructor &output);
+	// Read another file. The file buffer, decoder and bitmap are kept between
+	// reads, so a reader reused for many files (i.e. one per worker thread)
+	// stops allocating once it has seen the largest.
+	bool				read(const std::string &path, gif::ListConstructor &output);
+
+private:
+	std::string			mPath;
+	std::vector<char>	mBuffer;
+	gif::LzwReader		mDecoder;
+	gif::Bitmap			mBitmap;
+	std::vector<uint8_t>	mIndexes;
+};
+
+/**
+ * @class gif::Editor
+ * @brief Trim, join, retime and re-loop GIF files without decoding them.
+ * Image data is copied byte for byte; only the control extensions, image
+ * descriptors, color tables and loop extension around it are rewritten.
+ * Frames keep whatever they were drawn over in their source file, so
+ * cutting the start off an animation that only stores the changed area
+ * of each frame shows just those areas until the next full frame.
+ */
+class Editor {
+public:
+	Editor() { }
+
+	// Replace my frames with the file's. Throw on error.
+	Editor&					load(const std::string &path);
+	// Add the file's frames after mine. Throw on error. Frames that use a
+	// different global table than my first file get it as a local table, and
+	// my last frame is restored to the background so the new frames start
+	// clear (as long as that frame covers the screen).
+	Editor&					append(const std::string &path);
+	Editor&					append(const Editor&);
+
+	size_t					size() const { return mFrames.size(); }
+	bool					empty() const { return mFrames.empty(); }
+	// The screen size, large enough for every file's.
+	int32_t					getWidth() const;
+	int32_t					getHeight() const;
+	// Keep the frames in [begin, end).
+	Editor&					trim(const size_t begin, const size_t end);
+
+	// Delays are in seconds, stored in hundredths.
+	double					getDelay(const size_t frame) const;
+	Editor&					setDelay(const size_t frame, const double delay);
+	Editor&					setDelays(const double delay);
+	// Multiply every delay, i.e. 0.5 plays twice as fast.
+	Editor&					scaleDelays(const double scale);
+
+	// The number of times the animation repeats after the first play, 0 to
+	// repeat forever, or NO_LOOP to write no loop extension (most viewers then
+	// play once). Loaded from the first file.
+	static const int32_t	NO_LOOP = -1;
+	int32_t					getLoopCount() const { return mLoopCount; }
+	Editor&					setLoopCount(const int32_t count) { mLoopCount = count; return *this; }
+
+	// Re-encode every frame to make the file smaller without changing how it
+	// looks. Frames are decoded to color indices, never to pixels. Each frame is
+	// cut down to the area that changed, unchanged pixels in it become
+	// transparent, and identical frames merge. The colors in use are pooled
+	// into a global table, with local tables for frames that don't fit. Answer
+	// false and change nothing if the result wouldn't be smaller, or if a frame
+	// would need more than 256 colors.
+	bool					optimize(const LzwWriter::Effort = LzwWriter::Effort::kBalanced);
+
+	// Throw on error.
+	void					save(const std::string &path) const;
+
+private:
+	// A loaded file. Frames point into its bytes.
+	class Source {
+	public:
+		std::vector<char>	mBytes;
+		int32_t				mWidth = 0,
+							mHeight = 0;
+		uint8_t				mBackgroundColorIndex = 0;
+		bool				mHasGlobalTable = false;
+		gif::Palette		mGlobalTable;
+	};
+
+	class Frame {
+	public:
+		std::shared_ptr<const Source>	mSource;
+		// The LZW code size byte through the block terminator.
+		size_t				mDataBegin = 0,
+							mDataEnd = 0;
+		bool				mHasGce = false;
+		GraphicControlExtension	mGce;
+		int32_t				mLeft = 0,
+							mTop = 0,
+							mWidth = 0,
+							mHeight = 0;
+		bool				mInterlaced = false;
+		bool				mHasLocalTable = false;
+		gif::Palette		mLocalTable;
+
+		const gif::Palette&	table() const { return mHasLocalTable ? mLocalTable : mSource->mGlobalTable; }
+	};
+
+	void					read(const std::string &path, std::vector<Frame>&, int32_t &loop_count) const;
+	Frame&					frameAt(const size_t, const char *fn);
+	// Answer true if the frame is saved with a local table.
+	bool					writesTable(const Frame&) const;
+	// Answer the size of the file save() would write.
+	size_t					encodedSize() const;
+
+	std::vector<Frame>		mFrames;
+	int32_t					mLoopCount = NO_LOOP;
+};
+
+/**
+ * @class gif::WriterSettings
+ * @brief Private internal class.
+ */
+class WriterSettings {
+public:
+	WriterSettings() { }
+
+	// Create the global table from a single bitmap, or from everything
+	// that has been accumulated in the BitmapToPalette.
+	void						makeGlobalTable(const gif::BitmapView&);
+	void						makeGlobalTableFromAccumulated();
+	// Use the client's palette as the global table.
+	void						setGlobalTable(const gif::Palette&);
+	// Use a table another writer built, given as its colors before any reserved
+	// entries, as if it had been built here. Answer false if it has more colors
+	// than fit my maximum size.
+	bool						shareGlobalTable(const gif::Palette &colors);
+	// Collect statistics for makeGlobalTableFromAccumulated().
+	void						beginAccumulating();
+	void						accumulate(const gif::BitmapView&);
+	// Create the table for a single image. When palette reuse is on and the
+	// current table still fits the bitmap, it's kept instead.
+	void						makeLocalTable(const gif::BitmapView&);
+	// Point the ToColorIndex at the match palette, unless it already is.
+	void						prepareMatch();
+	// Map the bitmap through the exact colors of the match palette, with no
+	// distance search. Answer false if exact colors are off or any color is
+	// missing from the palette. Requires prepareMatch().
+	bool						convertExact(const gif::BitmapView&, gif::PalettedBitmap&) const;
+
+	bool						hasLocalTable() const { return mTableMode == TableMode::kLocalTable; }
+	bool						hasGlobalTable() const { return !hasLocalTable() && !mGlobalPalette.empty(); }
+	// The table that applies to the image currently being written.
+	const gif::Palette&			currentTable() const { return hasLocalTable() ? mLocalPalette : mGlobalPalette; }
+
+	int32_t						mWidth = 0,
+								mHeight = 0;
+	uint8_t						mBackgroundColorIndex = 0;
+	TableMode					mTableMode = TableMode::kGlobalTableFromFirst;
+	bool						mFrameDifferencing = false;
+	bool						mPaletteReuse = true;
+	bool						mExactColors = true;
+	bool						mInterlaced = false;
+	// The largest table to build, including any reserved entry.
+	size_t						mMaxColors = 256;
+	// The client supplied the global table.
+	bool						mGlobalTableSet = false;
+	gif::Palette				mGlobalPalette,
+								mLocalPalette;
+	// The colors clients are allowed to match against. This is the
+	// current table minus any reserved entries.
+	gif::Palette				mMatchPalette;
+	// When frame differencing, a palette index is reserved for unchanged pixels.
+	bool						mHasTransparentIndex = false;
+	uint8_t						mTransparentIndex = 0;
+
+	BitmapToPaletteRef			mBitmapToPalette;
+	ToColorIndexRef				mToColorIndex;
+	ToPalettedBitmapRef			mToPalettedBitmap;
+
+private:
+	// Answer true if tables may be built from a census of the bitmap's colors.
+	// A fixed palette is always written as is.
+	bool						usesCensus() const;
+	// Answer max_size minus any reserved entries.
+	size_t						availableSize(const size_t max_size) const;
+	// Add any reserved entries to the freshly generated palette.
+	void						finishTable(const size_t max_size, gif::Palette&);
+	// Answer the average distance from a sample of the bitmap's pixels to
+	// their matches. Requires prepareMatch().
+	double						matchError(const gif::BitmapView&) const;
+
+	// The palette the ToColorIndex was last set to, with its hash as a quick reject.
+	const ToColorIndex*			mPreparedFor = nullptr;
+	uint64_t					mPreparedHash = 0;
+	gif::Palette				mPreparedPalette;
+	// The match error of the local table on the bitmap it was built from.
+	double						mLocalTableError = -1.0;
+	// Bitmaps with few enough colors get a table of exactly those colors. The
+	// match census is the match palette, for exact lookups.
+	gif::ColorCensus			mCensus,
+								mMatchCensus;
+	bool						mAccumulatedExact = false;
+};
+
+/**
+ * @class gif::WriterSpool
+ * @brief Private internal class. Store frames in a temporary file until
+ * they can be written, so memory use doesn't grow with the frame count.
+ * Frames are stored as packed RGB; alpha is discarded, as it is by the
+ * rest of the writer.
+ */
+class WriterSpool {
+public:
+	WriterSpool() { }
+	~WriterSpool();
+
+	bool						empty() const { return mDelays.empty(); }
+	size_t						size() const { return mDelays.size(); }
+
+	// Create the file. All frames must be the same size.
+	void						begin(const std::string &path, const int32_t width, const int32_t height);
+	void						push(const gif::BitmapView&, const double delay);
+	// Read back the frames in order. Answer false when there are no more.
+	void						rewind();
+	bool						pop(gif::Bitmap&, double &delay);
+	// Close and delete the file.
+	void						end();
+
+private:
+	std::string					mPath;
+	std::fstream				mFile;
+	int32_t						mWidth = 0,
+								mHeight = 0;
+	std::vector<double>			mDelays;
+	size_t						mReadIndex = 0;
+	std::vector<char>			mRow;
+	std::vector<gif::ColorA8u>	mScratch;
+};
+
+/**
+ * @class gif::FrameStats
+ * @brief What the writer did with one frame.
+ */
+class FrameStats {
+public:
+	FrameStats() { }
+
+	double						mDelay = 0.0;
+	// Bytes written for the frame's image, including its graphic control
+	// extension and any local table. 0 when it didn't get an image.
+	size_t						mBytes = 0;
+	// The lossy quality and table size it was written with.
+	uint32_t					mQuality = 100;
+	size_t						mMaxColors = 256;
+	// Identical to the previous frame with frame differencing, which was shown
+	// longer instead. Dropped is the same, but to meet the target size.
+	bool						mMerged = false,
+								mDropped = false;
+};
+
+/**
+ * @class gif::RateControl
+ * @brief Private internal class. Pick settings for each frame so the file
+ * ends up within a target size, in a single pass. Each setting level trades
+ * quality for an expected fraction of the full quality size, and the bytes
+ * per pixel at full quality are estimated from the frames written so far.
+ * What's left of the budget is shared by area, so the whole first frame of
+ * frame differencing gets more than the changed areas after it, less some
+ * headroom in case the estimates are low.
+ */
+class RateControl {
+public:
+	RateControl() { }
+
+	bool						active() const { return mTarget > 0; }
+	size_t						target() const { return mTarget; }
+	void						setTarget(const size_t bytes, const size_t frame_count);
+	void						setFrameCount(const size_t frame_count) { mFrameCount = frame_count; }
+	bool						hasFrameCount() const { return mFrameCount > 0; }
+	// Describe how frames are written, before the first.
+	void						setLayout(const bool frame_differencing, const bool local_tables);
+
+	// Start the next frame. Answer false if it should be dropped.
+	bool						keep();
+	// Pick the settings for the frame just kept, from the bytes written so far.
+	void						choose(const size_t written, const size_t pixels);
+	// The frame was written in the given number of bytes.
+	void						wrote(const size_t bytes);
+
+	uint32_t					quality() const;
+	size_t						maxColors() const;
+
+private:
+	// Answer the bytes a frame costs regardless of its pixels at the level.
+	double						fixedSize(const size_t level) const;
+
+	size_t						mTarget = 0,
+								mFrameCount = 0,
+								mFrameIndex = 0,
+								mLevel = 0,
+								mPixels = 0;
+	bool						mDifferencing = false,
+								mLocalTables = false;
+	// Estimated bytes per pixel at full quality, and pixels per frame, or negative before any.
+	double						mBytesPerPixel = -1.0,
+								mFramePixels = -1.0;
+};
+
+/**
+ * @class gif::WrittenImage
+ * @brief Private internal class. Where an image went in the file, so rate
+ * control can trim the file after it's written.
+ */
+class WrittenImage {
+public:
+	WrittenImage() { }
+
+	// The image's bytes, from its graphic control extension if it has one.
+	size_t						mStart = 0,
+								mEnd = 0;
+	bool						mHasGce = false;
+	GraphicControlExtension		mGce;
+	// Its index in the writer's frame stats.
+	size_t						mStats = 0;
+};
+
+// Private writing API
+void		write_header(const gif::WriterSettings&, std::ostream &output);
+// Write the image with the given table, which is written with it if it's local.
+// Lossy encoding only trades between the colors of the match palette.
+void		write_table_based_image(const int32_t left, const int32_t top, const PalettedBitmap&,
+									const gif::Palette &table, const bool local_table,
+									const gif::Palette &match_palette, const bool interlaced,
+									LzwWriter&, WriterBuffer&, std::ostream &output);
+// Answer true if every pixel is an index into a table of the given size.
+bool		indices_fit(const PalettedBitmap&, const size_t table_size);
+// Find the bounding area of all pixels that differ between the bitmaps, which must
+// be the same size. Right and bottom are exclusive. Answer false if they are identical.
+bool		find_changed_area(	const gif::Bitmap &prev, const gif::Bitmap &cur,
+								int32_t &left, int32_t &top, int32_t &right, int32_t &bottom);
+// Assign index to every pixel in pbm, which is positioned at left, top, where
+// the previous and current bitmaps are identical.
+void		replace_unchanged(	const gif::Bitmap &prev, const gif::Bitmap &cur,
+								const int32_t left, const int32_t top, const uint8_t index,
+								PalettedBitmap &pbm);
+// Drop the last images of the finished file at path until it's no more than bytes,
+// showing the last image kept for as long as they were, and update their frame stats.
+// The first image is always kept. Throw on error.
+void		trim_to_size(	const std::string &path, const size_t bytes, const std::vector<WrittenImage>&,
+							std::vector<FrameStats>&);
+
+template <typename T> class MultiWriterT;
+
+/**
+ * @class gif::WriterT
+ * @brief Write image frames into a GIF file.
+ * GIF spec: http://www.w3.org/Graphics/GIF/spec-gif89a.txt
+ */
+template <typename T>
+class WriterT {
+public:
+	WriterT(std::function<void(const T&, gif::Bitmap&)>, std::string path);
+	virtual ~WriterT();
+
+	WriterT&				setTableMode(TableMode m) { mSettings.mTableMode = m; return *this; }
+	WriterT&				setBackgroundColorIndex(const uint8_t v) { mSettings.mBackgroundColorIndex = v; return *this; }
+	// Compare each frame to the previous one and only write the area that changed, with
+	// unchanged pixels set to a reserved transparent index. Identical frames are merged
+	// by extending the delay of the previous frame. Must be set before the first frame.
+	WriterT&				setFrameDifferencing(const bool v) { mSettings.mFrameDifferencing = v; return *this; }
+	// With local tables, keep the previous frame's table (and the prepared ToColorIndex)
+	// when it still fits the new frame about as well as it fit its own, instead of
+	// building a new one. On by default.
+	WriterT&				setPaletteReuse(const bool v) { mSettings.mPaletteReuse = v; return *this; }
+	// Frames with no more unique colors than fit in a table are written losslessly:
+	// the table is built from exactly those colors (when a table is built from them)
+	// and pixels are mapped by lookup instead of a nearest color search. On by default.
+	// A fixed BitmapToPalette keeps its own table; only the lookup applies.
+	WriterT&				setExactColors(const bool v) { mSettings.mExactColors = v; return *this; }
+	// Write images interlaced, so viewers can show a coarse version of each after a
+	// fraction of its data has arrived. Off by default.
+	WriterT&				setInterlaced(const bool v) { mSettings.mInterlaced = v; return *this; }
+	// Write the file on a separate thread, so encoding never waits on the disk. Encoded
+	// data fills buffer_count buffers of buffer_size bytes in turn, which bounds the
+	// memory in flight. Write errors surface from a later frame or finish(). Off by
+	// default. Must be set before the first frame.
+	WriterT&				setAsyncOutput(const bool, const size_t buffer_size = 1<<18, const size_t buffer_count = 4);
+	// Trade encoding time for smaller image data. The default, kFast, resets the LZW
+	// code table whenever it fills; higher efforts keep a full table while it still
+	// compresses well (see LzwWriter::Effort). Any effort decodes everywhere.
+	WriterT&				setEffort(const LzwWriter::Effort e) { mLzwWriter.setEffort(e); return *this; }
+	// Lossy encoding, from 0 to 100 (lossless, the default). Lower qualities let the
+	// encoder swap pixels for nearby colors of the table to make the data smaller, with
+	// around 80 being hard to notice on photographic frames. Transparent pixels are
+	// never swapped, so frame differencing is unaffected.
+	WriterT&				setQuality(const uint32_t q) { mQuality = q; mLzwWriter.setQuality(q); return *this; }
+	// The most colors to build a table with, from 2 to 256 (the default). Tables are
+	// padded to the next power of 2, as the format requires, but only these colors are
+	// used. Smaller tables mean smaller LZW codes. Doesn't apply to a table from
+	// setGlobalTable().
+	WriterT&				setMaxColors(const size_t);
+	// Keep the file within bytes over frame_count frames, in one pass. As frames are
+	// written, each one's share of what's left of the budget is compared with the size
+	// expected from the frames so far, and the quality (see setQuality()) and table size
+	// are lowered to fit, then frames dropped, each extending the previous frame's delay.
+	// A global table is built before anything is known, so only local tables shrink.
+	// If the file still comes out too large, finish() drops its last frames, showing
+	// the last frame kept for their time instead, so the file always fits unless its
+	// first frame alone doesn't.
+	// kGlobalTableFromAll counts the frames itself. Indexed frames count towards both
+	// and are never changed, though they can be dropped from the end.
+	// 0 bytes turns it off.
+	// Must be set before the first frame.
+	WriterT&				setTargetSize(const size_t bytes, const size_t frame_count = 0);
+	// What happened to each frame written so far, in order. Complete after finish().
+	const std::vector<FrameStats>&	getFrameStats() const { return mFrameStats; }
+
+	// Add the frame to the file, to be displayed for delay seconds. Throw on error.
+	void					writeFrame(const T&, const double delay = 0.0);
+	// Add a frame read in place from client memory, skipping the convert function.
+	// The memory is only used during the call. Frame differencing still has to copy
+	// the frame, to compare against the next one.
+	void					writeFrame(const gif::BitmapView&, const double delay = 0.0);
+	// Add a frame that is already indexed, which goes straight to the encoder with no
+	// quantizing. With a palette, the first frame's palette becomes the global table
+	// (for kGlobalTableFromFirst) and any frame with a different palette gets a local
+	// table. Without one, the frame uses the global table. Frame differencing doesn't
+	// apply, and kGlobalTableFromAll isn't supported. Can be mixed with writeFrame().
+	// Throw on error, including indices outside the palette.
+	void					writeIndexed(const PalettedBitmap&, const gif::Palette&, const double delay = 0.0);
+	void					writeIndexed(const PalettedBitmap&, const double delay = 0.0);
+	// Supply the global table instead of building one, for writeIndexed() or to
+	// match writeFrame() against. Switches to kGlobalTableFromFirst. Must be called
+	// before the first frame.
+	WriterT&				setGlobalTable(const gif::Palette&);
+	// Write any pending frame and the trailer. This is called automatically on
+	// destruction, but clients that want to be notified of errors should call
+	// it directly. Throw on error.
+	void					finish();
+
+	// Various pluggable algorithms. Ignore for defaults.
+
+	// Create a palette from a bitmap.
+	WriterT&				setBitmapToPalette(BitmapToPaletteRef a = nullptr) { mSettings.mBitmapToPalette = a; return *this; }
+	// When converting a bitmap into a paletted bitmap, this determines how to match the RGBA color
+	// to the nearest palette color.
+	WriterT&				setToColorIndex(ToColorIndexRef a = nullptr) { mSettings.mToColorIndex = a; return *this; }
+	// When converting a bitmap to a paletted bitmap, this determines how the full bitmap is processed.
+	WriterT&				setToPalettedBitmap(ToPalettedBitmapRef a = nullptr) { mSettings.mToPalettedBitmap = a; return *this; }
+
+private:
+	// Multi writers share one output's table with the others.
+	template <typename> friend class MultiWriterT;
+
+	void					startFile();
+	void					addFrame(const gif::BitmapView&, const double delay);
+	// Convert and write the frame.
+	void					encodeFrame(const gif::BitmapView&, const double delay);
+	// Apply the rate control settings for the frame about to be converted.
+	void					chooseRate(const size_t pixels);
+	// Write with the settings' current table, or the local table if supplied, for the
+	// frame stats at the index. Answer the bytes written.
+	size_t					writeImage(	const GraphicControlExtension&, const int32_t left, const int32_t top, const PalettedBitmap&,
+										const size_t stats, const gif::Palette *local_table = nullptr);
+	// Start the file for the first indexed frame, taking the global table from the palette if needed.
+	void					startIndexed(const PalettedBitmap&, const gif::Palette*);
+	void					writeIndexedImage(const PalettedBitmap&, const gif::Palette *local_table, const double delay);
+	void					writePending();
+	bool					isOpen() const { return mFileBuffer.is_open() || mAsyncBuffer.is_open(); }
+
+	WriterSettings			mSettings;
+	std::function<void(const T&, gif::Bitmap&)>
+							mConvertFn;
+	std::string				mPath;
+	bool					mNeedsHeader = true;
+	TableMode				mTableMode = TableMode::kGlobalTableFromFirst;
+	gif::Bitmap				mPixels;
+	// Frame differencing. The previous frame is retained for comparison, and
+	// each frame is held until the next arrives so identical frames can be merged.
+	// Rate control holds frames too, in case it drops the next.
+	gif::Bitmap				mPreviousPixels;
+	bool					mHasPending = false;
+	int32_t					mPendingLeft = 0,
+							mPendingTop = 0;
+	size_t					mPendingStats = 0;
+	GraphicControlExtension	mPendingGce;
+	PalettedBitmap			mPendingBitmap;
+	// The padded table of the current indexed frame.
+	gif::Palette			mIndexedTable;
+	// Frames are held here when the global table needs every frame.
+	WriterSpool				mSpool;
+	// The client's quality and table size, which rate control can only lower.
+	uint32_t				mQuality = 100;
+	size_t					mMaxColors = 256;
+	RateControl				mRate;
+	std::vector<WrittenImage>	mWritten;
+	std::vector<FrameStats>	mFrameStats;
+	// Store the encoder so I can reuse memory
+	LzwWriter				mLzwWriter;
+	// The stream writes through one of the buffers.
+	bool					mAsyncOutput = false;
+	std::filebuf			mFileBuffer;
+	AsyncFileBuffer			mAsyncBuffer;
+	std::ostream			mStream;
+	WriterBuffer			mBlockBuffer;
+};
+
+/**
+ * @class gif::Writer
+ * @brief A writer that specializes on the GIF bitmap storage class,
+ * if you want to handle all the pixel wrangling yourself.
+ */
+class Writer : public WriterT<gif::Bitmap> {
+public:
+	Writer(std::string path);
+
+	using WriterT<gif::Bitmap>::writeFrame;
+	// Read the bitmap in place rather than copying it.
+	void					writeFrame(const gif::Bitmap &bm, const double delay = 0.0) { base::writeFrame(gif::BitmapView(bm), delay); }
+
+private:
+	void					convert(const gif::Bitmap &src, gif::Bitmap &dst) const;
+
+	using base = WriterT<gif::Bitmap>;
+};
+
+/**
+ * @class gif::MultiWriterT
+ * @brief Write each frame into several GIF files at once, such as full size,
+ * half size and a preview. Each frame is converted once, and each output is
+ * scaled from the next larger one's pixels. Outputs that build their global
+ * table from the first frame share the one the largest of them builds, along
+ * with its color matcher, so the histogram, palette and inverse color map are
+ * made once. Outputs then quantize and encode on their own threads.
+ */
+template <typename T>
+class MultiWriterT {
+public:
+	MultiWriterT(std::function<void(const T&, gif::Bitmap&)>);
+	virtual ~MultiWriterT();
+
+	// Add an output at a scale of the input size, rounded to at least 1 pixel.
+	// Answer its writer, to configure before the first frame.
+	Writer&					addOutput(const std::string &path, const double scale = 1.0);
+	size_t					size() const { return mOutputs.size(); }
+	Writer&					getOutput(const size_t);
+	// Share the global table between the outputs that can. On by default.
+	MultiWriterT&			setShareTable(const bool v) { mShareTable = v; return *this; }
+
+	// Add the frame to every file. Throw on error.
+	void					writeFrame(const T&, const double delay = 0.0);
+	void					writeFrame(const gif::BitmapView&, const double delay = 0.0);
+	// Finish every file, then throw the first error, if any.
+	void					finish();
+
+private:
+	class Output {
+	public:
+		std::unique_ptr<Writer>	mWriter;
+		double				mScale = 1.0;
+		int32_t				mWidth = 0,
+							mHeight = 0;
+		gif::Bitmap			mPixels;
+	};
+
+	// Fix each output's size and the order they're scaled in.
+	void					start(const gif::BitmapView&);
+	// Scale the frame for every output into views.
+	void					scale(const gif::BitmapView&);
+	// Answer true if the output builds its global table from the first frame.
+	bool					canShare(const Writer&) const;
+
+	std::function<void(const T&, gif::Bitmap&)>
+							mConvertFn;
+	gif::Bitmap				mPixels;
+	std::vector<Output>		mOutputs;
+	// Output indexes, largest scale first.
+	std::vector<size_t>		mOrder;
+	std::vector<gif::BitmapView>
+							mViews;
+	int32_t					mWidth = 0,
+							mHeight = 0;
+	bool					mStarted = false,
+							mShareTable = true;
+};
+
+/**
+ * @class gif::MultiWriter
+ * @brief A multi writer that specializes on the GIF bitmap storage class.
+ */
+class MultiWriter : public MultiWriterT<gif::Bitmap> {
+public:
+	MultiWriter();
+
+	using MultiWriterT<gif::Bitmap>::writeFrame;
+	// Read the bitmap in place rather than copying it.
+	void					writeFrame(const gif::Bitmap &bm, const double delay = 0.0) { base::writeFrame(gif::BitmapView(bm), delay); }
+
+private:
+	using base = MultiWriterT<gif::Bitmap>;
+};
+
+/**
+ * @class gif::WriterT IMPLEMENTATION
+ */
+template <typename T>
+WriterT<T>::WriterT(std::function<void(const T&, gif::Bitmap&)> convert_fn, std::string path)
+		: mConvertFn(convert_fn)
+		, mPath(path)
+		, mStream(nullptr)
+		, mBlockBuffer(mStream) {
+}
+
+template <typename T>
+WriterT<T>::~WriterT() {
+	try {
+		finish();
+	} catch (std::exception const&) {
+	}
+}
+
+template <typename T>
+void WriterT<T>::writeFrame(const T &t, const double delay) {
+	if (!mConvertFn) throw std::runtime_error("gif::Writer<T>::writeFrame() has no convert function");
+	mConvertFn(t, mPixels);
+	if (mPixels.empty()) throw std::runtime_error("gif::Writer<T>::writeFrame() conversion failed");
+	addFrame(gif::BitmapView(mPixels), delay);
+}
+
+template <typename T>
+void WriterT<T>::writeFrame(const gif::BitmapView &view, const double delay) {
+	if (view.empty()) throw std::runtime_error("gif::Writer<T>::writeFrame() view is empty");
+	addFrame(view, delay);
+}
+
+template <typename T>
+void WriterT<T>::addFrame(const gif::BitmapView &view, const double delay) {
+	// Initialize my algorithms
+	if (!mSettings.mBitmapToPalette) mSettings.mBitmapToPalette = BitmapToPalette::create();
+	if (!mSettings.mToColorIndex) mSettings.mToColorIndex = ToColorIndex::create();
+	if (!mSettings.mToPalettedBitmap) mSettings.mToPalettedBitmap = ToPalettedBitmap::create();
+
+	// Delay the initial writing until I receive frame data as a convenience, so clients don't
+	// need to specify a screen size but instead it can just be pulled from the bitmap.
+	if (mNeedsHeader) {
+		mNeedsHeader = false;
+
+		mSettings.mWidth = view.mWidth;
+		mSettings.mHeight = view.mHeight;
+		if (mSettings.mWidth >= 1<<16 || mSettings.mHeight >= 1<<16) throw std::runtime_error("gif::Writer<T>::writeFrame() image is too large");
+		if (mRate.active() && !mRate.hasFrameCount() && mSettings.mTableMode != TableMode::kGlobalTableFromAll) {
+			throw std::runtime_error("gif::Writer<T>::writeFrame() setTargetSize() needs a frame count");
+		}
+		mRate.setLayout(mSettings.mFrameDifferencing, mSettings.hasLocalTable());
+		if (mSettings.mTableMode == TableMode::kGlobalTableFromAll) {
+			// The header needs the final table, so frames are spooled and written in finish().
+			mSettings.beginAccumulating();
+			mSpool.begin(mPath + ".frames", mSettings.mWidth, mSettings.mHeight);
+		} else {
+			if (mSettings.mTableMode == TableMode::kGlobalTableFromFirst && !mSettings.mGlobalTableSet) {
+				mSettings.makeGlobalTable(view);
+			}
+			startFile();
+		}
+	}
+	if (view.mWidth != mSettings.mWidth || view.mHeight != mSettings.mHeight) {
+		throw std::runtime_error("gif::Writer<T>::writeFrame() frame size does not match the first frame");
+	}
+
+	if (mSettings.mTableMode == TableMode::kGlobalTableFromAll) {
+		mSettings.accumulate(view);
+		mSpool.push(view, delay);
+	} else {
+		encodeFrame(view, delay);
+	}
+}
+
+template <typename T>
+void WriterT<T>::writeIndexed(const PalettedBitmap &pbm, const gif::Palette &palette, const double delay) {
+	if (palette.empty() || palette.size() > 256) throw std::runtime_error("gif::Writer<T>::writeIndexed() palette must have 1 to 256 colors");
+	startIndexed(pbm, &palette);
+	if (!indices_fit(pbm, palette.size())) throw std::runtime_error("gif::Writer<T>::writeIndexed() index outside the palette");
+
+	mIndexedTable = palette;
+	mIndexedTable.clip();
+	// Frames that share the global table don't need their own.
+	const bool				local = !(mSettings.hasGlobalTable() && mIndexedTable.mColors == mSettings.mGlobalPalette.mColors);
+	writeIndexedImage(pbm, (local ? &mIndexedTable : nullptr), delay);
+}
+
+template <typename T>
+void WriterT<T>::writeIndexed(const PalettedBitmap &pbm, const double delay) {
+	startIndexed(pbm, nullptr);
+	if (!mSettings.hasGlobalTable()) throw std::runtime_error("gif::Writer<T>::writeIndexed() needs a palette, there's no global table");
+	if (!indices_fit(pbm, mSettings.mGlobalPalette.size())) throw std::runtime_error("gif::Writer<T>::writeIndexed() index outside the global table");
+	writeIndexedImage(pbm, nullptr, delay);
+}
+
+template <typename T>
+WriterT<T>& WriterT<T>::setMaxColors(const size_t v) {
+	if (v < 2 || v > 256) throw std::runtime_error("gif::Writer<T>::setMaxColors() must be 2 to 256");
+	mMaxColors = v;
+	mSettings.mMaxColors = v;
+	return *this;
+}
+
+template <typename T>
+WriterT<T>& WriterT<T>::setAsyncOutput(const bool v, const size_t buffer_size, const size_t buffer_count) {
+	if (!mNeedsHeader) throw std::runtime_error("gif::Writer<T>::setAsyncOutput() must be called before the first frame");
+	mAsyncOutput = v;
+	mAsyncBuffer.setBuffers(buffer_size, buffer_count);
+	return *this;
+}
+
+template <typename T>
+WriterT<T>& WriterT<T>::setTargetSize(const size_t bytes, const size_t frame_count) {
+	if (!mNeedsHeader) throw std::runtime_error("gif::Writer<T>::setTargetSize() must be called before the first frame");
+	mRate.setTarget(bytes, frame_count);
+	return *this;
+}
+
+template <typename T>
+WriterT<T>& WriterT<T>::setGlobalTable(const gif::Palette &palette) {
+	if (!mNeedsHeader) throw std::runtime_error("gif::Writer<T>::setGlobalTable() must be called before the first frame");
+	mSettings.setGlobalTable(palette);
+	mSettings.mTableMode = TableMode::kGlobalTableFromFirst;
+	return *this;
+}
+
+template <typename T>
+void WriterT<T>::finish() {
+	if (!mSpool.empty()) {
+		mSettings.makeGlobalTableFromAccumulated();
+		if (mRate.active()) mRate.setFrameCount(mSpool.size());
+		startFile();
+		try {
+			double			delay = 0.0;
+			mSpool.rewind();
+			while (mSpool.pop(mPixels, delay)) encodeFrame(gif::BitmapView(mPixels), delay);
+		} catch (std::exception const&) {
+			mSpool.end();
+			throw;
+		}
+		mSpool.end();
+	}
+	if (!isOpen()) return;
+
+	writePending();
+	// Ending trailer byte
+	mStream << static_cast<uint8_t>(0x3b);
+	// Closing waits for the I/O thread, if there is one.
+	const bool				closed = (mAsyncOutput ? mAsyncBuffer.close() : mFileBuffer.close() != nullptr);
+	if (mStream.fail() || !closed) throw std::runtime_error("gif::Writer<T>::finish() failed writing " + mPath);
+
+	// The estimates can still come out over the target, which is a hard limit.
+	if (mRate.active() && !mWritten.empty()) {
+		trim_to_size(mPath, mRate.target(), mWritten, mFrameStats);
+		mWritten.clear();
+	}
+}
+
+template <typename T>
+void WriterT<T>::startFile() {
+	const bool				opened = (mAsyncOutput	? mAsyncBuffer.open(mPath)
+													: mFileBuffer.open(mPath, std::ios::out | std::ios::binary) != nullptr);
+	if (!opened) throw std::runtime_error("gif::Writer<T> can't open " + mPath);
+	mStream.rdbuf(mAsyncOutput ? static_cast<std::streambuf*>(&mAsyncBuffer) : &mFileBuffer);
+	write_header(mSettings, mStream);
+}
+
+template <typename T>
+void WriterT<T>::encodeFrame(const gif::BitmapView &view, const double delay) {
+	mFrameStats.push_back(FrameStats());
+	mFrameStats.back().mDelay = delay;
+	if (mRate.active() && !mRate.keep() && mHasPending) {
+		// Show the previous frame for longer instead.
+		mPendingGce.mDelay += delay;
+		mFrameStats.back().mQuality = mLzwWriter.getQuality();
+		mFrameStats.back().mMaxColors = mSettings.mMaxColors;
+		mFrameStats.back().mDropped = true;
+		return;
+	}
+
+	if (!mSettings.mFrameDifferencing) {
+		writePending();
+		chooseRate(view.size());
+		// Write the image data
+		if (mSettings.hasLocalTable()) mSettings.makeLocalTable(view);
+		mSettings.prepareMatch();
+		if (!mSettings.convertExact(view, mPendingBitmap)) {
+			mSettings.mToPalettedBitmap->setOrigin(0, 0);
+			mSettings.mToPalettedBitmap->convert(view, mSettings.mToColorIndex, mPendingBitmap);
+		}
+		if (mPendingBitmap.empty()) throw std::runtime_error("gif::Writer<T>::writeFrame() failed to convert to paletted bitmap");
+		mPendingGce = GraphicControlExtension();
+		mPendingGce.mDelay = delay;
+		mPendingLeft = 0;
+		mPendingTop = 0;
+		mPendingStats = mFrameStats.size() - 1;
+		mHasPending = true;
+		if (!mRate.active()) writePending();
+		return;
+	}
+
+	// The frame is kept for comparing with the next one, so it has to be owned.
+	view.copyTo(mPixels);
+
+	// Only the area that changed from the previous frame is converted and written.
+	int32_t					left = 0, top = 0, right = mPixels.mWidth, bottom = mPixels.mHeight;
+	if (!mPreviousPixels.empty()) {
+		if (!find_changed_area(mPreviousPixels, mPixels, left, top, right, bottom)) {
+			// Identical to the previous frame, which stays on screen longer.
+			mPendingGce.mDelay += delay;
+			mFrameStats.back().mMerged = true;
+			return;
+		}
+	}
+	writePending();
+	chooseRate(static_cast<size_t>(right - left) * static_cast<size_t>(bottom - top));
+
+	// The area is read in place.
+	const gif::BitmapView	area(	mPixels.mPixels.data() + static_cast<size_t>(top) * mPixels.mWidth + left,
+									right - left, bottom - top, sizeof(gif::ColorA8u) * static_cast<size_t>(mPixels.mWidth));
+	if (mSettings.hasLocalTable()) mSettings.makeLocalTable(area);
+	mSettings.prepareMatch();
+	if (!mSettings.convertExact(area, mPendingBitmap)) {
+		mSettings.mToPalettedBitmap->setOrigin(left, top);
+		mSettings.mToPalettedBitmap->convert(area, mSettings.mToColorIndex, mPendingBitmap);
+	}
+	if (mPendingBitmap.empty()) throw std::runtime_error("gif::Writer<T>::writeFrame() failed to convert to paletted bitmap");
+	mPendingGce = GraphicControlExtension();
+	mPendingGce.mDelay = delay;
+	mPendingGce.mDisposal = GraphicControlExtension::Disposal::kDoNotDispose;
+	if (!mPreviousPixels.empty() && mSettings.mHasTransparentIndex) {
+		replace_unchanged(mPreviousPixels, mPixels, left, top, mSettings.mTransparentIndex, mPendingBitmap);
+		mPendingGce.mFlags |= GraphicControlExtension::TRANSPARENT_COLOR_F;
+		mPendingGce.mTransparencyIndex = mSettings.mTransparentIndex;
+	}
+	mPendingLeft = left;
+	mPendingTop = top;
+	mPendingStats = mFrameStats.size() - 1;
+	mHasPending = true;
+	std::swap(mPixels, mPreviousPixels);
+}
+
+template <typename T>
+void WriterT<T>::chooseRate(const size_t pixels) {
+	if (mRate.active()) {
+		mRate.choose(static_cast<size_t>(mStream.tellp()), pixels);
+		mSettings.mMaxColors = std::min(mMaxColors, mRate.maxColors());
+		mLzwWriter.setQuality(std::min(mQuality, mRate.quality()));
+	}
+	FrameStats&				stats = mFrameStats.back();
+	stats.mQuality = mLzwWriter.getQuality();
+	stats.mMaxColors = mSettings.mMaxColors;
+}
+
+template <typename T>
+size_t WriterT<T>::writeImage(	const GraphicControlExtension &gce, const int32_t left, const int32_t top, const PalettedBitmap &pbm,
+								const size_t stats, const gif::Palette *local_table) {
+	const std::streamoff	start = mStream.tellp();
+	// The extension is only needed if it carries any information.
+	const bool				has_gce = (gce.mDelay > 0.0 || gce.mFlags != 0 || gce.mDisposal != GraphicControlExtension::Disposal::kUnspecified);
+	if (has_gce) gce.write(mStream);
+	if (local_table) {
+		write_table_based_image(left, top, pbm, *local_table, true, *local_table, mSettings.mInterlaced, mLzwWriter, mBlockBuffer, mStream);
+	} else {
+		write_table_based_image(left, top, pbm, mSettings.currentTable(), mSettings.hasLocalTable(), mSettings.mMatchPalette,
+								mSettings.mInterlaced, mLzwWriter, mBlockBuffer, mStream);
+	}
+	if (mStream.fail()) throw std::runtime_error("gif::Writer<T> failed writing " + mPath);
+	const std::streamoff	end = mStream.tellp();
+	if (start < 0 || end < start) return 0;
+	if (mRate.active()) {
+		WrittenImage		w;
+		w.mStart = static_cast<size_t>(start);
+		w.mEnd = static_cast<size_t>(end);
+		w.mHasGce = has_gce;
+		w.mGce = gce;
+		w.mStats = stats;
+		mWritten.push_back(w);
+	}
+	return static_cast<size_t>(end - start);
+}
+
+template <typename T>
+void WriterT<T>::startIndexed(const PalettedBitmap &pbm, const gif::Palette *palette) {
+	if (pbm.empty() || pbm.mPixels.size() != static_cast<size_t>(pbm.mWidth) * static_cast<size_t>(pbm.mHeight)) {
+		throw std::runtime_error("gif::Writer<T>::writeIndexed() bitmap is empty");
+	}
+	if (mSettings.mTableMode == TableMode::kGlobalTableFromAll) {
+		throw std::runtime_error("gif::Writer<T>::writeIndexed() doesn't support kGlobalTableFromAll");
+	}
+	if (mNeedsHeader) {
+		mNeedsHeader = false;
+
+		mSettings.mWidth = pbm.mWidth;
+		mSettings.mHeight = pbm.mHeight;
+		if (mSettings.mWidth >= 1<<16 || mSettings.mHeight >= 1<<16) throw std::runtime_error("gif::Writer<T>::writeIndexed() image is too large");
+		if (mSettings.mTableMode == TableMode::kGlobalTableFromFirst && !mSettings.mGlobalTableSet && palette) {
+			mSettings.setGlobalTable(*palette);
+		}
+		startFile();
+	}
+	if (pbm.mWidth != mSettings.mWidth || pbm.mHeight != mSettings.mHeight) {
+		throw std::runtime_error("gif::Writer<T>::writeIndexed() frame size does not match the first frame");
+	}
+}
+
+template <typename T>
+void WriterT<T>::writeIndexedImage(const PalettedBitmap &pbm, const gif::Palette *local_table, const double delay) {
+	// Any pending frame goes first, and the next RGB frame can't be differenced against
+	// a frame it never saw, so it will be written whole.
+	writePending();
+	mPreviousPixels = gif::Bitmap();
+	// Indexed frames count towards rate control, but keep the client's quality.
+	if (mRate.active()) mRate.keep();
+	mLzwWriter.setQuality(mQuality);
+
+	GraphicControlExtension	gce;
+	gce.mDelay = delay;
+	FrameStats				stats;
+	stats.mDelay = delay;
+	stats.mMaxColors = (local_table ? local_table->size() : mSettings.currentTable().size());
+	stats.mBytes = writeImage(gce, 0, 0, pbm, mFrameStats.size(), local_table);
+	stats.mQuality = mLzwWriter.getQuality();
+	mFrameStats.push_back(stats);
+	if (mStream.fail()) throw std::runtime_error("gif::Writer<T>::writeIndexed() failed writing " + mPath);
+}
+
+template <typename T>
+void WriterT<T>::writePending() {
+	if (!mHasPending) return;
+	mHasPending = false;
+	const size_t			bytes = writeImage(mPendingGce, mPendingLeft, mPendingTop, mPendingBitmap, mPendingStats);
+	if (mPendingStats < mFrameStats.size()) mFrameStats[mPendingStats].mBytes = bytes;
+	if (mRate.active()) mRate.wrote(bytes);
+}
+
+/**
+ * @class gif::MultiWriterT IMPLEMENTATION
+ */
+template <typename T>
+MultiWriterT<T>::MultiWriterT(std::function<void(const T&, gif::Bitmap&)> convert_fn)
+		: mConvertFn(convert_fn) {
+}
+
+template <typename T>
+MultiWriterT<T>::~MultiWriterT() {
+	try {
+		finish();
+	} catch (std::exception const&) {
+	}
+}
+
+template <typename T>
+Writer& MultiWriterT<T>::addOutput(const std::string &path, const double scale) {
+	if (mStarted) throw std::runtime_error("gif::MultiWriter<T>::addOutput() must be called before the first frame");
+	if (!(scale > 0.0)) throw std::runtime_error("gif::MultiWriter<T>::addOutput() scale must be positive");
+	mOutputs.push_back(Output());
+	mOutputs.back().mWriter.reset(new Writer(path));
+	mOutputs.back().mScale = scale;
+	return *mOutputs.back().mWriter;
+}
+
+template <typename T>
+Writer& MultiWriterT<T>::getOutput(const size_t index) {
+	if (index >= mOutputs.size()) throw std::runtime_error("gif::MultiWriter<T>::getOutput() index out of range");
+	return *mOutputs[index].mWriter;
+}
+
+template <typename T>
+void MultiWriterT<T>::writeFrame(const T &t, const double delay) {
+	if (!mConvertFn) throw std::runtime_error("gif::MultiWriter<T>::writeFrame() has no convert function");
+	mConvertFn(t, mPixels);
+	if (mPixels.empty()) throw std::runtime_error("gif::MultiWriter<T>::writeFrame() conversion failed");
+	writeFrame(gif::BitmapView(mPixels), delay);
+}
+
+template <typename T>
+void MultiWriterT<T>::writeFrame(const gif::BitmapView &view, const double delay) {
+	if (view.empty()) throw std::runtime_error("gif::MultiWriter<T>::writeFrame() view is empty");
+	if (mOutputs.empty()) throw std::runtime_error("gif::MultiWriter<T>::writeFrame() has no outputs");
+	std::vector<size_t>		todo;
+	if (!mStarted) {
+		start(view);
+		scale(view);
+		// The largest output that builds its table from the first frame writes
+		// first, then the others take its table and matcher.
+		Writer*				source = nullptr;
+		for (const auto k : mOrder) {
+			Writer&			w(*mOutputs[k].mWriter);
+			if (!mShareTable || !canShare(w)) {
+				todo.push_back(k);
+			} else if (!source) {
+				source = &w;
+				w.writeFrame(mViews[k], delay);
+			} else {
+				if (w.mSettings.shareGlobalTable(source->mSettings.mMatchPalette) && !w.mSettings.mToColorIndex) {
+					w.mSettings.mToColorIndex = source->mSettings.mToColorIndex;
+					w.mSettings.prepareMatch();
+				}
+				todo.push_back(k);
+			}
+		}
+	} else {
+		scale(view);
+		todo = mOrder;
+	}
+
+	parallel_for(todo.size(), todo.size(), [this, &todo, delay](const size_t begin, const size_t end, const size_t) {
+		for (size_t k=begin; k<end; ++k) mOutputs[todo[k]].mWriter->writeFrame(mViews[todo[k]], delay);
+	});
+}
+
+template <typename T>
+void MultiWriterT<T>::finish() {
+	std::exception_ptr		error;
+	for (auto& o : mOutputs) {
+		try {
+			o.mWriter->finish();
+		} catch (...) {
+			if (!error) error = std::current_exception();
+		}
+	}
+	if (error) std::rethrow_exception(error);
+}
+
+template <typename T>
+void MultiWriterT<T>::start(const gif::BitmapView &view) {
+	mStarted = true;
+	mWidth = view.mWidth;
+	mHeight = view.mHeight;
+	for (auto& o : mOutputs) {
+		o.mWidth = std::max<int32_t>(1, static_cast<int32_t>(std::floor(view.mWidth * o.mScale + 0.5)));
+		o.mHeight = std::max<int32_t>(1, static_cast<int32_t>(std::floor(view.mHeight * o.mScale + 0.5)));
+		mOrder.push_back(mOrder.size());
+	}
+	std::stable_sort(mOrder.begin(), mOrder.end(), [this](const size_t a, const size_t b) { return mOutputs[a].mScale > mOutputs[b].mScale; });
+	mViews.resize(mOutputs.size());
+}
+
+template <typename T>
+void MultiWriterT<T>::scale(const gif::BitmapView &view) {
+	if (view.mWidth != mWidth || view.mHeight != mHeight) {
+		throw std::runtime_error("gif::MultiWriter<T>::writeFrame() frame size does not match the first frame");
+	}
+	// Shrinking starts from the input and continues from the last output shrunk,
+	// which is the smallest so far. Enlarging is always from the input.
+	const gif::BitmapView*	from = &view;
+	for (size_t i=0; i<mOrder.size(); ++i) {
+		Output&				o(mOutputs[mOrder[i]]);
+		gif::BitmapView&	v(mViews[mOrder[i]]);
+		if (o.mWidth == view.mWidth && o.mHeight == view.mHeight) {
+			v = view;
+		} else if (i > 0 && o.mWidth == mOutputs[mOrder[i-1]].mWidth && o.mHeight == mOutputs[mOrder[i-1]].mHeight) {
+			v = mViews[mOrder[i-1]];
+		} else {
+			resize_bitmap(o.mScale < 1.0 ? *from : view, o.mWidth, o.mHeight, o.mPixels);
+			v = gif::BitmapView(o.mPixels);
+		}
+		if (o.mScale <= 1.0) from = &v;
+	}
+}
+
+template <typename T>
+bool MultiWriterT<T>::canShare(const Writer &w) const {
+	return w.mNeedsHeader && w.mSettings.mTableMode == TableMode::kGlobalTableFromFirst && !w.mSettings.mGlobalTableSet;
+}
+
+} // namespace gif
+
+#endif
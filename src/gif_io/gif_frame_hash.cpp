@@ -0,0 +1,202 @@
+#include "gif_frame_hash.h"
+
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+
+namespace gif {
+
+namespace {
+// The luminance copy is GRID x GRID cells, each the mean of the same number
+// of samples: 1x1 or 2x2 of them, as the frame size allows.
+const int32_t		GRID(32);
+const int32_t		MAX_SAMPLES(64);
+// The pHash keeps the lowest DCT_SIZE x DCT_SIZE frequencies.
+const int32_t		DCT_SIZE(8);
+// The dHash compares DHASH_COLUMNS cells in each of DHASH_ROWS rows.
+const int32_t		DHASH_COLUMNS(9);
+const int32_t		DHASH_ROWS(8);
+// Frames without a delay still count for something in the signature.
+const double		MIN_WEIGHT(0.02);
+const double		PI(3.14159265358979323846);
+
+// Answer how many samples to take across a frame dimension: a multiple of
+// GRID, as many as there are pixels up to MAX_SAMPLES.
+int32_t				sample_count(const int32_t size) {
+	return std::min(MAX_SAMPLES, std::max(GRID, size / GRID * GRID));
+}
+
+// Answer the centers of count samples across size pixels, and their cells.
+void				sample_positions(const int32_t size, const int32_t count, std::vector<int32_t> &positions, std::vector<uint8_t> *cells) {
+	positions.resize(count);
+	if (cells) cells->resize(count);
+	for (int32_t k=0; k<count; ++k) {
+		positions[k] = static_cast<int32_t>((static_cast<int64_t>(2 * k + 1) * size) / (2 * count));
+		if (cells) (*cells)[k] = static_cast<uint8_t>(k * GRID / count);
+	}
+}
+
+uint64_t			bits_above(const float *values, const size_t count, const float threshold) {
+	uint64_t		bits = 0;
+	for (size_t k=0; k<count; ++k) {
+		if (values[k] > threshold) bits |= (1ULL<<k);
+	}
+	return bits;
+}
+
+}
+
+/**
+ * @class gif::FrameHasher
+ */
+FrameHasher::FrameHasher(gif::ListConstructor *next)
+		: mNext(next)
+		, mLuma(GRID * GRID, 0.0f)
+		, mCos(DCT_SIZE * GRID) {
+	for (int32_t k=0; k<DCT_SIZE; ++k) {
+		for (int32_t n=0; n<GRID; ++n) {
+			mCos[k * GRID + n] = static_cast<float>(std::cos(PI * (2 * n + 1) * k / (2.0 * GRID)));
+		}
+	}
+}
+
+void FrameHasher::clear() {
+	mHashes.clear();
+	mFrameCount = 0;
+}
+
+AnimationSignature FrameHasher::getSignature() const {
+	AnimationSignature		s;
+	if (mHashes.empty()) return s;
+	double					p[64] = { 0.0 },
+							d[64] = { 0.0 },
+							total = 0.0;
+	for (const auto& h : mHashes) {
+		const double		w = std::max(h.mDelay, MIN_WEIGHT);
+		total += w;
+		for (size_t b=0; b<64; ++b) {
+			if ((h.mPHash>>b) & 1) p[b] += w;
+			if ((h.mDHash>>b) & 1) d[b] += w;
+		}
+		s.mDuration += h.mDelay;
+	}
+	for (size_t b=0; b<64; ++b) {
+		if (p[b] * 2.0 > total) s.mPHash |= (1ULL<<b);
+		if (d[b] * 2.0 > total) s.mDHash |= (1ULL<<b);
+	}
+	s.mFrameCount = mHashes.size();
+	return s;
+}
+
+uint32_t FrameHasher::distance(const uint64_t a, const uint64_t b) {
+	return static_cast<uint32_t>(std::bitset<64>(a ^ b).count());
+}
+
+void FrameHasher::addFrame(const gif::Bitmap &bm, const double delay) {
+	const size_t			frame = mFrameCount++;
+	if (frame % mFrameStep == 0 && !bm.empty()) {
+		sample(bm);
+		FrameHash			h;
+		h.mFrame = frame;
+		h.mDelay = delay;
+		h.mPHash = pHash();
+		h.mDHash = dHash();
+		mHashes.push_back(h);
+	}
+	if (mNext) mNext->addFrame(bm, delay);
+}
+
+bool FrameHasher::wantsMoreFrames() const {
+	if (mMaxFrames > 0 && mFrameCount >= mMaxFrames) return false;
+	return !mNext || mNext->wantsMoreFrames();
+}
+
+void FrameHasher::readerFinished() {
+	if (mNext) mNext->readerFinished();
+}
+
+void FrameHasher::sample(const gif::Bitmap &bm) {
+	if (bm.mWidth != mSampledWidth || bm.mHeight != mSampledHeight) {
+		sample_positions(bm.mWidth, sample_count(bm.mWidth), mColumns, &mColumnCells);
+		sample_positions(bm.mHeight, sample_count(bm.mHeight), mRows, nullptr);
+		mSampledWidth = bm.mWidth;
+		mSampledHeight = bm.mHeight;
+	}
+	const int32_t			columns = static_cast<int32_t>(mColumns.size()),
+							rows = static_cast<int32_t>(mRows.size());
+	mSums.assign(GRID * GRID, 0);
+	for (int32_t j=0; j<rows; ++j) {
+		const gif::ColorA8u*	src = bm.mPixels.data() + static_cast<size_t>(mRows[j]) * bm.mWidth;
+		uint32_t*			sums = mSums.data() + (j * GRID / rows) * GRID;
+		for (int32_t i=0; i<columns; ++i) {
+			// BT.601 luma in 8.8 fixed point, with pixels never drawn counting as black.
+			const gif::ColorA8u&	c(src[mColumns[i]]);
+			sums[mColumnCells[i]] += ((77 * c.r + 150 * c.g + 29 * c.b) * c.a) >> 16;
+		}
+	}
+	const float				scale = 1.0f / static_cast<float>((columns / GRID) * (rows / GRID));
+	for (size_t k=0; k<mLuma.size(); ++k) mLuma[k] = static_cast<float>(mSums[k]) * scale;
+}
+
+uint64_t FrameHasher::pHash() const {
+	// A separable DCT, computing only the frequencies that are kept.
+	float					t[DCT_SIZE * GRID],
+							d[DCT_SIZE * DCT_SIZE];
+	// Down the columns first, a row at a time so the inner loop runs along memory.
+	std::fill(t, t + DCT_SIZE * GRID, 0.0f);
+	for (int32_t k=0; k<DCT_SIZE; ++k) {
+		float*				dst = t + k * GRID;
+		for (int32_t y=0; y<GRID; ++y) {
+			const float		c = mCos[k * GRID + y];
+			const float*	src = mLuma.data() + y * GRID;
+			for (int32_t x=0; x<GRID; ++x) dst[x] += c * src[x];
+		}
+	}
+	for (int32_t k=0; k<DCT_SIZE; ++k) {
+		for (int32_t l=0; l<DCT_SIZE; ++l) {
+			const float*	c = mCos.data() + l * GRID;
+			float			sum = 0.0f;
+			for (int32_t x=0; x<GRID; ++x) sum += t[k * GRID + x] * c[x];
+			d[k * DCT_SIZE + l] = sum;
+		}
+	}
+	float					sorted[DCT_SIZE * DCT_SIZE];
+	std::copy(d, d + DCT_SIZE * DCT_SIZE, sorted);
+	const size_t			half = DCT_SIZE * DCT_SIZE / 2;
+	std::nth_element(sorted, sorted + half, sorted + DCT_SIZE * DCT_SIZE);
+	const float				upper = sorted[half],
+							lower = *std::max_element(sorted, sorted + half);
+	return bits_above(d, DCT_SIZE * DCT_SIZE, (lower + upper) * 0.5f);
+}
+
+uint64_t FrameHasher::dHash() const {
+	// Each row of cells averages GRID / DHASH_ROWS rows of the copy. Columns
+	// don't divide evenly, so each cell weighs the copy's columns it overlaps.
+	const int32_t			band = GRID / DHASH_ROWS;
+	const float				width = static_cast<float>(GRID) / DHASH_COLUMNS;
+	uint64_t				bits = 0;
+	for (int32_t r=0; r<DHASH_ROWS; ++r) {
+		float				line[GRID];
+		for (int32_t x=0; x<GRID; ++x) {
+			float			sum = 0.0f;
+			for (int32_t y=r*band; y<(r+1)*band; ++y) sum += mLuma[y * GRID + x];
+			line[x] = sum;
+		}
+		float				cells[DHASH_COLUMNS];
+		for (int32_t c=0; c<DHASH_COLUMNS; ++c) {
+			const float		lo = c * width,
+							hi = (c + 1) * width;
+			float			sum = 0.0f;
+			for (int32_t x=static_cast<int32_t>(lo); x<GRID && x<hi; ++x) {
+				sum += line[x] * (std::min(hi, x + 1.0f) - std::max(lo, static_cast<float>(x)));
+			}
+			cells[c] = sum;
+		}
+		for (int32_t c=0; c<DHASH_COLUMNS-1; ++c) {
+			if (cells[c] < cells[c + 1]) bits |= (1ULL<<(r * (DHASH_COLUMNS - 1) + c));
+		}
+	}
+	return bits;
+}
+
+} // namespace gif
@@ -0,0 +1,108 @@
+#ifndef GIFIO_GIFFRAMEHASH_H_
+#define GIFIO_GIFFRAMEHASH_H_
+
+#include <cstdint>
+#include <vector>
+#include "gif_list.h"
+
+namespace gif {
+
+/**
+ * @class gif::FrameHash
+ * @brief Perceptual hashes of one frame. Similar looking frames have hashes
+ * a few bits apart, whatever their size, palette or encoding.
+ */
+class FrameHash {
+public:
+	FrameHash() { }
+
+	// The index of the frame in its file.
+	size_t					mFrame = 0;
+	double					mDelay = 0.0;
+	// DCT hash: the sign of the lowest 8x8 frequencies of a 32x32 luminance
+	// copy, against their median.
+	uint64_t				mPHash = 0;
+	// Difference hash: whether each of 9x8 luminance cells is darker than the
+	// one to its right.
+	uint64_t				mDHash = 0;
+};
+
+/**
+ * @class gif::AnimationSignature
+ * @brief The hashes of a whole animation: each bit is the one most of the
+ * hashed frames have, weighted by how long each is shown.
+ */
+class AnimationSignature {
+public:
+	AnimationSignature() { }
+
+	bool					empty() const { return mFrameCount < 1; }
+
+	uint64_t				mPHash = 0,
+							mDHash = 0;
+	// The frames hashed, and the time they cover.
+	size_t					mFrameCount = 0;
+	double					mDuration = 0.0;
+};
+
+/**
+ * @class gif::FrameHasher
+ * @brief A list stage that hashes each frame as the reader decodes it. Each
+ * frame is sampled into a 32x32 luminance copy, from at most 64x64 of its
+ * pixels however large it is, so the cost per frame stays small next to
+ * decoding it. Frames are passed on to the next constructor, if there is one,
+ * so a file can be hashed while it's loaded for something else.
+ */
+class FrameHasher : public gif::ListConstructor {
+public:
+	FrameHasher(gif::ListConstructor *next = nullptr);
+
+	// Hash every step-th frame, starting with the first. Default 1.
+	FrameHasher&			setFrameStep(const size_t v) { mFrameStep = (v < 1 ? 1 : v); return *this; }
+	// Stop the reader once this many frames are decoded, 0 (the default) to
+	// read them all. Animations tend to show what they are early on, so a few
+	// frames make a quick first pass over a large library.
+	FrameHasher&			setMaxFrames(const size_t v) { mMaxFrames = v; return *this; }
+
+	// Forget the hashes, to reuse me for another file.
+	void					clear();
+
+	const std::vector<FrameHash>&	getFrames() const { return mHashes; }
+	AnimationSignature		getSignature() const;
+
+	// Answer the number of bits that differ.
+	static uint32_t			distance(const uint64_t a, const uint64_t b);
+
+	void					addFrame(const gif::Bitmap&, const double delay) override;
+	bool					wantsImages() const override { return mNext && mNext->wantsImages(); }
+	void					addImage(const gif::IndexedImage &image) override { if (mNext) mNext->addImage(image); }
+	bool					wantsMoreFrames() const override;
+	void					readerFinished() override;
+
+private:
+	// Sample the frame into mLuma.
+	void					sample(const gif::Bitmap&);
+	uint64_t				pHash() const;
+	uint64_t				dHash() const;
+
+	gif::ListConstructor*	mNext;
+	size_t					mFrameStep = 1,
+							mMaxFrames = 0,
+							mFrameCount = 0;
+	std::vector<FrameHash>	mHashes;
+
+	// 32x32 mean luminance, and the DCT basis for its lowest 8 frequencies.
+	std::vector<float>		mLuma,
+							mCos;
+	// The columns, rows and cells of the last frame size sampled.
+	int32_t					mSampledWidth = -1,
+							mSampledHeight = -1;
+	std::vector<int32_t>	mColumns,
+							mRows;
+	std::vector<uint8_t>	mColumnCells;
+	std::vector<uint32_t>	mSums;
+};
+
+} // namespace gif
+
+#endif
@@ -1,76 +1,109 @@
-#ifndef GIFIO_GIFLIST_H_
-#define GIFIO_GIFLIST_H_
-
-#include <functional>
-#include "gif_bitmap.h"
-
-namespace gif {
-
-/**
- * @class gif::ListConstructor
- * @brief A stub class passed to the framework for constructing lists.
- */
-class ListConstructor {
-public:
-	ListConstructor() { }
-	virtual ~ListConstructor() { }
-
-	virtual void			addFrame(const gif::Bitmap&, const double delay) = 0;
-	// Called when the if reader is done reading frames, so
-	// any resources can be cleaned up.
-	virtual void			readerFinished() { }
-};
-
-/**
- * @class gif::GifList
- * @brief Templated class that defines a collection of image frames.
- * @description Clients will subclass and specialize to provide both a
- * local bitmap storage format as T as well as an allocator that translates
- * gif bitmaps into the local storage class.
- */
-template <typename T>
-class List : public gif::ListConstructor {
-public:
-	class Frame {
-	public:
-		Frame() { }
-
-		T							mBitmap;
-		double						mDelay = 0.0;
-	};
-
-public:
-	List(const std::function<T(const gif::Bitmap&)>& alloc = nullptr) : mAlloc(alloc) { }
-
-	bool							empty() const { return mFrames.empty(); }
-	size_t							size() const { return mFrames.size(); }
-
-	void							addFrame(const gif::Bitmap&, const double delay) override;
-	const Frame*					getFrame(const size_t index) const;
-
-protected:
-	std::function<T(const gif::Bitmap&)>
-									mAlloc;
-	std::vector<Frame>				mFrames;
-};
-
-/**
- * gif::List IMPLEMENTATION
- */
-template <typename T>
-void List<T>::addFrame(const gif::Bitmap &bm, const double delay) {
-	mFrames.push_back(Frame());
-	Frame&			f(mFrames.back());
-	if (mAlloc) f.mBitmap = mAlloc(bm);
-	f.mDelay = delay;
-}
-
-template <typename T>
-const typename List<T>::Frame* List<T>::getFrame(const size_t index) const {
-	if (index >= mFrames.size()) return nullptr;
-	return &mFrames[index];
-}
-
-} // namespace gif
-
-#endif
+#ifndef GIFIO_GIFLIST_H_
+#define GIFIO_GIFLIST_H_
+
+#include <functional>
+#include "gif_bitmap.h"
+
+namespace gif {
+
+/**
+ * @class gif::IndexedImage
+ * @brief One image as the file stores it, before it's drawn to the screen:
+ * its area of the screen, its color indices and the table they index.
+ * Everything points into the reader's memory, valid only during the call.
+ */
+class IndexedImage {
+public:
+	IndexedImage() { }
+
+	int32_t					mLeft = 0,
+							mTop = 0,
+							mWidth = 0,
+							mHeight = 0;
+	bool					mInterlaced = false;
+	// The indices in the order they were stored, so interlaced rows are in pass
+	// order. Normally mWidth * mHeight of them; fewer if the data ran short.
+	const uint8_t*			mIndexes = nullptr;
+	size_t					mIndexCount = 0;
+	const gif::ColorA8u*	mColors = nullptr;
+	size_t					mColorCount = 0;
+	// -1 if the image has no transparent index.
+	int32_t					mTransparentIndex = -1;
+	double					mDelay = 0.0;
+};
+
+/**
+ * @class gif::ListConstructor
+ * @brief A stub class passed to the framework for constructing lists.
+ */
+class ListConstructor {
+public:
+	ListConstructor() { }
+	virtual ~ListConstructor() { }
+
+	virtual void			addFrame(const gif::Bitmap&, const double delay) = 0;
+	// Answer true to also be given each image's color indices, just before the
+	// frame they're drawn into. Off by default, since the reader has to keep them.
+	virtual bool			wantsImages() const { return false; }
+	virtual void			addImage(const gif::IndexedImage&) { }
+	// Answer false to stop the reader after the current frame, i.e. once
+	// enough frames have been seen. Stopping early still counts as success.
+	virtual bool			wantsMoreFrames() const { return true; }
+	// Called when the if reader is done reading frames, so
+	// any resources can be cleaned up.
+	virtual void			readerFinished() { }
+};
+
+/**
+ * @class gif::GifList
+ * @brief Templated class that defines a collection of image frames.
+ * @description Clients will subclass and specialize to provide both a
+ * local bitmap storage format as T as well as an allocator that translates
+ * gif bitmaps into the local storage class.
+ */
+template <typename T>
+class List : public gif::ListConstructor {
+public:
+	class Frame {
+	public:
+		Frame() { }
+
+		T							mBitmap;
+		double						mDelay = 0.0;
+	};
+
+public:
+	List(const std::function<T(const gif::Bitmap&)>& alloc = nullptr) : mAlloc(alloc) { }
+
+	bool							empty() const { return mFrames.empty(); }
+	size_t							size() const { return mFrames.size(); }
+
+	void							addFrame(const gif::Bitmap&, const double delay) override;
+	const Frame*					getFrame(const size_t index) const;
+
+protected:
+	std::function<T(const gif::Bitmap&)>
+									mAlloc;
+	std::vector<Frame>				mFrames;
+};
+
+/**
+ * gif::List IMPLEMENTATION
+ */
+template <typename T>
+void List<T>::addFrame(const gif::Bitmap &bm, const double delay) {
+	mFrames.push_back(Frame());
+	Frame&			f(mFrames.back());
+	if (mAlloc) f.mBitmap = mAlloc(bm);
+	f.mDelay = delay;
+}
+
+template <typename T>
+const typename List<T>::Frame* List<T>::getFrame(const size_t index) const {
+	if (index >= mFrames.size()) return nullptr;
+	return &mFrames[index];
+}
+
+} // namespace gif
+
+#endif
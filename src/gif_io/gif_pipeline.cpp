@@ -0,0 +1,192 @@
+#include "gif_pipeline.h"
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include "gif_algorithm.h"
+#include "gif_file.h"
+#include "gif_list.h"
+
+namespace gif {
+
+namespace {
+
+class PipelineFrame {
+public:
+	PipelineFrame() { }
+
+	gif::Bitmap				mPixels;
+	double					mDelay = 0.0;
+};
+
+// Track how many frames are alive across the stages.
+class FrameCounter {
+public:
+	FrameCounter() { }
+
+	void					add() {
+		std::lock_guard<std::mutex>		lock(mMutex);
+		mPeak = std::max(mPeak, ++mCount);
+	}
+	void					remove() {
+		std::lock_guard<std::mutex>		lock(mMutex);
+		if (mCount > 0) --mCount;
+	}
+	size_t					peak() {
+		std::lock_guard<std::mutex>		lock(mMutex);
+		return mPeak;
+	}
+
+private:
+	std::mutex				mMutex;
+	size_t					mCount = 0,
+							mPeak = 0;
+};
+
+// Copy each decoded frame into the queue, waiting while it's full. Stop
+// the reader once the queue is closed.
+class QueueConstructor : public gif::ListConstructor {
+public:
+	QueueConstructor(BoundedQueue<PipelineFrame> &q, FrameCounter &c) : mQueue(q), mCounter(c) { }
+
+	void					addFrame(const gif::Bitmap &bm, const double delay) override {
+		if (mStopped) return;
+		mCounter.add();
+		PipelineFrame		f;
+		f.mPixels = bm;
+		f.mDelay = delay;
+		if (!mQueue.push(std::move(f))) {
+			mCounter.remove();
+			mStopped = true;
+		}
+	}
+	bool					wantsMoreFrames() const override { return !mStopped; }
+
+private:
+	BoundedQueue<PipelineFrame>&	mQueue;
+	FrameCounter&			mCounter;
+	bool					mStopped = false;
+};
+
+int32_t		scale_dimension(const int32_t v, const double scale) {
+	return std::max(1, static_cast<int32_t>(std::lround(static_cast<double>(v) * scale)));
+}
+
+}
+
+/**
+ * @class gif::ResizePipeline
+ */
+ResizePipeline& ResizePipeline::setSize(const int32_t width, const int32_t height) {
+	mWidth = std::max(0, width);
+	mHeight = std::max(0, height);
+	mScale = 0.0;
+	return *this;
+}
+
+ResizePipeline& ResizePipeline::setScale(const double v) {
+	mScale = std::max(0.0, v);
+	mWidth = mHeight = 0;
+	return *this;
+}
+
+void ResizePipeline::run(const std::string &input, const std::string &output) {
+	mFrameCount = mPeakFrames = 0;
+	mOutWidth = mOutHeight = 0;
+
+	BoundedQueue<PipelineFrame>	decoded(mQueueSize),
+							scaled(mQueueSize);
+	FrameCounter			counter;
+	bool					read_ok = false;
+	std::exception_ptr		scale_error,
+							error;
+
+	// Decode
+	std::thread				reader([&input, &decoded, &counter, &read_ok]() {
+		QueueConstructor	qc(decoded, counter);
+		read_ok = gif::Reader(input).read(qc);
+		decoded.close();
+	});
+
+	// Scale. The output size is fixed by the first frame, since every
+	// frame the reader produces is the full logical screen.
+	int32_t					out_w = 0,
+							out_h = 0;
+	std::thread				scaler([this, &decoded, &scaled, &counter, &scale_error, &out_w, &out_h]() {
+		try {
+			PipelineFrame	in;
+			while (decoded.pop(in)) {
+				if (out_w < 1) outputSize(in.mPixels.mWidth, in.mPixels.mHeight, out_w, out_h);
+				PipelineFrame	out;
+				if (out_w == in.mPixels.mWidth && out_h == in.mPixels.mHeight) {
+					out = std::move(in);
+				} else {
+					counter.add();
+					resize_bitmap(gif::BitmapView(in.mPixels), out_w, out_h, out.mPixels);
+					out.mDelay = in.mDelay;
+					in = PipelineFrame();
+					counter.remove();
+				}
+				if (!scaled.push(std::move(out))) break;
+			}
+		} catch (std::exception const&) {
+			scale_error = std::current_exception();
+		}
+		// Unblock the reader if I stopped early.
+		decoded.close();
+		scaled.close();
+	});
+
+	// Encode
+	try {
+		gif::Writer			writer(output);
+		if (mConfigure) mConfigure(writer);
+		PipelineFrame		f;
+		while (scaled.pop(f)) {
+			writer.writeFrame(f.mPixels, f.mDelay);
+			f = PipelineFrame();
+			counter.remove();
+			++mFrameCount;
+		}
+		reader.join();
+		scaler.join();
+		if (scale_error) std::rethrow_exception(scale_error);
+		if (!read_ok) throw std::runtime_error("gif::ResizePipeline::run() can't read " + input);
+		writer.finish();
+	} catch (std::exception const&) {
+		error = std::current_exception();
+	}
+	decoded.close();
+	scaled.close();
+	if (reader.joinable()) reader.join();
+	if (scaler.joinable()) scaler.join();
+
+	mOutWidth = out_w;
+	mOutHeight = out_h;
+	mPeakFrames = counter.peak();
+	if (error) std::rethrow_exception(error);
+}
+
+void ResizePipeline::outputSize(const int32_t w, const int32_t h, int32_t &out_w, int32_t &out_h) const {
+	if (mScale > 0.0) {
+		out_w = scale_dimension(w, mScale);
+		out_h = scale_dimension(h, mScale);
+	} else if (mWidth > 0 && mHeight > 0) {
+		out_w = mWidth;
+		out_h = mHeight;
+	} else if (mWidth > 0) {
+		out_w = mWidth;
+		out_h = scale_dimension(h, static_cast<double>(mWidth) / static_cast<double>(std::max(1, w)));
+	} else if (mHeight > 0) {
+		out_w = scale_dimension(w, static_cast<double>(mHeight) / static_cast<double>(std::max(1, h)));
+		out_h = mHeight;
+	} else {
+		out_w = w;
+		out_h = h;
+	}
+}
+
+} // namespace gif
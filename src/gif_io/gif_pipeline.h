@@ -0,0 +1,126 @@
+#ifndef GIFIO_GIFPIPELINE_H_
+#define GIFIO_GIFPIPELINE_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include "gif_bitmap.h"
+
+namespace gif {
+class Writer;
+
+/**
+ * @class gif::BoundedQueue
+ * @brief A queue that blocks producers while it's full and consumers while
+ * it's empty, to pass items between threads with a fixed number in flight.
+ * Closing it wakes everyone: pushes fail, and pops drain what's left.
+ */
+template <typename T>
+class BoundedQueue {
+public:
+	BoundedQueue(const size_t capacity) : mCapacity(capacity < 1 ? 1 : capacity) { }
+
+	// Answer false if the queue was closed, in which case the item is dropped.
+	bool					push(T&&);
+	// Answer false once the queue is closed and empty.
+	bool					pop(T&);
+	void					close();
+
+private:
+	std::mutex				mMutex;
+	std::condition_variable	mNotFull,
+							mNotEmpty;
+	std::deque<T>			mItems;
+	const size_t			mCapacity;
+	bool					mClosed = false;
+};
+
+/**
+ * @class gif::ResizePipeline
+ * @brief Resize a GIF file into a new one in a single streaming pass. Frames
+ * are decoded on one thread, scaled on another and encoded on the calling
+ * thread, with bounded queues between them, so the three overlap and only a
+ * fixed number of frames is ever in memory, however long the animation. (The
+ * reader still loads the compressed input in one piece.)
+ */
+class ResizePipeline {
+public:
+	ResizePipeline() { }
+
+	// The output size. Leave either at 0 to keep the aspect ratio from the other,
+	// or both to keep the input size. Clears any scale.
+	ResizePipeline&			setSize(const int32_t width, const int32_t height);
+	// Or scale the input size, rounded to at least 1 pixel. Clears any size.
+	ResizePipeline&			setScale(const double);
+	// The frames each queue holds before its producer waits, at least 1. Default 2.
+	// At most 2 * size + 4 frames exist at once: the queues, the one the reader
+	// is waiting to push, the scaler's input and output, and the one being written.
+	ResizePipeline&			setQueueSize(const size_t v) { mQueueSize = v; return *this; }
+	// Called with the writer before the first frame, to set its table mode,
+	// effort and so on.
+	ResizePipeline&			setConfigure(const std::function<void(gif::Writer&)> &fn) { mConfigure = fn; return *this; }
+
+	// Resize input into output. Throw on error, after stopping every stage.
+	void					run(const std::string &input, const std::string &output);
+
+	// From the last run.
+	size_t					getFrameCount() const { return mFrameCount; }
+	int32_t					getWidth() const { return mOutWidth; }
+	int32_t					getHeight() const { return mOutHeight; }
+	// The most frames that existed at once, decoded or scaled.
+	size_t					getPeakFrames() const { return mPeakFrames; }
+
+private:
+	// Answer the output size for an input size.
+	void					outputSize(const int32_t w, const int32_t h, int32_t &out_w, int32_t &out_h) const;
+
+	int32_t					mWidth = 0,
+							mHeight = 0;
+	double					mScale = 0.0;
+	size_t					mQueueSize = 2;
+	std::function<void(gif::Writer&)>
+							mConfigure;
+	size_t					mFrameCount = 0,
+							mPeakFrames = 0;
+	int32_t					mOutWidth = 0,
+							mOutHeight = 0;
+};
+
+/**
+ * @class gif::BoundedQueue IMPLEMENTATION
+ */
+template <typename T>
+bool BoundedQueue<T>::push(T &&item) {
+	std::unique_lock<std::mutex>	lock(mMutex);
+	mNotFull.wait(lock, [this]() { return mClosed || mItems.size() < mCapacity; });
+	if (mClosed) return false;
+	mItems.push_back(std::move(item));
+	mNotEmpty.notify_one();
+	return true;
+}
+
+template <typename T>
+bool BoundedQueue<T>::pop(T &item) {
+	std::unique_lock<std::mutex>	lock(mMutex);
+	mNotEmpty.wait(lock, [this]() { return mClosed || !mItems.empty(); });
+	if (mItems.empty()) return false;
+	item = std::move(mItems.front());
+	mItems.pop_front();
+	mNotFull.notify_one();
+	return true;
+}
+
+template <typename T>
+void BoundedQueue<T>::close() {
+	std::lock_guard<std::mutex>		lock(mMutex);
+	mClosed = true;
+	mNotFull.notify_all();
+	mNotEmpty.notify_all();
+}
+
+} // namespace gif
+
+#endif
@@ -0,0 +1,220 @@
+#include "gif_video.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GIFIO_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace gif {
+
+namespace {
+
+// BT.601 limited range, in 8 bit fixed point. Chroma is computed from
+// the sum of 2x2 pixels, so it has two more bits to shift out.
+const int32_t		Y_R(66), Y_G(129), Y_B(25);
+const int32_t		U_R(-38), U_G(-74), U_B(112);
+const int32_t		V_R(112), V_G(-94), V_B(-18);
+
+inline const gif::ColorA8u&	opaque(const gif::ColorA8u &c, const gif::ColorA8u &background) {
+	return c.a == 0 ? background : c;
+}
+
+inline uint8_t		luma(const gif::ColorA8u &c) {
+	return static_cast<uint8_t>(((Y_R * c.r + Y_G * c.g + Y_B * c.b + 128) >> 8) + 16);
+}
+
+inline uint8_t		chroma(const int32_t r, const int32_t g, const int32_t b, const int32_t cr, const int32_t cg, const int32_t cb) {
+	return static_cast<uint8_t>(((cr * r + cg * g + cb * b + 512) >> 10) + 128);
+}
+
+#if defined(GIFIO_SSE2)
+// Replace the transparent pixels of 4 with the background.
+inline __m128i		opaque4(const __m128i c, const __m128i background) {
+	const __m128i	clear = _mm_cmpeq_epi32(_mm_srli_epi32(c, 24), _mm_setzero_si128());
+	return _mm_or_si128(_mm_andnot_si128(clear, c), _mm_and_si128(clear, background));
+}
+
+// Given the products of _mm_madd_epi16() for 4 items as [a0 b0 a1 b1] and
+// [a2 b2 a3 b3], answer each item's total.
+inline __m128i		sum_pairs(const __m128i p, const __m128i q) {
+	const __m128i	ps = _mm_shuffle_epi32(p, _MM_SHUFFLE(3, 1, 2, 0));
+	const __m128i	qs = _mm_shuffle_epi32(q, _MM_SHUFFLE(3, 1, 2, 0));
+	return _mm_add_epi32(_mm_unpacklo_epi64(ps, qs), _mm_unpackhi_epi64(ps, qs));
+}
+
+// The luma of 4 pixels as 32 bit values.
+inline __m128i		luma4(const __m128i c, const __m128i coef) {
+	const __m128i	zero = _mm_setzero_si128();
+	const __m128i	y = sum_pairs(	_mm_madd_epi16(_mm_unpacklo_epi8(c, zero), coef),
+									_mm_madd_epi16(_mm_unpackhi_epi8(c, zero), coef));
+	return _mm_add_epi32(_mm_srli_epi32(_mm_add_epi32(y, _mm_set1_epi32(128)), 8), _mm_set1_epi32(16));
+}
+
+// Sum the 2x2 blocks of 4 pixels over 2 rows into 16 bit RGBA, [block 0, block 1].
+inline __m128i		sum_blocks(const __m128i top, const __m128i bottom) {
+	const __m128i	zero = _mm_setzero_si128();
+	__m128i			lo = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+	__m128i			hi = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+	lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+	hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+	return _mm_unpacklo_epi64(lo, hi);
+}
+
+// The chroma of 4 blocks as 32 bit values.
+inline __m128i		chroma4(const __m128i b0, const __m128i b1, const __m128i coef) {
+	const __m128i	c = sum_pairs(_mm_madd_epi16(b0, coef), _mm_madd_epi16(b1, coef));
+	return _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(c, _mm_set1_epi32(512)), 10), _mm_set1_epi32(128));
+}
+#endif
+
+}
+
+void to_i420(const gif::Bitmap &bm, const gif::ColorA8u &background, std::vector<uint8_t> &out) {
+	const int32_t			w = std::max(0, bm.mWidth),
+							h = std::max(0, bm.mHeight);
+	const int32_t			cw = (w + 1) / 2,
+							ch = (h + 1) / 2;
+	const size_t			y_size = static_cast<size_t>(w) * static_cast<size_t>(h),
+							c_size = static_cast<size_t>(cw) * static_cast<size_t>(ch);
+	out.resize(y_size + c_size * 2);
+	if (y_size < 1) return;
+
+	uint8_t*				y_plane = out.data();
+	uint8_t*				u_plane = y_plane + y_size;
+	uint8_t*				v_plane = u_plane + c_size;
+	const gif::ColorA8u		bg(background.r, background.g, background.b, 255);
+#if defined(GIFIO_SSE2)
+	uint32_t				bg_bits;
+	std::memcpy(&bg_bits, &bg, sizeof(bg_bits));
+	const __m128i			bg4 = _mm_set1_epi32(static_cast<int32_t>(bg_bits));
+	const __m128i			y_coef = _mm_setr_epi16(Y_R, Y_G, Y_B, 0, Y_R, Y_G, Y_B, 0);
+	const __m128i			u_coef = _mm_setr_epi16(U_R, U_G, U_B, 0, U_R, U_G, U_B, 0);
+	const __m128i			v_coef = _mm_setr_epi16(V_R, V_G, V_B, 0, V_R, V_G, V_B, 0);
+#endif
+
+	for (int32_t y=0; y<h; y+=2) {
+		// An odd last row pairs with itself.
+		const bool			has_bottom = y + 1 < h;
+		const gif::ColorA8u*	top = bm.mPixels.data() + static_cast<size_t>(y) * w;
+		const gif::ColorA8u*	bottom = has_bottom ? top + w : top;
+		uint8_t*			y_top = y_plane + static_cast<size_t>(y) * w;
+		uint8_t*			y_bottom = y_top + w;
+		uint8_t*			u_row = u_plane + static_cast<size_t>(y / 2) * cw;
+		uint8_t*			v_row = v_plane + static_cast<size_t>(y / 2) * cw;
+		int32_t				x = 0;
+#if defined(GIFIO_SSE2)
+		// 8 pixels from each row, 4 chroma samples.
+		for (; x + 8 <= w; x += 8) {
+			const __m128i	t0 = opaque4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(top + x)), bg4);
+			const __m128i	t1 = opaque4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(top + x + 4)), bg4);
+			const __m128i	b0 = opaque4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + x)), bg4);
+			const __m128i	b1 = opaque4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + x + 4)), bg4);
+
+			const __m128i	yt = _mm_packs_epi32(luma4(t0, y_coef), luma4(t1, y_coef));
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(y_top + x), _mm_packus_epi16(yt, yt));
+			if (has_bottom) {
+				const __m128i	yb = _mm_packs_epi32(luma4(b0, y_coef), luma4(b1, y_coef));
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(y_bottom + x), _mm_packus_epi16(yb, yb));
+			}
+
+			const __m128i	s0 = sum_blocks(t0, b0),
+							s1 = sum_blocks(t1, b1);
+			const __m128i	uv = _mm_packs_epi32(chroma4(s0, s1, u_coef), chroma4(s0, s1, v_coef));
+			const __m128i	uv8 = _mm_packus_epi16(uv, uv);
+			const uint32_t	u4 = static_cast<uint32_t>(_mm_cvtsi128_si32(uv8)),
+							v4 = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(uv8, 4)));
+			std::memcpy(u_row + x / 2, &u4, 4);
+			std::memcpy(v_row + x / 2, &v4, 4);
+		}
+#endif
+		for (; x < w; x += 2) {
+			// An odd last column pairs with itself.
+			const int32_t		x1 = std::min(x + 1, w - 1);
+			const gif::ColorA8u	&c00 = opaque(top[x], bg), &c01 = opaque(top[x1], bg),
+								&c10 = opaque(bottom[x], bg), &c11 = opaque(bottom[x1], bg);
+			y_top[x] = luma(c00);
+			if (x1 > x) y_top[x1] = luma(c01);
+			if (has_bottom) {
+				y_bottom[x] = luma(c10);
+				if (x1 > x) y_bottom[x1] = luma(c11);
+			}
+			const int32_t		r = c00.r + c01.r + c10.r + c11.r,
+								g = c00.g + c01.g + c10.g + c11.g,
+								b = c00.b + c01.b + c10.b + c11.b;
+			u_row[x / 2] = chroma(r, g, b, U_R, U_G, U_B);
+			v_row[x / 2] = chroma(r, g, b, V_R, V_G, V_B);
+		}
+	}
+}
+
+/**
+ * @class gif::VideoExporter
+ */
+VideoExporter::VideoExporter(std::FILE *file, const Format format)
+		: mFile(file)
+		, mFormat(format) {
+	if (!mFile) throw std::runtime_error("gif::VideoExporter() no file");
+}
+
+VideoExporter& VideoExporter::setFrameRate(const uint32_t numerator, const uint32_t denominator) {
+	if (numerator < 1 || denominator < 1) throw std::runtime_error("gif::VideoExporter::setFrameRate() invalid rate");
+	mRateNum = numerator;
+	mRateDen = denominator;
+	return *this;
+}
+
+void VideoExporter::addFrame(const gif::Bitmap &bm, const double delay) {
+	if (bm.empty()) return;
+	if (mInputCount == 0) {
+		mWidth = bm.mWidth;
+		mHeight = bm.mHeight;
+		if (mFormat == Format::kY4m) {
+			const std::string	header = "YUV4MPEG2 W" + std::to_string(mWidth) + " H" + std::to_string(mHeight)
+										+ " F" + std::to_string(mRateNum) + ":" + std::to_string(mRateDen)
+										+ " Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n";
+			write(header.data(), header.size());
+		}
+	} else if (bm.mWidth != mWidth || bm.mHeight != mHeight) {
+		throw std::runtime_error("gif::VideoExporter::addFrame() frame size changed");
+	}
+	++mInputCount;
+
+	// The frame is on screen from the current time until its delay has passed,
+	// and shows in every output frame that starts in that span.
+	int64_t					hundredths = std::llround(delay * 100.0);
+	if (hundredths <= 1) hundredths = std::max<int64_t>(0, std::llround(mMinimumDelay * 100.0));
+	const uint64_t			scale = 100 * static_cast<uint64_t>(mRateDen);
+	const uint64_t			begin = (mTime * mRateNum + scale - 1) / scale;
+	mTime += static_cast<uint64_t>(hundredths);
+	const uint64_t			end = (mTime * mRateNum + scale - 1) / scale;
+	if (end <= begin) return;
+
+	const void*				data = bm.mPixels.data();
+	size_t					size = bm.mPixels.size() * sizeof(gif::ColorA8u);
+	if (mFormat == Format::kY4m) {
+		to_i420(bm, mBackground, mFrame);
+		data = mFrame.data();
+		size = mFrame.size();
+	}
+	for (uint64_t k=begin; k<end; ++k) {
+		if (mFormat == Format::kY4m) write("FRAME\n", 6);
+		write(data, size);
+		++mOutputCount;
+	}
+}
+
+void VideoExporter::readerFinished() {
+	if (std::fflush(mFile) != 0) throw std::runtime_error("gif::VideoExporter::readerFinished() failed writing");
+}
+
+void VideoExporter::write(const void *data, const size_t size) {
+	if (std::fwrite(data, 1, size, mFile) != size) throw std::runtime_error("gif::VideoExporter failed writing");
+}
+
+} // namespace gif
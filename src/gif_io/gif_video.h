@@ -0,0 +1,70 @@
+#ifndef GIFIO_GIFVIDEO_H_
+#define GIFIO_GIFVIDEO_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "gif_bitmap.h"
+#include "gif_list.h"
+
+namespace gif {
+
+// Convert to 8 bit planar YUV 4:2:0 (I420) with BT.601 limited range: the Y
+// plane, then U and V at half size, rounded up. Each chroma sample averages
+// the 2x2 pixels it covers. Transparent pixels take the background color.
+void		to_i420(const gif::Bitmap&, const gif::ColorA8u &background, std::vector<uint8_t> &out);
+
+/**
+ * @class gif::VideoExporter
+ * @brief Stream frames from a Reader to a file, such as stdout piped into
+ * ffmpeg, as YUV4MPEG2 or raw RGBA video.
+ * @description GIF delays vary per frame, so frames are repeated or dropped
+ * to fill a constant frame rate: each output frame shows whichever GIF frame
+ * is on screen at its time. Dropped frames aren't converted. Only one frame
+ * is held, so memory stays constant however long the animation is.
+ */
+class VideoExporter : public gif::ListConstructor {
+public:
+	// kY4m -- a YUV4MPEG2 stream of I420 frames, with the size and rate in its header.
+	// kRgba -- raw RGBA frames with no header; the reader needs the size and rate.
+	enum class Format { kY4m, kRgba };
+
+	// The file must be open for binary writing, and is not closed.
+	VideoExporter(std::FILE*, const Format = Format::kY4m);
+
+	// The output rate as a fraction, i.e. 30000/1001. Default 25/1. Set before the first frame.
+	VideoExporter&			setFrameRate(const uint32_t numerator, const uint32_t denominator = 1);
+	// Shown in place of transparent pixels in Y4M output. Default black.
+	VideoExporter&			setBackground(const gif::ColorA8u &c) { mBackground = c; return *this; }
+	// Delays of 0.01 seconds or less are shown for this long, as browsers do. Default 0.1.
+	VideoExporter&			setMinimumDelay(const double v) { mMinimumDelay = v; return *this; }
+
+	// Throw on a write error, which stops the reader.
+	void					addFrame(const gif::Bitmap&, const double delay) override;
+	void					readerFinished() override;
+
+	// GIF frames received, and video frames written.
+	size_t					getInputCount() const { return mInputCount; }
+	size_t					getOutputCount() const { return mOutputCount; }
+
+private:
+	void					write(const void*, const size_t);
+
+	std::FILE*				mFile;
+	const Format			mFormat;
+	uint32_t				mRateNum = 25,
+							mRateDen = 1;
+	gif::ColorA8u			mBackground = gif::ColorA8u(0, 0, 0);
+	double					mMinimumDelay = 0.1;
+	int32_t					mWidth = 0,
+							mHeight = 0;
+	// Time so far in hundredths of a second, the unit GIF delays are stored in.
+	uint64_t				mTime = 0;
+	size_t					mInputCount = 0,
+							mOutputCount = 0;
+	std::vector<uint8_t>	mFrame;
+};
+
+} // namespace gif
+
+#endif
@@ -1,186 +1,289 @@
-#include "lzw_writer.h"
-
-#include <iostream>
-#include <unordered_map>
-
-namespace gif {
-
-namespace {
-const uint32_t		MAX_CODE = (1<<12) - 1;
-const uint32_t		INVALID_CODE = static_cast<uint32_t>((static_cast<uint64_t>(1)<<32)-1);
-// There are 1<<12 possible codes, which is an upper bound on the number of
-// valid hash table entries at any given point in time. tableSize is 4x that.
-const uint32_t		TABLE_SIZE = 4 * (1<<12);
-const uint32_t		TABLE_MASK = TABLE_SIZE - 1;
-const uint32_t		INVALID_ENTRY = 0;
-
-inline uint32_t		safeTableValue(const uint32_t key, const std::unordered_map<uint32_t, uint32_t> &table) {
-	auto			found = table.find(key);
-	if (found == table.end()) return INVALID_ENTRY;
-	return found->second;
-}
-
-}
-
-/**
- * @class gif::LzwWriter
- */
-void LzwWriter::begin(	const uint8_t code_size,
-						const std::function<void(const std::vector<uint8_t>&)> &flush_fn) {
-	mFlushFn = flush_fn;
-	mWidth = 1 + static_cast<uint32_t>(code_size);
-	mCodeSize = code_size;
-	mHi = (1<<mCodeSize) + 1;
-	mOverflow = 1<<(mCodeSize+1);
-	mSavedCode = INVALID_CODE;
-	mTable.clear();
-
-	// Write initial clear code
-	writeCodeLsb(clearCode());
-}
-
-void LzwWriter::encode(const std::vector<uint8_t> &bm) {
-	if (bm.empty()) return;
-
-	uint32_t			code = mSavedCode;
-	auto				bm_it = bm.begin(), end_it = bm.end();
-	if (code == INVALID_CODE) {
-		// The first code is always a literal code
-		code = *bm_it;
-		++bm_it;
-	}
-	while (bm_it != end_it) {
-		uint32_t		literal = *bm_it;
-		uint32_t		key = (code<<8) | literal;
-
-		// If there is a hash table hit for this key then we continue the loop
-		// and do not emit a code yet.
-		uint32_t		hash = (key>>12 ^ key) & TABLE_MASK;
-		{
-			uint32_t	h = hash, t = safeTableValue(hash, mTable);
-			while (t != INVALID_ENTRY) {
-				if (key == t>>12) {
-					code = t&MAX_CODE;
-					goto endloop;
-				}
-				h = (h+1)&TABLE_MASK;
-				t = safeTableValue(h, mTable);
-			}
-		}
-
-		// Otherwise, write the current code, and literal becomes the start of
-		// the next emitted code.
-		writeCodeLsb(code);
-
-		code = literal;
-		// Increment e.hi, the next implied code. If we run out of codes, reset
-		// the encoder state (including clearing the hash table) and continue.
-		const IncError		ierr = incHi();
-		if (ierr != IncError::kNone) {
-			if (ierr == IncError::kOutOfCodes) {
-				goto endloop;
-			}
-			return; // error
-		}
-
-		// Otherwise, insert key -> e.hi into the map that e.table represents.
-		while (true) {
-			if (safeTableValue(hash, mTable) == INVALID_ENTRY) {
-				mTable[hash] = (key << 12) | mHi;
-				break;
-			}
-			hash = (hash + 1) & TABLE_MASK;
-		}
-
-endloop:
-		++bm_it;
-	}
-	mSavedCode = code;
-	close();
-}
-
-void LzwWriter::close() {
-	if (mSavedCode != INVALID_CODE) {
-		writeCodeLsb(mSavedCode);
-	}
-	// Write the eof code.
-	const uint32_t	eof = (static_cast<uint32_t>(1)<<mCodeSize) + 1;
-	writeCodeLsb(eof);
-
-	// Write the final bits.
-	if (mNBits > 0 && mFlushFn) {
-		mOutput.clear();
-		mOutput.push_back(static_cast<uint8_t>(mBits));
-		mFlushFn(mOutput);
-	}
-}
-
-void LzwWriter::writeCodeLsb(const uint32_t code) {
-	mBits |= code << mNBits;
-	mNBits += mWidth;
-	while (mNBits >= 8) {
-		if (mFlushFn) {
-			mOutput.clear();
-			mOutput.push_back(static_cast<uint8_t>(mBits));
-			mFlushFn(mOutput);
-		}
-
-		mBits >>= 8;
-		mNBits -= 8;
-	}
-}
-
-LzwWriter::IncError LzwWriter::incHi() {
-	++mHi;
-	if (mHi == mOverflow) {
-		++mWidth;
-		mOverflow <<= 1;
-	}
-	if (mHi == MAX_CODE) {
-		const uint32_t		clear = clearCode();
-		writeCodeLsb(clear);
-
-		mWidth = mCodeSize + 1;
-		mHi = clear + 1;
-		mOverflow = clear << 1;
-		for (auto& kv : mTable) kv.second = INVALID_ENTRY;
-		return IncError::kOutOfCodes;
-	}
-	return IncError::kNone;
-}
-
-/**
- * @class gif::WriterBuffer
- */
-void WriterBuffer::write(const std::vector<uint8_t> &data) {
-	// Append to my current data
-	if (!data.empty()) {
-		mBuffer.reserve(mBuffer.size() + data.size());
-		mBuffer.insert(mBuffer.end(), data.begin(), data.end());
-	}
-	writeFullBlocks();
-}
-
-void WriterBuffer::terminate() {
-	writeFullBlocks();
-	if (!mBuffer.empty()) {
-		writeBlock(mBuffer.size());
-	}
-	mStream << static_cast<uint8_t>(0);
-}
-
-void WriterBuffer::writeFullBlocks() {
-	while (mBuffer.size() >= mBlockSize) {
-		writeBlock(mBlockSize);
-	}
-}
-
-void WriterBuffer::writeBlock(const size_t size) {
-	if (mBuffer.size() < size) return; // error
-
-	mStream << static_cast<uint8_t>(size);
-	mStream.write((const char*)mBuffer.data(), size);
-	mBuffer.erase(mBuffer.begin(), mBuffer.begin()+size);
-}
-
-} // namespace gif
+#include "lzw_writer.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+namespace gif {
+
+namespace {
+const uint32_t		MAX_CODE = (1<<12) - 1;
+// There are 1<<12 possible codes, which is an upper bound on the number of
+// valid hash table entries at any given point in time. tableSize is 4x that.
+const uint32_t		TABLE_SIZE = 4 * (1<<12);
+const uint32_t		TABLE_MASK = TABLE_SIZE - 1;
+const uint32_t		INVALID_ENTRY = 0;
+// Pixels between compression ratio checks once the table is full.
+const size_t		RATIO_WINDOW(4096);
+// A full table matching fewer pixels than this per 12-bit code is barely
+// helping, so a fresh one is always worth a try.
+const double		MIN_FULL_RATIO(2.0 / 12.0);
+// Reset thresholds, as a fraction of the best ratio seen on a full table.
+const float			BALANCED_DROP(0.9f);
+const float			BEST_DROPS[] = { 0.95f, 0.9f, 0.8f };
+// Interlaced images are written in four passes, each starting at a row and
+// stepping down the image.
+const uint32_t		INTERLACE_START[] = { 0, 4, 2, 1 };
+const uint32_t		INTERLACE_STEP[] = { 8, 8, 4, 2 };
+// Lossy matches accept a summed RGB difference of up to this much per
+// quality step below 100.
+const uint32_t		ERROR_PER_QUALITY(3);
+
+}
+
+/**
+ * @class gif::LzwWriter
+ */
+void LzwWriter::setQuality(const uint32_t quality) {
+	mQuality = std::min<uint32_t>(quality, 100);
+}
+
+void LzwWriter::begin(	const uint8_t code_size,
+						const std::function<void(const std::vector<uint8_t>&)> &flush_fn,
+						const std::vector<gif::ColorA8u> *colors) {
+	mFlushFn = flush_fn;
+	mCodeSize = code_size;
+
+	mLossy = (colors && !colors->empty() && mQuality < 100);
+	if (!mLossy) return;
+	mThreshold = static_cast<int32_t>((100 - mQuality) * ERROR_PER_QUALITY);
+	mColors.assign(colors->begin(), colors->begin() + std::min<size_t>(colors->size(), 256));
+	mFirstChild.resize(MAX_CODE + 1);
+	mNextSibling.resize(MAX_CODE + 1);
+	mSuffix.resize(MAX_CODE + 1);
+}
+
+void LzwWriter::encode(const std::vector<uint8_t> &bm) {
+	encode(bm.data(), bm.size(), (bm.empty() ? 0 : 1), false);
+}
+
+void LzwWriter::encode(const uint8_t *pixels, const size_t width, const size_t height, const bool interlaced) {
+	mRows.clear();
+	if (interlaced) {
+		for (size_t pass = 0; pass < 4; ++pass) {
+			for (size_t y = INTERLACE_START[pass]; y < height; y += INTERLACE_STEP[pass]) mRows.push_back(static_cast<uint32_t>(y));
+		}
+	} else {
+		for (size_t y = 0; y < height; ++y) mRows.push_back(static_cast<uint32_t>(y));
+	}
+
+	if (mEffort == Effort::kBest) {
+		encodeWith(pixels, width, height, 0.0f);
+		mSmallest.swap(mOutput);
+		for (const auto drop : BEST_DROPS) {
+			encodeWith(pixels, width, height, drop);
+			if (mOutput.size() < mSmallest.size()) mSmallest.swap(mOutput);
+		}
+		mOutput.swap(mSmallest);
+	} else {
+		encodeWith(pixels, width, height, mEffort == Effort::kBalanced ? BALANCED_DROP : 0.0f);
+	}
+	if (mFlushFn && !mOutput.empty()) mFlushFn(mOutput);
+}
+
+void LzwWriter::encodeWith(const uint8_t *pixels, const size_t width, const size_t height, const float reset_drop) {
+	// Each image starts on a byte boundary.
+	mOutput.clear();
+	mNBits = 0;
+	mBits = 0;
+	clearTable();
+	mFillStart = 0;
+	mFillBits = 0;
+	mRunError[0] = mRunError[1] = mRunError[2] = 0;
+
+	// Write initial clear code
+	writeCodeLsb(clearCode());
+
+	if (width > 0 && height > 0) {
+		// The first code is always a literal code
+		uint32_t				code = pixels[static_cast<size_t>(mRows[0]) * width];
+		size_t					position = 1;
+		for (size_t r = 0; r < height; ++r) {
+			const uint8_t*		row = pixels + static_cast<size_t>(mRows[r]) * width;
+			for (size_t x = (r == 0 ? 1 : 0); x < width; ++x, ++position) {
+				const uint32_t	literal = row[x];
+				const uint32_t	key = (code<<8) | literal;
+
+				// If there is a hash table hit for this key then we continue the loop
+				// and do not emit a code yet.
+				uint32_t		hash = (key>>12 ^ key) & TABLE_MASK;
+				uint32_t		t = mTable[hash];
+				while (t != INVALID_ENTRY && key != t>>12) {
+					hash = (hash+1)&TABLE_MASK;
+					t = mTable[hash];
+				}
+				if (t != INVALID_ENTRY) {
+					code = t&MAX_CODE;
+					continue;
+				}
+				if (mLossy && extendLossy(code, literal)) continue;
+
+				// Otherwise, write the current code, and literal becomes the start of
+				// the next emitted code.
+				writeCodeLsb(code);
+				code = literal;
+				mRunError[0] = mRunError[1] = mRunError[2] = 0;
+
+				if (mFrozen) {
+					checkRatio(reset_drop, position);
+					continue;
+				}
+				// Increment e.hi, the next implied code. If we run out of codes, either
+				// reset the encoder state or stop adding entries, and continue.
+				if (incHi(reset_drop, position) == IncError::kOutOfCodes) continue;
+
+				// Otherwise, insert key -> e.hi into the empty slot that ended the probe.
+				mTable[hash] = (key << 12) | mHi;
+				if (mLossy) {
+					const uint32_t	prefix = key >> 8;
+					mSuffix[mHi] = static_cast<uint8_t>(literal);
+					mNextSibling[mHi] = mFirstChild[prefix];
+					mFirstChild[prefix] = static_cast<uint16_t>(mHi);
+				}
+			}
+		}
+		writeCodeLsb(code);
+	}
+
+	// Write the eof code.
+	writeCodeLsb(clearCode() + 1);
+
+	// Write the final bits.
+	if (mNBits > 0) mOutput.push_back(static_cast<uint8_t>(mBits));
+}
+
+void LzwWriter::clearTable() {
+	const uint32_t		clear = clearCode();
+	mWidth = mCodeSize + 1;
+	mHi = clear + 1;
+	mOverflow = clear << 1;
+	mFrozen = false;
+	mTable.assign(TABLE_SIZE, INVALID_ENTRY);
+	// Child codes are never below the first free code, so 0 ends a list.
+	if (mLossy) std::fill(mFirstChild.begin(), mFirstChild.end(), 0);
+}
+
+bool LzwWriter::extendLossy(uint32_t &code, const uint32_t literal) {
+	if (literal >= mColors.size()) return false;
+	// The error carries along the match, so pixels that are each close enough
+	// can't drift the whole run in one direction.
+	const gif::ColorA8u&	want = mColors[literal];
+	uint32_t				found = 0;
+	int32_t					found_d = mThreshold + 1, found_e[3] = { 0, 0, 0 };
+	for (uint32_t c = mFirstChild[code]; c != 0; c = mNextSibling[c]) {
+		const uint32_t		suffix = mSuffix[c];
+		if (suffix >= mColors.size()) continue;
+		const gif::ColorA8u&	got = mColors[suffix];
+		const int32_t		e[3] = {	mRunError[0] + static_cast<int32_t>(got.r) - static_cast<int32_t>(want.r),
+										mRunError[1] + static_cast<int32_t>(got.g) - static_cast<int32_t>(want.g),
+										mRunError[2] + static_cast<int32_t>(got.b) - static_cast<int32_t>(want.b) };
+		const int32_t		d = std::abs(e[0]) + std::abs(e[1]) + std::abs(e[2]);
+		if (d < found_d) {
+			found = c;
+			found_d = d;
+			found_e[0] = e[0]; found_e[1] = e[1]; found_e[2] = e[2];
+		}
+	}
+	if (found == 0) return false;
+	code = found;
+	mRunError[0] = found_e[0];
+	mRunError[1] = found_e[1];
+	mRunError[2] = found_e[2];
+	return true;
+}
+
+void LzwWriter::writeCodeLsb(const uint32_t code) {
+	mBits |= code << mNBits;
+	mNBits += mWidth;
+	while (mNBits >= 8) {
+		mOutput.push_back(static_cast<uint8_t>(mBits));
+		mBits >>= 8;
+		mNBits -= 8;
+	}
+}
+
+LzwWriter::IncError LzwWriter::incHi(const float reset_drop, const size_t position) {
+	++mHi;
+	if (mHi == mOverflow) {
+		++mWidth;
+		mOverflow <<= 1;
+	}
+	if (mHi == MAX_CODE) {
+		if (reset_drop > 0.0f) {
+			// Decoders stop adding entries once the table is full, so keep
+			// encoding with the codes already there until they stop paying off.
+			// The ratio reached while the table was filling is the bar a fresh
+			// table is expected to clear, so a full table must at least match it.
+			const size_t	bits = mOutput.size() * 8 + mNBits;
+			mFrozen = true;
+			mBestRatio = static_cast<double>(position - mFillStart) / static_cast<double>(std::max<size_t>(1, bits - mFillBits));
+			mWindowStart = position;
+			mWindowBits = bits;
+			return IncError::kOutOfCodes;
+		}
+		writeCodeLsb(clearCode());
+		clearTable();
+		mFillStart = position;
+		mFillBits = mOutput.size() * 8 + mNBits;
+		return IncError::kOutOfCodes;
+	}
+	return IncError::kNone;
+}
+
+void LzwWriter::checkRatio(const float reset_drop, const size_t position) {
+	if (position - mWindowStart < RATIO_WINDOW) return;
+
+	const size_t		bits = mOutput.size() * 8 + mNBits;
+	const double		ratio = static_cast<double>(position - mWindowStart) / static_cast<double>(std::max<size_t>(1, bits - mWindowBits));
+	if (ratio < mBestRatio * reset_drop || ratio < MIN_FULL_RATIO) {
+		// The image has moved on from what the table holds; start over.
+		writeCodeLsb(clearCode());
+		clearTable();
+		mFillStart = position;
+		mFillBits = mOutput.size() * 8 + mNBits;
+		return;
+	}
+	mBestRatio = std::max(mBestRatio, ratio);
+	mWindowStart = position;
+	mWindowBits = bits;
+}
+
+/**
+ * @class gif::WriterBuffer
+ */
+void WriterBuffer::write(const std::vector<uint8_t> &data) {
+	// Append to my current data
+	if (!data.empty()) {
+		mBuffer.reserve(mBuffer.size() + data.size());
+		mBuffer.insert(mBuffer.end(), data.begin(), data.end());
+	}
+	writeFullBlocks();
+}
+
+void WriterBuffer::terminate() {
+	writeFullBlocks();
+	if (!mBuffer.empty()) {
+		writeBlock(0, mBuffer.size());
+		mBuffer.clear();
+	}
+	mStream << static_cast<uint8_t>(0);
+}
+
+void WriterBuffer::writeFullBlocks() {
+	// Write every full block, then drop them from the buffer in one go.
+	size_t			pos = 0;
+	while (mBuffer.size() - pos >= mBlockSize) {
+		writeBlock(pos, mBlockSize);
+		pos += mBlockSize;
+	}
+	if (pos > 0) mBuffer.erase(mBuffer.begin(), mBuffer.begin()+pos);
+}
+
+void WriterBuffer::writeBlock(const size_t pos, const size_t size) {
+	if (mBuffer.size() < pos + size) return; // error
+
+	mStream << static_cast<uint8_t>(size);
+	mStream.write((const char*)mBuffer.data() + pos, size);
+}
+
+} // namespace gif
@@ -1,78 +1,131 @@
-#ifndef GIFIO_LZWWRITER_H_
-#define GIFIO_LZWWRITER_H_
-
-#include <cstdint>
-#include <fstream>
-#include <functional>
-#include <vector>
-#include <unordered_map>
-
-namespace gif {
-
-/**
- * @class gif::LzwWriter
- * @brief Encode an LZW buffer, specifically one used for GIFs.
- * @description This implementation was based on the extremely nice one in the Go library:
-https://golang.org/src/compress/lzw/writer.go
-https://golang.org/src/image/gif/writer.go
- */
-class LzwWriter {
-public:
-	LzwWriter() { }
-
-	void						begin(	const uint8_t code_size,
-										const std::function<void(const std::vector<uint8_t>&)> &flush_fn);
-	void						encode(const std::vector<uint8_t>&);
-
-private:
-	void						close();
-	enum class IncError			{ kNone, kOutOfCodes, kWriteFailed };
-	inline uint32_t				clearCode() const { return static_cast<uint32_t>(1) << mCodeSize; }
-	void						writeCodeLsb(const uint32_t code);
-	IncError					incHi();
-
-	std::function<void(const std::vector<uint8_t>&)>
-								mFlushFn;
-
-	uint32_t					mCodeSize = 0,
-								mWidth = 0,
-								mNBits = 0,
-								mBits = 0,
-								mHi = 0,
-								mOverflow = 0,
-								mSavedCode = 0;
-	std::unordered_map<uint32_t, uint32_t>
-								mTable;
-	std::vector<uint8_t>		mOutput;
-};
-
-/**
- * @class gif::WriterBuffer
- * @brief Utility to handle writing blocks of bytes in the standard GIF format.
- */
-class WriterBuffer {
-public:
-	WriterBuffer() = delete;
-	WriterBuffer(const WriterBuffer&) = delete;
-	WriterBuffer(std::ostream &s) : mStream(s) { }
-
-	// Clear my buffer without writing anything
-	void						clear() { mBuffer.clear(); }
-	void						write(const std::vector<uint8_t>&);
-	// Force writing my current state, even if it's not large enough for a block,
-	// and write the block terminator.
-	void						terminate();
-
-private:
-	// Write all completed blocks.
-	void						writeFullBlocks();
-	void						writeBlock(const size_t size);
-
-	std::ostream&				mStream;
-	std::vector<uint8_t>		mBuffer;
-	size_t						mBlockSize = 255;
-};
-
-} // namespace gif
-
-#endif
+#ifndef GIFIO_LZWWRITER_H_
+#define GIFIO_LZWWRITER_H_
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <vector>
+#include "gif_color.h"
+
+namespace gif {
+
+/**
+ * @class gif::LzwWriter
+ * @brief Encode an LZW buffer, specifically one used for GIFs.
+ * @description This implementation was based on the extremely nice one in the Go library:
+https://golang.org/src/compress/lzw/writer.go
+https://golang.org/src/image/gif/writer.go
+ */
+class LzwWriter {
+public:
+	// How hard to work at shrinking the output. kFast clears the code table
+	// as soon as it fills, like the Go encoder. kBalanced keeps using a full
+	// table for as long as it compresses well and clears it once the ratio
+	// drops. kBest encodes every strategy and keeps the smallest. All levels
+	// produce standard GIF streams.
+	enum class Effort			{ kFast, kBalanced, kBest };
+
+	LzwWriter() { }
+
+	void						setEffort(const Effort e) { mEffort = e; }
+	Effort						getEffort() const { return mEffort; }
+	// Lossy encoding lets a dictionary match continue through a pixel whose color
+	// is close to the dictionary's, instead of requiring the exact index, which
+	// makes the matches longer. 100 (the default) is lossless, lower values accept
+	// larger color errors. Clamped to 0 - 100.
+	void						setQuality(const uint32_t quality);
+	uint32_t					getQuality() const { return mQuality; }
+
+	// @param colors are what the indices display as, and are used to measure the
+	// error of lossy matches. Indices past the end (i.e. a transparent index) are
+	// only matched exactly. Without colors the image is encoded losslessly.
+	void						begin(	const uint8_t code_size,
+										const std::function<void(const std::vector<uint8_t>&)> &flush_fn,
+										const std::vector<gif::ColorA8u> *colors = nullptr);
+	// Encode a complete image and send it to the flush function assigned
+	// in begin(). Call once per begin().
+	void						encode(const std::vector<uint8_t>&);
+	// Encode an image of width * height pixels, read in place. Interlaced
+	// reads the rows in the four pass GIF order.
+	void						encode(const uint8_t *pixels, const size_t width, const size_t height, const bool interlaced);
+
+private:
+	enum class IncError			{ kNone, kOutOfCodes };
+	inline uint32_t				clearCode() const { return static_cast<uint32_t>(1) << mCodeSize; }
+	// Encode into mOutput. A reset_drop of 0 clears the table as soon as
+	// it fills, otherwise a full table is kept until the compression ratio
+	// falls below reset_drop times the best ratio seen since it filled.
+	void						encodeWith(const uint8_t *pixels, const size_t width, const size_t height, const float reset_drop);
+	void						clearTable();
+	// Replace code with its child whose last pixel is closest to literal, within
+	// the lossy threshold. Answer false if there isn't one.
+	bool						extendLossy(uint32_t &code, const uint32_t literal);
+	void						writeCodeLsb(const uint32_t code);
+	IncError					incHi(const float reset_drop, const size_t position);
+	void						checkRatio(const float reset_drop, const size_t position);
+
+	std::function<void(const std::vector<uint8_t>&)>
+								mFlushFn;
+	Effort						mEffort = Effort::kFast;
+	uint32_t					mQuality = 100;
+	// Lossy encoding. The tree links each code to its children, so lossy
+	// matches can search them. mRunError is the summed error of the current
+	// match, per channel.
+	bool						mLossy = false;
+	int32_t						mThreshold = 0;
+	int32_t						mRunError[3];
+	std::vector<gif::ColorA8u>	mColors;
+	std::vector<uint16_t>		mFirstChild,
+								mNextSibling;
+	std::vector<uint8_t>		mSuffix;
+
+	uint32_t					mCodeSize = 0,
+								mWidth = 0,
+								mNBits = 0,
+								mBits = 0,
+								mHi = 0,
+								mOverflow = 0;
+	// The table is full and no longer taking entries.
+	bool						mFrozen = false;
+	size_t						mFillStart = 0,
+								mFillBits = 0,
+								mWindowStart = 0,
+								mWindowBits = 0;
+	double						mBestRatio = 0.0;
+	std::vector<uint32_t>		mTable;
+	// The source row of each row encoded.
+	std::vector<uint32_t>		mRows;
+	std::vector<uint8_t>		mOutput,
+								mSmallest;
+};
+
+/**
+ * @class gif::WriterBuffer
+ * @brief Utility to handle writing blocks of bytes in the standard GIF format.
+ */
+class WriterBuffer {
+public:
+	WriterBuffer() = delete;
+	WriterBuffer(const WriterBuffer&) = delete;
+	WriterBuffer(std::ostream &s) : mStream(s) { }
+
+	// Clear my buffer without writing anything
+	void						clear() { mBuffer.clear(); }
+	void						write(const std::vector<uint8_t>&);
+	// Force writing my current state, even if it's not large enough for a block,
+	// and write the block terminator.
+	void						terminate();
+
+private:
+	// Write all completed blocks.
+	void						writeFullBlocks();
+	void						writeBlock(const size_t pos, const size_t size);
+
+	std::ostream&				mStream;
+	std::vector<uint8_t>		mBuffer;
+	size_t						mBlockSize = 255;
+};
+
+} // namespace gif
+
+#endif
@@ -0,0 +1,365 @@
+// gif_writer_test: write files with gif::Writer, edit them with gif::Editor
+// and read them back with gif::Reader, checking the tables and frames that
+// come out. Exits non-zero on the first failure. Builds from the gif_io
+// library alone:
+//
+// g++ -std=c++11 -O2 -pthread -Isrc tests/gif_writer_test.cpp src/gif_io/*.cpp -o gif_writer_test
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "gif_io/gif_algorithm.h"
+#include "gif_io/gif_file.h"
+
+namespace {
+
+const int32_t		WIDTH(64);
+const int32_t		HEIGHT(48);
+const size_t		FRAMES(6);
+const size_t		NOISY_FRAMES(24);
+// Large enough to fill the LZW code table several times over.
+const int32_t		LZW_SIZE(256);
+
+// Gradients with more colors than any table holds, moving a little each frame.
+gif::Bitmap			make_frame(const size_t frame) {
+	gif::Bitmap		bm(WIDTH, HEIGHT);
+	for (int32_t y=0; y<HEIGHT; ++y) {
+		for (int32_t x=0; x<WIDTH; ++x) {
+			const int32_t	fx = x + static_cast<int32_t>(frame) * 3;
+			bm.mPixels[y * WIDTH + x] = gif::ColorA8u(	static_cast<uint8_t>(fx * 4), static_cast<uint8_t>(y * 5),
+														static_cast<uint8_t>((fx + y) * 2));
+		}
+	}
+	return bm;
+}
+
+// Noise over a moving gradient, which compresses badly at full quality.
+gif::Bitmap			make_noisy_frame(const size_t frame, uint32_t &seed) {
+	gif::Bitmap		bm(make_frame(frame));
+	for (auto& c : bm.mPixels) {
+		seed = seed * 1664525u + 1013904223u;
+		c.r = static_cast<uint8_t>(c.r ^ ((seed >> 24) & 0x3f));
+		c.g = static_cast<uint8_t>(c.g ^ ((seed >> 16) & 0x3f));
+	}
+	return bm;
+}
+
+// A striped background under a small box that moves and changes color, with
+// each frame's colors exact. Frames 2 and 3 are the same.
+gif::Bitmap			make_box_frame(const size_t frame) {
+	const size_t	step = (frame == 3 ? 2 : frame);
+	gif::Bitmap		bm(WIDTH, HEIGHT);
+	for (int32_t y=0; y<HEIGHT; ++y) {
+		for (int32_t x=0; x<WIDTH; ++x) {
+			const uint8_t	stripe = static_cast<uint8_t>((x / 4) * 16);
+			bm.mPixels[y * WIDTH + x] = gif::ColorA8u(stripe, static_cast<uint8_t>(255 - stripe), 64);
+		}
+	}
+	const int32_t	left = 4 + static_cast<int32_t>(step) * 6, top = 8 + static_cast<int32_t>(step) * 2;
+	for (int32_t y=top; y<top+10; ++y) {
+		for (int32_t x=left; x<left+10; ++x) bm.mPixels[y * WIDTH + x] = gif::ColorA8u(255, static_cast<uint8_t>(step * 40), 0);
+	}
+	return bm;
+}
+
+// Colors picked from a table of 200, so an exact table holds them all. The top
+// half repeats a short pattern, which compresses well until the noise below
+// makes a full code table stop paying off; noisy frames are all noise.
+gif::Bitmap			make_indexed_frame(const bool noisy, uint32_t &seed) {
+	gif::Bitmap		bm(LZW_SIZE, LZW_SIZE);
+	for (int32_t y=0; y<LZW_SIZE; ++y) {
+		for (int32_t x=0; x<LZW_SIZE; ++x) {
+			uint32_t	index = static_cast<uint32_t>((x / 4 + y) % 7);
+			if (noisy || y >= LZW_SIZE / 2) {
+				seed = seed * 1664525u + 1013904223u;
+				index = (seed >> 16) % 200;
+			}
+			bm.mPixels[y * LZW_SIZE + x] = gif::ColorA8u(	static_cast<uint8_t>(index), static_cast<uint8_t>(255 - index),
+															static_cast<uint8_t>(index * 7));
+		}
+	}
+	return bm;
+}
+
+// Collect what the reader finds in each image.
+class Collector : public gif::ListConstructor {
+public:
+	Collector() { }
+
+	void					addFrame(const gif::Bitmap&, const double delay) override { ++mFrames; mDuration += delay; }
+	bool					wantsImages() const override { return true; }
+	void					addImage(const gif::IndexedImage &image) override {
+		mTableSizes.push_back(image.mColorCount);
+		std::vector<bool>	used(256, false);
+		size_t				count = 0;
+		for (size_t k=0; k<image.mIndexCount; ++k) {
+			const uint8_t	index = image.mIndexes[k];
+			if (static_cast<int32_t>(index) == image.mTransparentIndex || used[index]) continue;
+			used[index] = true;
+			++count;
+		}
+		mUsedColors.push_back(count);
+	}
+
+	size_t					mFrames = 0;
+	double					mDuration = 0.0;
+	std::vector<size_t>		mTableSizes,
+							mUsedColors;
+};
+
+// Keep every composited frame.
+class Frames : public gif::ListConstructor {
+public:
+	Frames() { }
+
+	void					addFrame(const gif::Bitmap &bm, const double delay) override { mFrames.push_back(bm); mDelays.push_back(delay); }
+
+	std::vector<gif::Bitmap>	mFrames;
+	std::vector<double>		mDelays;
+};
+
+void				check(const bool condition, const std::string &what) {
+	if (!condition) throw std::runtime_error(what);
+}
+
+// Any limit from 2 to 256 has to write a valid file: the table is padded to a
+// power of 2, but no frame uses more than the limit.
+void				test_max_colors(const std::string &path, const size_t max_colors, const gif::TableMode mode, const bool differencing) {
+	const std::string	name = "max colors " + std::to_string(max_colors) + (mode == gif::TableMode::kLocalTable ? " local" : " global")
+							+ (differencing ? " differencing" : "");
+	{
+		gif::Writer		writer(path);
+		writer.setTableMode(mode).setFrameDifferencing(differencing).setMaxColors(max_colors);
+		for (size_t k=0; k<FRAMES; ++k) writer.writeFrame(make_frame(k), 0.1);
+		writer.finish();
+	}
+	Collector			c;
+	check(gif::Reader(path).read(c), name + ": can't read the file");
+	check(c.mFrames == FRAMES, name + ": wrong frame count");
+	check(!c.mTableSizes.empty(), name + ": no images");
+	for (size_t k=0; k<c.mTableSizes.size(); ++k) {
+		const size_t	size = c.mTableSizes[k];
+		check(size >= 2 && size <= 256 && (size & (size - 1)) == 0, name + ": table size isn't a power of 2");
+		check(c.mUsedColors[k] <= max_colors, name + ": more colors than the limit");
+	}
+}
+
+
+// Answer the average distance per channel between the colors of two bitmaps.
+double				mean_error(const gif::Bitmap &a, const gif::Bitmap &b) {
+	if (a.mWidth != b.mWidth || a.mHeight != b.mHeight || a.mPixels.empty()) return 255.0;
+	double			sum = 0.0;
+	for (size_t k=0; k<a.mPixels.size(); ++k) {
+		const gif::ColorA8u&	c(a.mPixels[k]), &d(b.mPixels[k]);
+		sum += std::abs(c.r - d.r) + std::abs(c.g - d.g) + std::abs(c.b - d.b);
+	}
+	return sum / static_cast<double>(a.mPixels.size() * 3);
+}
+
+// A fixed palette is written as is, even when the first frame has few enough
+// colors for an exact table, or later frames would match only those colors.
+void				test_fixed_palette(const std::string &path, const gif::TableMode mode, const bool differencing) {
+	const std::string	name = std::string("fixed palette") + (mode == gif::TableMode::kLocalTable ? " local" : " global")
+							+ (differencing ? " differencing" : "");
+	const gif::Bitmap	black(WIDTH, HEIGHT), gradient(make_frame(0));
+	{
+		gif::Writer		writer(path);
+		writer.setTableMode(mode).setFrameDifferencing(differencing)
+				.setBitmapToPalette(gif::BitmapToPalette::createFixed(gif::web_safe_palette()))
+				.setToColorIndex(gif::ToColorIndex::createWebSafe());
+		writer.writeFrame(black, 0.1);
+		writer.writeFrame(gradient, 0.1);
+		writer.finish();
+	}
+	Frames				f;
+	check(gif::Reader(path).read(f), name + ": can't read the file");
+	check(f.mFrames.size() == 2, name + ": wrong frame count");
+	// Web safe colors are 51 apart, so no channel is off by more than 26.
+	check(mean_error(f.mFrames[0], black) < 1.0, name + ": the black frame changed");
+	check(mean_error(f.mFrames[1], gradient) < 26.0, name + ": the gradient lost its colors");
+}
+
+// Every effort has to decode to the pixels written, including streams that keep
+// using a full code table and clear it later.
+void				test_lzw_round_trip(const std::string &path, const gif::LzwWriter::Effort effort, const bool interlaced) {
+	const std::string	name = std::string("lzw round trip")
+							+ (effort == gif::LzwWriter::Effort::kFast ? " fast" : effort == gif::LzwWriter::Effort::kBalanced ? " balanced" : " best")
+							+ (interlaced ? " interlaced" : "");
+	uint32_t			seed = 7;
+	std::vector<gif::Bitmap>	frames;
+	frames.push_back(make_indexed_frame(false, seed));
+	frames.push_back(make_indexed_frame(true, seed));
+	frames.push_back(make_indexed_frame(false, seed));
+	{
+		gif::Writer		writer(path);
+		writer.setTableMode(gif::TableMode::kLocalTable).setEffort(effort).setInterlaced(interlaced);
+		for (const auto& bm : frames) writer.writeFrame(bm, 0.1);
+		writer.finish();
+	}
+	Frames				f;
+	check(gif::Reader(path).read(f), name + ": can't read the file");
+	check(f.mFrames.size() == frames.size(), name + ": wrong frame count");
+	for (size_t k=0; k<frames.size(); ++k) {
+		check(mean_error(f.mFrames[k], frames[k]) == 0.0, name + ": frame " + std::to_string(k) + " changed");
+	}
+}
+
+size_t				file_size(const std::string &path) {
+	std::ifstream	f(path, std::ios::binary | std::ios::ate);
+	return (f ? static_cast<size_t>(f.tellg()) : 0);
+}
+
+Frames				read_frames(const std::string &path, const std::string &name) {
+	Frames			f;
+	check(gif::Reader(path).read(f), name + ": can't read " + path);
+	return f;
+}
+
+// Answer every frame repeated once per hundredth of a second it shows for, so
+// files that merge identical frames can be compared.
+std::vector<const gif::Bitmap*>	timeline(const Frames &f) {
+	std::vector<const gif::Bitmap*>	ans;
+	for (size_t k=0; k<f.mFrames.size(); ++k) {
+		const long	hundredths = std::lround(f.mDelays[k] * 100.0);
+		for (long n=0; n<hundredths; ++n) ans.push_back(&f.mFrames[k]);
+	}
+	return ans;
+}
+
+void				check_same_timeline(const Frames &a, const Frames &b, const std::string &name) {
+	const auto		ta = timeline(a), tb = timeline(b);
+	check(ta.size() == tb.size(), name + ": the duration changed");
+	for (size_t k=0; k<ta.size(); ++k) {
+		check(mean_error(*ta[k], *tb[k]) == 0.0, name + ": the frame at " + std::to_string(k) + "/100 s changed");
+	}
+}
+
+void				write_box_frames(const std::string &path, const gif::TableMode mode) {
+	gif::Writer		writer(path);
+	writer.setTableMode(mode);
+	for (size_t k=0; k<FRAMES; ++k) writer.writeFrame(make_box_frame(k), 0.1);
+	writer.finish();
+}
+
+// Files joined by the editor show each file's frames unchanged, even when
+// their global tables differ.
+void				test_editor_append(const std::string &path) {
+	const std::string	name = "editor append", first = path + ".1.gif", second = path + ".2.gif";
+	{
+		gif::Writer		writer(first);
+		for (size_t k=0; k<FRAMES; ++k) writer.writeFrame(make_frame(k), 0.1);
+		writer.finish();
+	}
+	write_box_frames(second, gif::TableMode::kGlobalTableFromFirst);
+	gif::Editor().load(first).append(second).save(path);
+
+	const Frames		a = read_frames(first, name), b = read_frames(second, name), joined = read_frames(path, name);
+	std::remove(first.c_str());
+	std::remove(second.c_str());
+	check(joined.mFrames.size() == a.mFrames.size() + b.mFrames.size(), name + ": wrong frame count");
+	for (size_t k=0; k<joined.mFrames.size(); ++k) {
+		const bool		in_a = k < a.mFrames.size();
+		const gif::Bitmap&	expected(in_a ? a.mFrames[k] : b.mFrames[k - a.mFrames.size()]);
+		check(mean_error(joined.mFrames[k], expected) == 0.0, name + ": frame " + std::to_string(k) + " changed");
+		check(joined.mDelays[k] == (in_a ? a.mDelays[k] : b.mDelays[k - a.mFrames.size()]), name + ": a delay changed");
+	}
+}
+
+// Optimizing shrinks the file but every moment of the animation looks the same.
+void				test_editor_optimize(const std::string &path, const gif::TableMode mode) {
+	const std::string	name = std::string("editor optimize") + (mode == gif::TableMode::kLocalTable ? " local" : " global");
+	write_box_frames(path, mode);
+	const size_t		before = file_size(path);
+	const Frames		original = read_frames(path, name);
+	gif::Editor			editor;
+	editor.load(path);
+	check(editor.optimize(), name + ": nothing was optimized");
+	editor.save(path);
+	check(file_size(path) < before, name + ": the file didn't shrink");
+	const Frames		optimized = read_frames(path, name);
+	check(optimized.mFrames.size() < original.mFrames.size(), name + ": identical frames weren't merged");
+	check_same_timeline(original, optimized, name);
+}
+
+// The loop count is saved, including none at all.
+void				test_editor_loop_count(const std::string &path) {
+	write_box_frames(path, gif::TableMode::kGlobalTableFromFirst);
+	for (const int32_t count : { 0, 3, 65535, gif::Editor::NO_LOOP }) {
+		const std::string	name = "editor loop count " + std::to_string(count);
+		gif::Editor().load(path).setLoopCount(count).save(path);
+		check(gif::Editor().load(path).getLoopCount() == count, name + ": didn't round trip");
+		check(read_frames(path, name).mFrames.size() == FRAMES, name + ": wrong frame count");
+	}
+}
+
+size_t				write_noisy(const std::string &path, const gif::TableMode mode, const bool differencing, const size_t target) {
+	uint32_t		seed = 1;
+	gif::Writer		writer(path);
+	writer.setTableMode(mode).setFrameDifferencing(differencing);
+	if (target > 0) writer.setTargetSize(target, NOISY_FRAMES);
+	for (size_t k=0; k<NOISY_FRAMES; ++k) writer.writeFrame(make_noisy_frame(k, seed), 0.1);
+	writer.finish();
+	for (const auto& stats : writer.getFrameStats()) {
+		check(!stats.mDropped || stats.mBytes == 0, "target size: a dropped frame has bytes");
+	}
+	return file_size(path);
+}
+
+// A target size is a hard limit, and frames dropped to meet it keep the timing.
+void				test_target_size(const std::string &path, const gif::TableMode mode, const bool differencing) {
+	const size_t	full = write_noisy(path, mode, differencing, 0);
+	const double	fractions[] = { 0.8, 0.5, 0.3, 0.2, 0.15 };
+	for (const auto fraction : fractions) {
+		const size_t	target = static_cast<size_t>(static_cast<double>(full) * fraction);
+		const std::string	name = "target " + std::to_string(target) + " of " + std::to_string(full)
+								+ (mode == gif::TableMode::kLocalTable ? " local" : " global") + (differencing ? " differencing" : "");
+		const size_t	size = write_noisy(path, mode, differencing, target);
+		check(size > 0 && size <= target, name + ": wrote " + std::to_string(size) + " bytes");
+		Collector		c;
+		check(gif::Reader(path).read(c), name + ": can't read the file");
+		check(std::abs(c.mDuration - 0.1 * NOISY_FRAMES) < 0.005, name + ": the duration changed");
+	}
+}
+
+}
+
+int main(int argc, char *argv[]) {
+	const std::string	path = (argc > 1 ? argv[1] : "gif_writer_test.gif");
+	try {
+		const size_t	limits[] = { 2, 3, 5, 100, 128, 200, 256 };
+		for (const auto max_colors : limits) {
+			for (const auto mode : { gif::TableMode::kGlobalTableFromFirst, gif::TableMode::kGlobalTableFromAll, gif::TableMode::kLocalTable }) {
+				test_max_colors(path, max_colors, mode, false);
+				test_max_colors(path, max_colors, mode, true);
+			}
+		}
+		for (const auto mode : { gif::TableMode::kGlobalTableFromFirst, gif::TableMode::kGlobalTableFromAll, gif::TableMode::kLocalTable }) {
+			test_target_size(path, mode, false);
+			test_target_size(path, mode, true);
+		}
+		for (const auto effort : { gif::LzwWriter::Effort::kFast, gif::LzwWriter::Effort::kBalanced, gif::LzwWriter::Effort::kBest }) {
+			test_lzw_round_trip(path, effort, false);
+			test_lzw_round_trip(path, effort, true);
+		}
+		for (const auto mode : { gif::TableMode::kGlobalTableFromFirst, gif::TableMode::kGlobalTableFromAll, gif::TableMode::kLocalTable }) {
+			test_fixed_palette(path, mode, false);
+			test_fixed_palette(path, mode, true);
+		}
+		test_editor_append(path);
+		test_editor_optimize(path, gif::TableMode::kGlobalTableFromFirst);
+		test_editor_optimize(path, gif::TableMode::kLocalTable);
+		test_editor_loop_count(path);
+	} catch (std::exception const &ex) {
+		std::cout << "FAILED " << ex.what() << std::endl;
+		std::remove(path.c_str());
+		return 1;
+	}
+	std::remove(path.c_str());
+	std::cout << "passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,502 @@
+// gif_batch: probe, decode, re-encode, thumbnail or hash every GIF file under
+// the given paths on a work-stealing thread pool, and report the throughput.
+// Builds from the gif_io library alone, see the README.
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gif_io/gif_algorithm.h"
+#include "gif_io/gif_cache.h"
+#include "gif_io/gif_file.h"
+#include "gif_io/gif_frame_hash.h"
+
+#if defined(_WIN32)
+#include <direct.h>
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+namespace {
+
+enum class Command { kProbe, kDecode, kEncode, kThumb, kHash };
+
+enum Stage { kProbeStage, kDecodeStage, kScaleStage, kEncodeStage, kHashStage, STAGE_COUNT };
+const char*			STAGE_NAMES[] = { "probe", "decode", "scale", "encode", "hash" };
+
+class Options {
+public:
+	Command					mCommand = Command::kDecode;
+	std::string				mOut,
+							mCache;
+	uint64_t				mCacheMegabytes = 256;
+	int32_t					mSize = 128;
+	uint32_t				mThreads = 0;
+	size_t					mHashFrames = 0,
+							mHashStep = 1;
+	// Report files whose signatures are within this many bits, -1 for none.
+	int32_t					mDupes = -1;
+	gif::LzwWriter::Effort	mEffort = gif::LzwWriter::Effort::kFast;
+	bool					mDiff = false,
+							mLocal = false,
+							mVerbose = false;
+};
+
+class Job {
+public:
+	std::string				mPath,
+							mRelative;
+	uint64_t				mBytes = 0;
+};
+
+class Stats {
+public:
+	void					add(const Stats &s) {
+		mFiles += s.mFiles;
+		mFailed += s.mFailed;
+		mFrames += s.mFrames;
+		mBytesIn += s.mBytesIn;
+		mSteals += s.mSteals;
+		for (size_t k=0; k<STAGE_COUNT; ++k) mSeconds[k] += s.mSeconds[k];
+	}
+
+	size_t					mFiles = 0,
+							mFailed = 0,
+							mFrames = 0,
+							mSteals = 0;
+	uint64_t				mBytesIn = 0;
+	double					mSeconds[STAGE_COUNT] = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+};
+
+double		seconds_since(const std::chrono::steady_clock::time_point &start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * WorkStealingQueue
+ * Each worker takes its newest job from its own deque, and when that's empty
+ * steals the oldest from another's. Every job is known up front, so all
+ * deques being empty means the work is done.
+ */
+class WorkStealingQueue {
+public:
+	WorkStealingQueue(const size_t workers) {
+		for (size_t k=0; k<workers; ++k) mDeques.push_back(std::unique_ptr<Deque>(new Deque()));
+	}
+
+	void					push(const size_t worker, const size_t job) {
+		Deque&				d(*mDeques[worker % mDeques.size()]);
+		std::lock_guard<std::mutex>		lock(d.mMutex);
+		d.mJobs.push_back(job);
+	}
+
+	bool					pop(const size_t worker, size_t &job, bool &stolen) {
+		{
+			Deque&			d(*mDeques[worker]);
+			std::lock_guard<std::mutex>	lock(d.mMutex);
+			if (!d.mJobs.empty()) {
+				job = d.mJobs.back();
+				d.mJobs.pop_back();
+				stolen = false;
+				return true;
+			}
+		}
+		for (size_t k=1; k<mDeques.size(); ++k) {
+			Deque&			d(*mDeques[(worker + k) % mDeques.size()]);
+			std::lock_guard<std::mutex>	lock(d.mMutex);
+			if (!d.mJobs.empty()) {
+				job = d.mJobs.front();
+				d.mJobs.pop_front();
+				stolen = true;
+				return true;
+			}
+		}
+		return false;
+	}
+
+private:
+	class Deque {
+	public:
+		std::mutex			mMutex;
+		std::deque<size_t>	mJobs;
+	};
+	std::vector<std::unique_ptr<Deque>>	mDeques;
+};
+
+/**
+ * Worker
+ * Everything a thread reuses from file to file: the reader's buffer, decoder
+ * and screen, the scaled frame, and single threaded palette and quantizing
+ * algorithms for each writer, since the pool already fills every core. The
+ * color matcher is shared too, because building one dominates the cost of
+ * writing a small file.
+ */
+class Worker : public gif::ListConstructor {
+public:
+	Worker(const Options &o, gif::FrameCache *cache)
+			: mOptions(o)
+			, mCache(cache)
+			, mBitmapToPalette(gif::BitmapToPalette::create(1))
+			, mToPalettedBitmap(gif::ToPalettedBitmap::create(1))
+			, mToColorIndex(gif::ToColorIndex::create()) {
+		mHasher.setMaxFrames(o.mHashFrames).setFrameStep(o.mHashStep);
+	}
+
+	// Answer a line for the probe report, or an error.
+	std::string				run(const Job&);
+
+	void					addFrame(const gif::Bitmap&, const double delay) override;
+	bool					wantsMoreFrames() const override;
+
+	Stats					mStats;
+	// The last file's, for the hash command.
+	gif::AnimationSignature	mSignature;
+
+private:
+	std::string				probe(const Job&);
+	std::string				hashLine(const Job&) const;
+	void					thumbSize(const int32_t w, const int32_t h, int32_t &out_w, int32_t &out_h) const;
+
+	const Options&			mOptions;
+	// Shared by every worker, when decoded files are cached.
+	gif::FrameCache*		mCache;
+	gif::Reader				mReader;
+	gif::Bitmap				mScaled;
+	gif::BitmapToPaletteRef	mBitmapToPalette;
+	gif::ToPalettedBitmapRef	mToPalettedBitmap;
+	gif::ToColorIndexRef	mToColorIndex;
+	gif::FrameHasher		mHasher;
+	// The current job's writer, and time spent in addFrame().
+	gif::Writer*			mWriter = nullptr;
+	// A writer error from addFrame(), kept until the reader returns so it
+	// isn't reported as a read error.
+	std::exception_ptr		mError;
+	double					mCallbackSeconds = 0.0;
+};
+
+void		make_parent_dirs(const std::string &path) {
+	for (size_t pos = path.find_first_of("/\\", 1); pos != std::string::npos; pos = path.find_first_of("/\\", pos + 1)) {
+		const std::string	dir = path.substr(0, pos);
+#if defined(_WIN32)
+		_mkdir(dir.c_str());
+#else
+		mkdir(dir.c_str(), 0755);
+#endif
+	}
+}
+
+std::string Worker::run(const Job &job) {
+	mStats.mBytesIn += job.mBytes;
+	++mStats.mFiles;
+	try {
+		if (mOptions.mCommand == Command::kProbe) return probe(job);
+
+		std::unique_ptr<gif::Writer>	writer;
+		if (mOptions.mCommand != Command::kDecode) {
+			const std::string	out = mOptions.mOut + "/" + job.mRelative;
+			make_parent_dirs(out);
+			writer.reset(new gif::Writer(out));
+			writer->setEffort(mOptions.mEffort).setFrameDifferencing(mOptions.mDiff);
+			if (mOptions.mLocal) writer->setTableMode(gif::TableMode::kLocalTable);
+			writer->setBitmapToPalette(mBitmapToPalette).setToPalettedBitmap(mToPalettedBitmap).setToColorIndex(mToColorIndex);
+		}
+		mWriter = writer.get();
+		mError = nullptr;
+		mHasher.clear();
+		mCallbackSeconds = 0.0;
+		const auto			start = std::chrono::steady_clock::now();
+		bool				ok = true;
+		if (mCache) mCache->open(job.mPath)->read(*this);
+		else ok = mReader.read(job.mPath, *this);
+		// Decoding is whatever the reader spent outside my callback.
+		mStats.mSeconds[kDecodeStage] += seconds_since(start) - mCallbackSeconds;
+		mWriter = nullptr;
+		if (mError) std::rethrow_exception(mError);
+		if (!ok) throw std::runtime_error("can't read");
+		if (writer) {
+			const auto		finish_start = std::chrono::steady_clock::now();
+			writer->finish();
+			mStats.mSeconds[kEncodeStage] += seconds_since(finish_start);
+		}
+		if (mOptions.mCommand == Command::kHash) {
+			mSignature = mHasher.getSignature();
+			return hashLine(job);
+		}
+	} catch (std::exception const &ex) {
+		mWriter = nullptr;
+		++mStats.mFailed;
+		return job.mRelative + ": error " + ex.what();
+	}
+	return std::string();
+}
+
+void Worker::addFrame(const gif::Bitmap &bm, const double delay) {
+	++mStats.mFrames;
+	if (mOptions.mCommand == Command::kHash) {
+		const auto			start = std::chrono::steady_clock::now();
+		mHasher.addFrame(bm, delay);
+		mStats.mSeconds[kHashStage] += seconds_since(start);
+		mCallbackSeconds += seconds_since(start);
+		return;
+	}
+	if (!mWriter || mError) return;
+	const auto				start = std::chrono::steady_clock::now();
+	try {
+		if (mOptions.mCommand == Command::kThumb) {
+			int32_t			w = 0, h = 0;
+			thumbSize(bm.mWidth, bm.mHeight, w, h);
+			gif::resize_bitmap(gif::BitmapView(bm), w, h, mScaled, 1);
+			const double	scaled = seconds_since(start);
+			mStats.mSeconds[kScaleStage] += scaled;
+			mWriter->writeFrame(mScaled, delay);
+			mStats.mSeconds[kEncodeStage] += seconds_since(start) - scaled;
+		} else {
+			mWriter->writeFrame(bm, delay);
+			mStats.mSeconds[kEncodeStage] += seconds_since(start);
+		}
+	} catch (std::exception const&) {
+		mError = std::current_exception();
+	}
+	mCallbackSeconds += seconds_since(start);
+}
+
+bool Worker::wantsMoreFrames() const {
+	if (mError) return false;
+	return mOptions.mCommand != Command::kHash || mHasher.wantsMoreFrames();
+}
+
+std::string Worker::probe(const Job &job) {
+	// The editor parses the blocks without decoding any image data.
+	const auto				start = std::chrono::steady_clock::now();
+	gif::Editor				e;
+	e.load(job.mPath);
+	double					duration = 0.0;
+	for (size_t k=0; k<e.size(); ++k) duration += e.getDelay(k);
+	mStats.mFrames += e.size();
+	mStats.mSeconds[kProbeStage] += seconds_since(start);
+
+	char					line[256];
+	std::snprintf(	line, sizeof(line), "%dx%d, %u frames, %.2f s, loop %d", e.getWidth(), e.getHeight(),
+					static_cast<unsigned>(e.size()), duration, e.getLoopCount());
+	return job.mRelative + ": " + line;
+}
+
+std::string Worker::hashLine(const Job &job) const {
+	char					line[256];
+	std::snprintf(	line, sizeof(line), "phash %016llx dhash %016llx, %u frames hashed, %.2f s", static_cast<unsigned long long>(mSignature.mPHash),
+					static_cast<unsigned long long>(mSignature.mDHash), static_cast<unsigned>(mSignature.mFrameCount), mSignature.mDuration);
+	return job.mRelative + ": " + line;
+}
+
+void Worker::thumbSize(const int32_t w, const int32_t h, int32_t &out_w, int32_t &out_h) const {
+	// Fit in a square of the thumbnail size, never enlarging.
+	const double			scale = std::min(1.0, static_cast<double>(mOptions.mSize) / static_cast<double>(std::max(1, std::max(w, h))));
+	out_w = std::max(1, static_cast<int32_t>(w * scale + 0.5));
+	out_h = std::max(1, static_cast<int32_t>(h * scale + 0.5));
+}
+
+bool		is_gif(const std::string &name) {
+	if (name.size() < 4) return false;
+	std::string				ext = name.substr(name.size() - 4);
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](const char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+	return ext == ".gif";
+}
+
+// Add the file, or every GIF file under the directory.
+void		find_gifs(const std::string &path, const std::string &relative, std::vector<Job> &jobs) {
+#if defined(_WIN32)
+	WIN32_FIND_DATAA		data;
+	HANDLE					h = FindFirstFileA((path + "\\*").c_str(), &data);
+	if (h != INVALID_HANDLE_VALUE) {
+		do {
+			const std::string	name(data.cFileName);
+			if (name == "." || name == "..") continue;
+			find_gifs(path + "\\" + name, relative.empty() ? name : relative + "/" + name, jobs);
+		} while (FindNextFileA(h, &data));
+		FindClose(h);
+		return;
+	}
+	struct _stat64			st;
+	if (_stat64(path.c_str(), &st) != 0) return;
+#else
+	struct stat				st;
+	if (stat(path.c_str(), &st) != 0) return;
+	if (S_ISDIR(st.st_mode)) {
+		DIR*				dir = opendir(path.c_str());
+		if (!dir) return;
+		while (dirent *e = readdir(dir)) {
+			const std::string	name(e->d_name);
+			if (name == "." || name == "..") continue;
+			find_gifs(path + "/" + name, relative.empty() ? name : relative + "/" + name, jobs);
+		}
+		closedir(dir);
+		return;
+	}
+#endif
+	if (!is_gif(path)) return;
+	Job						job;
+	job.mPath = path;
+	job.mRelative = relative.empty() ? path.substr(path.find_last_of("/\\") + 1) : relative;
+	job.mBytes = static_cast<uint64_t>(st.st_size);
+	jobs.push_back(job);
+}
+
+void		usage() {
+	std::cout	<< "usage: gif_batch probe|decode|encode|thumb|hash [options] path..." << std::endl
+				<< "Paths are GIF files or directories, searched recursively." << std::endl
+				<< "  probe           list each file's size, frames and duration, without decoding" << std::endl
+				<< "  decode          decode every frame" << std::endl
+				<< "  encode          decode and write each file again into --out" << std::endl
+				<< "  thumb           decode and write each file at --size into --out" << std::endl
+				<< "  hash            list each file's perceptual hash signature" << std::endl
+				<< "  --out DIR       output folder, mirroring the input tree" << std::endl
+				<< "  --size N        thumbnail size, default 128" << std::endl
+				<< "  --threads N     default is the hardware concurrency" << std::endl
+				<< "  --effort E      fast (default), balanced or best" << std::endl
+				<< "  --local         a color table per frame instead of a global one" << std::endl
+				<< "  --diff          only write the area of each frame that changed" << std::endl
+				<< "  --cache DIR     keep decoded files in DIR, and map them when they're seen again" << std::endl
+				<< "  --cache-mb N    the most the cache keeps, default 256" << std::endl
+				<< "  --hash-frames N stop decoding each file after N frames, default all" << std::endl
+				<< "  --hash-step N   hash every Nth frame, default 1" << std::endl
+				<< "  --dupes N       list files whose signatures are within N bits" << std::endl
+				<< "  --verbose       list every file" << std::endl;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 3) { usage(); return 1; }
+	Options					options;
+	const std::string		command(argv[1]);
+	if (command == "probe") options.mCommand = Command::kProbe;
+	else if (command == "decode") options.mCommand = Command::kDecode;
+	else if (command == "encode") options.mCommand = Command::kEncode;
+	else if (command == "thumb") options.mCommand = Command::kThumb;
+	else if (command == "hash") options.mCommand = Command::kHash;
+	else { usage(); return 1; }
+
+	std::vector<Job>		jobs;
+	for (int k=2; k<argc; ++k) {
+		const std::string	arg(argv[k]);
+		const bool			has_value = k + 1 < argc;
+		if (arg == "--out" && has_value) options.mOut = argv[++k];
+		else if (arg == "--size" && has_value) options.mSize = std::max(1, std::atoi(argv[++k]));
+		else if (arg == "--threads" && has_value) options.mThreads = static_cast<uint32_t>(std::max(1, std::atoi(argv[++k])));
+		else if (arg == "--local") options.mLocal = true;
+		else if (arg == "--diff") options.mDiff = true;
+		else if (arg == "--cache" && has_value) options.mCache = argv[++k];
+		else if (arg == "--cache-mb" && has_value) options.mCacheMegabytes = static_cast<uint64_t>(std::max(1, std::atoi(argv[++k])));
+		else if (arg == "--verbose") options.mVerbose = true;
+		else if (arg == "--hash-frames" && has_value) options.mHashFrames = static_cast<size_t>(std::max(0, std::atoi(argv[++k])));
+		else if (arg == "--hash-step" && has_value) options.mHashStep = static_cast<size_t>(std::max(1, std::atoi(argv[++k])));
+		else if (arg == "--dupes" && has_value) options.mDupes = std::max(0, std::atoi(argv[++k]));
+		else if (arg == "--effort" && has_value) {
+			const std::string	e(argv[++k]);
+			if (e == "fast") options.mEffort = gif::LzwWriter::Effort::kFast;
+			else if (e == "balanced") options.mEffort = gif::LzwWriter::Effort::kBalanced;
+			else if (e == "best") options.mEffort = gif::LzwWriter::Effort::kBest;
+			else { usage(); return 1; }
+		} else if (arg.size() > 1 && arg[0] == '-') { usage(); return 1; }
+		else find_gifs(arg, std::string(), jobs);
+	}
+	if ((options.mCommand == Command::kEncode || options.mCommand == Command::kThumb) && options.mOut.empty()) {
+		std::cout << "gif_batch: " << command << " needs --out" << std::endl;
+		return 1;
+	}
+	if (jobs.empty()) {
+		std::cout << "gif_batch: no GIF files found" << std::endl;
+		return 1;
+	}
+	std::sort(jobs.begin(), jobs.end(), [](const Job &a, const Job &b) { return a.mRelative < b.mRelative; });
+
+	size_t					thread_count = options.mThreads;
+	if (thread_count < 1) thread_count = std::max(1u, std::thread::hardware_concurrency());
+	thread_count = std::min(thread_count, jobs.size());
+
+	// Deal the jobs out in turn, so each deque starts with a similar mix.
+	WorkStealingQueue		queue(thread_count);
+	for (size_t k=0; k<jobs.size(); ++k) queue.push(k, k);
+
+	std::vector<std::string>	results(jobs.size());
+	std::vector<gif::AnimationSignature>	signatures(jobs.size());
+	std::unique_ptr<gif::FrameCache>	cache;
+	if (!options.mCache.empty()) cache.reset(new gif::FrameCache(options.mCache, options.mCacheMegabytes << 20));
+	std::vector<std::unique_ptr<Worker>>	workers;
+	for (size_t k=0; k<thread_count; ++k) workers.push_back(std::unique_ptr<Worker>(new Worker(options, cache.get())));
+
+	const auto				start = std::chrono::steady_clock::now();
+	std::vector<std::thread>	threads;
+	for (size_t t=0; t<thread_count; ++t) {
+		threads.push_back(std::thread([t, &queue, &workers, &jobs, &results, &signatures]() {
+			Worker&			w(*workers[t]);
+			size_t			job = 0;
+			bool			stolen = false;
+			while (queue.pop(t, job, stolen)) {
+				if (stolen) ++w.mStats.mSteals;
+				w.mSignature = gif::AnimationSignature();
+				results[job] = w.run(jobs[job]);
+				signatures[job] = w.mSignature;
+			}
+		}));
+	}
+	for (auto& t : threads) t.join();
+	const double			wall = seconds_since(start);
+
+	Stats					total;
+	for (const auto& w : workers) total.add(w->mStats);
+	for (size_t k=0; k<results.size(); ++k) {
+		if (results[k].empty()) {
+			if (options.mVerbose) std::cout << jobs[k].mRelative << ": ok" << std::endl;
+		} else if (	options.mVerbose || options.mCommand == Command::kProbe || options.mCommand == Command::kHash
+					|| results[k].find(": error ") != std::string::npos) {
+			std::cout << results[k] << std::endl;
+		}
+	}
+
+	if (options.mDupes >= 0) {
+		// Every pair: fine for a batch, a library needs an index on the hash bits.
+		for (size_t a=0; a<jobs.size(); ++a) {
+			if (signatures[a].empty()) continue;
+			for (size_t b=a+1; b<jobs.size(); ++b) {
+				if (signatures[b].empty()) continue;
+				const uint32_t	d = gif::FrameHasher::distance(signatures[a].mPHash, signatures[b].mPHash);
+				if (d <= static_cast<uint32_t>(options.mDupes)) {
+					std::cout << "dupe: " << jobs[a].mRelative << " ~ " << jobs[b].mRelative << " (" << d << " bits)" << std::endl;
+				}
+			}
+		}
+	}
+
+	const double			mb = static_cast<double>(total.mBytesIn) / (1024.0 * 1024.0);
+	double					busy = 0.0;
+	for (size_t k=0; k<STAGE_COUNT; ++k) busy += total.mSeconds[k];
+	std::printf("%s: %u files (%u failed), %.1f MB, %u frames in %.3f s on %u threads\n",
+				command.c_str(), static_cast<unsigned>(total.mFiles), static_cast<unsigned>(total.mFailed), mb,
+				static_cast<unsigned>(total.mFrames), wall, static_cast<unsigned>(thread_count));
+	std::printf("  %.1f files/s, %.1f MB/s, %.1f frames/s, %u jobs stolen\n",
+				total.mFiles / wall, mb / wall, total.mFrames / wall, static_cast<unsigned>(total.mSteals));
+	if (cache) {
+		std::printf("  cache: %u hits, %u misses\n", static_cast<unsigned>(cache->getHits()), static_cast<unsigned>(cache->getMisses()));
+	}
+	for (size_t k=0; k<STAGE_COUNT; ++k) {
+		if (total.mSeconds[k] <= 0.0) continue;
+		std::printf("  %-8s %9.3f thread-s %5.1f%%  %.2f ms/file\n", STAGE_NAMES[k], total.mSeconds[k],
+					100.0 * total.mSeconds[k] / std::max(busy, 1e-9), 1000.0 * total.mSeconds[k] / std::max<size_t>(total.mFiles, 1));
+	}
+	return total.mFailed > 0 ? 2 : 0;
+}
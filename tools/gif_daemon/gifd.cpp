@@ -0,0 +1,322 @@
+// gifd: a long running GIF job daemon. Clients (see gifd_client.h) send
+// probe, decode, encode and thumbnail jobs over a Unix domain socket. A pool
+// of warm workers runs them, and frames travel in sealed memfds instead of
+// through the socket. Linux only; builds from the gif_io library alone:
+//
+// g++ -std=c++11 -O2 -pthread -Isrc -Itools/gif_daemon tools/gif_daemon/gifd.cpp
+//		tools/gif_daemon/gifd_protocol.cpp src/gif_io/*.cpp -o gifd
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "gif_io/gif_algorithm.h"
+#include "gif_io/gif_file.h"
+#include "gif_io/gif_pipeline.h"
+#include "gifd_protocol.h"
+
+namespace {
+
+using namespace gifd;
+
+// Paths longer than this are refused, so a bad request can't make me allocate much.
+const uint32_t		MAX_PATH_LENGTH(4096);
+
+/**
+ * Task
+ * A job from a connection, and its result.
+ */
+class Task {
+public:
+	Task() { }
+	~Task() {
+		if (mFd >= 0) close(mFd);
+		if (mReplyFd >= 0) close(mReplyFd);
+	}
+
+	Request					mRequest;
+	std::string				mInput,
+							mOutput;
+	int						mFd = -1;
+
+	Reply					mReply;
+	std::string				mMessage;
+	int						mReplyFd = -1;
+	std::promise<void>		mDone;
+};
+
+using TaskRef = std::shared_ptr<Task>;
+
+/**
+ * Worker
+ * A pool thread. The reader's buffer, decoder and screen, the scaled frame
+ * and the writer algorithms are made once and reused by every job, with the
+ * algorithms single threaded since the pool already fills the cores.
+ */
+class Worker : public gif::ListConstructor {
+public:
+	Worker()
+			: mBitmapToPalette(gif::BitmapToPalette::create(1))
+			, mToPalettedBitmap(gif::ToPalettedBitmap::create(1)) {
+	}
+
+	void					run(Task&);
+
+	void					addFrame(const gif::Bitmap&, const double delay) override;
+
+private:
+	void					probe(Task&);
+	void					decode(Task&);
+	void					encode(Task&);
+	void					thumb(Task&);
+	std::unique_ptr<gif::Writer>	newWriter(const std::string &path);
+
+	gif::Reader				mReader;
+	gif::Bitmap				mScaled;
+	gif::BitmapToPaletteRef	mBitmapToPalette;
+	gif::ToPalettedBitmapRef	mToPalettedBitmap;
+
+	// The current job. Decoded frames go to the memfd, or scaled to the writer.
+	int						mFrameFd = -1;
+	FrameHeader				mHeader;
+	std::vector<double>		mDelays;
+	gif::Writer*			mWriter = nullptr;
+	int32_t					mThumbSize = 0;
+};
+
+void Worker::run(Task &task) {
+	try {
+		switch (task.mRequest.mOp) {
+			case Op::kProbe:	probe(task); break;
+			case Op::kDecode:	decode(task); break;
+			case Op::kEncode:	encode(task); break;
+			case Op::kThumb:	thumb(task); break;
+			default:			throw std::runtime_error("unknown job");
+		}
+	} catch (std::exception const &ex) {
+		task.mReply = Reply();
+		task.mReply.mStatus = 1;
+		task.mMessage = ex.what();
+		if (task.mReplyFd >= 0) close(task.mReplyFd);
+		task.mReplyFd = -1;
+	}
+	mFrameFd = -1;
+	mWriter = nullptr;
+	task.mReply.mMessageLength = static_cast<uint32_t>(task.mMessage.size());
+}
+
+void Worker::addFrame(const gif::Bitmap &bm, const double delay) {
+	if (mWriter) {
+		const double		scale = std::min(1.0, static_cast<double>(mThumbSize) / static_cast<double>(std::max(1, std::max(bm.mWidth, bm.mHeight))));
+		const int32_t		w = std::max(1, static_cast<int32_t>(bm.mWidth * scale + 0.5)),
+							h = std::max(1, static_cast<int32_t>(bm.mHeight * scale + 0.5));
+		gif::resize_bitmap(gif::BitmapView(bm), w, h, mScaled, 1);
+		mWriter->writeFrame(mScaled, delay);
+		return;
+	}
+	if (mFrameFd < 0) return;
+	if (mHeader.mFrameCount == 0) {
+		mHeader.mWidth = bm.mWidth;
+		mHeader.mHeight = bm.mHeight;
+	}
+	write_all(mFrameFd, bm.mPixels.data(), bm.mPixels.size() * sizeof(gif::ColorA8u));
+	mDelays.push_back(delay);
+	++mHeader.mFrameCount;
+}
+
+void Worker::probe(Task &task) {
+	gif::Editor				e;
+	e.load(task.mInput);
+	double					duration = 0.0;
+	for (size_t k=0; k<e.size(); ++k) duration += e.getDelay(k);
+	task.mReply.mWidth = e.getWidth();
+	task.mReply.mHeight = e.getHeight();
+	task.mReply.mFrameCount = static_cast<uint32_t>(e.size());
+	task.mMessage = "duration " + std::to_string(duration) + " loop " + std::to_string(e.getLoopCount());
+}
+
+void Worker::decode(Task &task) {
+	task.mReplyFd = create_memfd("gifd-frames");
+	mFrameFd = task.mReplyFd;
+	mHeader = FrameHeader();
+	mDelays.clear();
+	// The header is filled in once the frames are counted.
+	write_all(mFrameFd, &mHeader, sizeof(mHeader));
+	if (!mReader.read(task.mInput, *this)) throw std::runtime_error("can't read " + task.mInput);
+	write_all(mFrameFd, mDelays.data(), mDelays.size() * sizeof(double));
+	if (pwrite(mFrameFd, &mHeader, sizeof(mHeader), 0) != static_cast<ssize_t>(sizeof(mHeader))) throw std::runtime_error("can't write frame data");
+	seal_memfd(mFrameFd);
+
+	task.mReply.mWidth = mHeader.mWidth;
+	task.mReply.mHeight = mHeader.mHeight;
+	task.mReply.mFrameCount = mHeader.mFrameCount;
+	task.mReply.mDataSize = mHeader.totalSize();
+}
+
+void Worker::encode(Task &task) {
+	if (task.mFd < 0) throw std::runtime_error("encode has no frame data");
+	// Unsealed, the client could shrink the file while I read the mapping.
+	if (!is_memfd_sealed(task.mFd)) throw std::runtime_error("encode frame data isn't sealed");
+	struct stat				st;
+	if (fstat(task.mFd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(FrameHeader)) throw std::runtime_error("encode has no frame data");
+	const size_t			size = static_cast<size_t>(st.st_size);
+	void*					m = mmap(nullptr, size, PROT_READ, MAP_SHARED, task.mFd, 0);
+	if (m == MAP_FAILED) throw std::runtime_error("encode can't map the frame data");
+	try {
+		const char*			base = static_cast<const char*>(m);
+		FrameHeader			header;
+		std::memcpy(&header, base, sizeof(header));
+		if (header.mMagic != MAGIC || header.mWidth < 1 || header.mHeight < 1 || header.totalSize() > size) {
+			throw std::runtime_error("encode has invalid frame data");
+		}
+		std::unique_ptr<gif::Writer>	writer = newWriter(task.mOutput);
+		for (uint32_t k=0; k<header.mFrameCount; ++k) {
+			double			delay = 0.0;
+			std::memcpy(&delay, base + header.delaysOffset() + sizeof(double) * k, sizeof(double));
+			// Read straight from the client's memory.
+			const gif::BitmapView	view(base + sizeof(header) + header.frameSize() * k, header.mWidth, header.mHeight,
+										static_cast<size_t>(header.mWidth) * 4);
+			writer->writeFrame(view, delay);
+		}
+		writer->finish();
+		task.mReply.mWidth = header.mWidth;
+		task.mReply.mHeight = header.mHeight;
+		task.mReply.mFrameCount = header.mFrameCount;
+	} catch (std::exception const&) {
+		munmap(m, size);
+		throw;
+	}
+	munmap(m, size);
+}
+
+void Worker::thumb(Task &task) {
+	if (task.mRequest.mSize < 1) throw std::runtime_error("thumb needs a size");
+	std::unique_ptr<gif::Writer>	writer = newWriter(task.mOutput);
+	mWriter = writer.get();
+	mThumbSize = task.mRequest.mSize;
+	if (!mReader.read(task.mInput, *this)) throw std::runtime_error("can't read " + task.mInput);
+	mWriter = nullptr;
+	writer->finish();
+	task.mReply.mWidth = mScaled.mWidth;
+	task.mReply.mHeight = mScaled.mHeight;
+}
+
+std::unique_ptr<gif::Writer> Worker::newWriter(const std::string &path) {
+	if (path.empty()) throw std::runtime_error("no output path");
+	std::unique_ptr<gif::Writer>	writer(new gif::Writer(path));
+	writer->setBitmapToPalette(mBitmapToPalette).setToPalettedBitmap(mToPalettedBitmap);
+	return writer;
+}
+
+// Read jobs from the connection, hand them to the pool and send back each
+// result, until the client hangs up or breaks the protocol.
+void		serve(const int socket, gif::BoundedQueue<TaskRef> &queue) {
+	try {
+		while (true) {
+			TaskRef			task = std::make_shared<Task>();
+			recv_all(socket, &task->mRequest, sizeof(Request), &task->mFd);
+			const Request&	r(task->mRequest);
+			if (r.mMagic != MAGIC || r.mInputLength > MAX_PATH_LENGTH || r.mOutputLength > MAX_PATH_LENGTH) break;
+			task->mInput = recv_string(socket, r.mInputLength);
+			task->mOutput = recv_string(socket, r.mOutputLength);
+
+			std::future<void>	done = task->mDone.get_future();
+			TaskRef			queued(task);
+			if (!queue.push(std::move(queued))) break;
+			done.wait();
+			send_all(socket, &task->mReply, sizeof(Reply), task->mReplyFd);
+			send_string(socket, task->mMessage);
+		}
+	} catch (std::exception const&) {
+	}
+	close(socket);
+}
+
+std::string			SOCKET_PATH;
+
+void		on_signal(int) {
+	unlink(SOCKET_PATH.c_str());
+	_exit(0);
+}
+
+}
+
+int main(int argc, char *argv[]) {
+	SOCKET_PATH = DEFAULT_SOCKET;
+	size_t					thread_count = std::max(1u, std::thread::hardware_concurrency());
+	size_t					queue_size = 0;
+	for (int k=1; k<argc; ++k) {
+		const std::string	arg(argv[k]);
+		const bool			has_value = k + 1 < argc;
+		if (arg == "--socket" && has_value) SOCKET_PATH = argv[++k];
+		else if (arg == "--threads" && has_value) thread_count = static_cast<size_t>(std::max(1, std::atoi(argv[++k])));
+		else if (arg == "--queue" && has_value) queue_size = static_cast<size_t>(std::max(1, std::atoi(argv[++k])));
+		else {
+			std::cout	<< "usage: gifd [--socket PATH] [--threads N] [--queue N]" << std::endl
+						<< "  --socket PATH   default " << DEFAULT_SOCKET << std::endl
+						<< "  --threads N     workers, default the hardware concurrency" << std::endl
+						<< "  --queue N       jobs waiting for a worker before clients wait, default 4 per worker" << std::endl;
+			return 1;
+		}
+	}
+	if (queue_size < 1) queue_size = thread_count * 4;
+
+	sockaddr_un				addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (SOCKET_PATH.size() >= sizeof(addr.sun_path)) {
+		std::cerr << "gifd: socket path too long" << std::endl;
+		return 1;
+	}
+	std::memcpy(addr.sun_path, SOCKET_PATH.c_str(), SOCKET_PATH.size() + 1);
+	const int				listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	unlink(SOCKET_PATH.c_str());
+	if (listener < 0 || bind(listener, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listener, 128) != 0) {
+		std::cerr << "gifd: can't listen on " << SOCKET_PATH << ": " << std::strerror(errno) << std::endl;
+		return 1;
+	}
+	std::signal(SIGINT, on_signal);
+	std::signal(SIGTERM, on_signal);
+
+	gif::BoundedQueue<TaskRef>	queue(queue_size);
+	std::vector<std::thread>	workers;
+	for (size_t k=0; k<thread_count; ++k) {
+		workers.push_back(std::thread([&queue]() {
+			Worker			w;
+			TaskRef			task;
+			while (queue.pop(task)) {
+				w.run(*task);
+				task->mDone.set_value();
+				task.reset();
+			}
+		}));
+	}
+	std::cout << "gifd: listening on " << SOCKET_PATH << " with " << thread_count << " workers" << std::endl;
+
+	while (true) {
+		const int			client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+		if (client < 0) {
+			if (errno == EINTR || errno == ECONNABORTED || errno == EMFILE || errno == ENFILE) continue;
+			break;
+		}
+		// Connections only wait on their own jobs, so each gets a light thread.
+		std::thread(serve, client, std::ref(queue)).detach();
+	}
+	queue.close();
+	for (auto& w : workers) w.join();
+	unlink(SOCKET_PATH.c_str());
+	return 1;
+}
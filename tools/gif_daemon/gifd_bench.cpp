@@ -0,0 +1,291 @@
+// gifd_bench: a load generator for gifd. Client threads each send a stream of
+// jobs over the files given, and the throughput and latency are reported.
+// The same jobs can run in this process (--direct), or as one gif_batch
+// process per job (--spawn), to compare against. Linux only:
+//
+// g++ -std=c++11 -O2 -pthread -Isrc -Itools/gif_daemon tools/gif_daemon/gifd_bench.cpp
+//		tools/gif_daemon/gifd_client.cpp tools/gif_daemon/gifd_protocol.cpp src/gif_io/*.cpp -o gifd_bench
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "gif_io/gif_algorithm.h"
+#include "gif_io/gif_file.h"
+#include "gifd_client.h"
+
+extern char **environ;
+
+namespace {
+
+enum class Mode { kDaemon, kDirect, kSpawn };
+
+class Options {
+public:
+	std::string				mSocket = gifd::DEFAULT_SOCKET;
+	gifd::Op				mOp = gifd::Op::kDecode;
+	Mode					mMode = Mode::kDaemon;
+	std::string				mSpawnPath,
+							mOut = "/tmp/gifd_bench";
+	size_t					mClients = 4,
+							mRequests = 100;
+	int32_t					mSize = 128;
+};
+
+// A file and, for encode jobs, its frames.
+class Input {
+public:
+	std::string				mPath;
+	uint64_t				mBytes = 0;
+	std::vector<gif::Bitmap>	mFrames;
+	std::vector<double>		mDelays;
+};
+
+class FrameCollector : public gif::ListConstructor {
+public:
+	FrameCollector(Input &in) : mInput(in) { }
+	void					addFrame(const gif::Bitmap &bm, const double delay) override {
+		mInput.mFrames.push_back(bm);
+		mInput.mDelays.push_back(delay);
+	}
+	Input&					mInput;
+};
+
+// Reads every pixel of the first row, as a client would start using the frames.
+class FrameToucher : public gif::ListConstructor {
+public:
+	void					addFrame(const gif::Bitmap &bm, const double) override {
+		for (int32_t x=0; x<bm.mWidth; ++x) mSum += bm.mPixels[x].r;
+	}
+	uint64_t				mSum = 0;
+};
+
+// Scale each frame to fit in size x size, as gifd's thumbnails do, and write it.
+class ThumbWriter : public gif::ListConstructor {
+public:
+	ThumbWriter(gif::Writer &w, const int32_t size) : mWriter(w), mSize(size) { }
+	void					addFrame(const gif::Bitmap &bm, const double delay) override {
+		const double		scale = std::min(1.0, static_cast<double>(mSize) / static_cast<double>(std::max(1, std::max(bm.mWidth, bm.mHeight))));
+		gif::resize_bitmap(	gif::BitmapView(bm), std::max(1, static_cast<int32_t>(bm.mWidth * scale + 0.5)),
+							std::max(1, static_cast<int32_t>(bm.mHeight * scale + 0.5)), mScaled);
+		mWriter.writeFrame(mScaled, delay);
+	}
+	gif::Writer&			mWriter;
+	const int32_t			mSize;
+	gif::Bitmap				mScaled;
+};
+
+double		seconds_since(const std::chrono::steady_clock::time_point &start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::string	output_path(const Options &o, const size_t client, const size_t request) {
+	return o.mOut + "/c" + std::to_string(client) + "_" + std::to_string(request % 4) + ".gif";
+}
+
+// Run a job in this process, the way a process per job would, minus the process.
+void		run_direct(const Options &o, const Input &in, const std::string &out) {
+	switch (o.mOp) {
+		case gifd::Op::kProbe: {
+			gif::Editor		e;
+			e.load(in.mPath);
+			break;
+		}
+		case gifd::Op::kDecode: {
+			FrameToucher	t;
+			if (!gif::Reader(in.mPath).read(t)) throw std::runtime_error("can't read " + in.mPath);
+			break;
+		}
+		case gifd::Op::kEncode: {
+			gif::Writer		w(out);
+			for (size_t k=0; k<in.mFrames.size(); ++k) w.writeFrame(in.mFrames[k], in.mDelays[k]);
+			w.finish();
+			break;
+		}
+		case gifd::Op::kThumb: {
+			gif::Writer		w(out);
+			ThumbWriter		t(w, o.mSize);
+			if (!gif::Reader(in.mPath).read(t)) throw std::runtime_error("can't read " + in.mPath);
+			w.finish();
+			break;
+		}
+	}
+}
+
+void		run_spawn(const Options &o, const Input &in) {
+	std::vector<std::string>	args;
+	args.push_back(o.mSpawnPath);
+	switch (o.mOp) {
+		case gifd::Op::kProbe:	args.push_back("probe"); break;
+		case gifd::Op::kDecode:	args.push_back("decode"); break;
+		case gifd::Op::kThumb:	args.push_back("thumb"); args.push_back("--out"); args.push_back(o.mOut);
+								args.push_back("--size"); args.push_back(std::to_string(o.mSize)); break;
+		default:				throw std::runtime_error("--spawn supports probe, decode and thumb");
+	}
+	args.push_back("--threads");
+	args.push_back("1");
+	args.push_back(in.mPath);
+	std::vector<char*>		argv;
+	for (auto& a : args) argv.push_back(&a[0]);
+	argv.push_back(nullptr);
+
+	posix_spawn_file_actions_t	actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+	pid_t					pid = 0;
+	const int				err = posix_spawn(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+	posix_spawn_file_actions_destroy(&actions);
+	if (err != 0) throw std::runtime_error("can't spawn " + o.mSpawnPath);
+	int						status = 0;
+	waitpid(pid, &status, 0);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) throw std::runtime_error("job failed for " + in.mPath);
+}
+
+void		usage() {
+	std::cout	<< "usage: gifd_bench [options] file.gif..." << std::endl
+				<< "  --op OP         probe, decode (default), encode or thumb" << std::endl
+				<< "  --clients N     concurrent clients, default 4" << std::endl
+				<< "  --requests N    jobs per client, default 100" << std::endl
+				<< "  --socket PATH   default " << gifd::DEFAULT_SOCKET << std::endl
+				<< "  --size N        thumbnail size, default 128" << std::endl
+				<< "  --out DIR       where encode and thumb write, default /tmp/gifd_bench" << std::endl
+				<< "  --direct        run the jobs in this process instead" << std::endl
+				<< "  --spawn PATH    run each job as a gif_batch process at PATH instead" << std::endl;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+	Options					o;
+	std::vector<Input>		inputs;
+	for (int k=1; k<argc; ++k) {
+		const std::string	arg(argv[k]);
+		const bool			has_value = k + 1 < argc;
+		if (arg == "--clients" && has_value) o.mClients = static_cast<size_t>(std::max(1, std::atoi(argv[++k])));
+		else if (arg == "--requests" && has_value) o.mRequests = static_cast<size_t>(std::max(1, std::atoi(argv[++k])));
+		else if (arg == "--socket" && has_value) o.mSocket = argv[++k];
+		else if (arg == "--size" && has_value) o.mSize = std::max(1, std::atoi(argv[++k]));
+		else if (arg == "--out" && has_value) o.mOut = argv[++k];
+		else if (arg == "--direct") o.mMode = Mode::kDirect;
+		else if (arg == "--spawn" && has_value) { o.mMode = Mode::kSpawn; o.mSpawnPath = argv[++k]; }
+		else if (arg == "--op" && has_value) {
+			const std::string	op(argv[++k]);
+			if (op == "probe") o.mOp = gifd::Op::kProbe;
+			else if (op == "decode") o.mOp = gifd::Op::kDecode;
+			else if (op == "encode") o.mOp = gifd::Op::kEncode;
+			else if (op == "thumb") o.mOp = gifd::Op::kThumb;
+			else { usage(); return 1; }
+		} else if (arg.size() > 1 && arg[0] == '-') { usage(); return 1; }
+		else {
+			Input			in;
+			in.mPath = arg;
+			struct stat		st;
+			if (stat(arg.c_str(), &st) == 0) in.mBytes = static_cast<uint64_t>(st.st_size);
+			inputs.push_back(in);
+		}
+	}
+	if (inputs.empty()) { usage(); return 1; }
+	mkdir(o.mOut.c_str(), 0755);
+	if (o.mOp == gifd::Op::kEncode) {
+		for (auto& in : inputs) {
+			FrameCollector	c(in);
+			if (!gif::Reader(in.mPath).read(c) || in.mFrames.empty()) {
+				std::cerr << "gifd_bench: can't read " << in.mPath << std::endl;
+				return 1;
+			}
+		}
+	}
+
+	std::mutex				mutex;
+	std::vector<double>		latencies;
+	size_t					failures = 0;
+	uint64_t				bytes = 0,
+							checksum = 0;
+	std::string				first_error;
+	const auto				start = std::chrono::steady_clock::now();
+	std::vector<std::thread>	threads;
+	for (size_t c=0; c<o.mClients; ++c) {
+		threads.push_back(std::thread([c, &o, &inputs, &mutex, &latencies, &failures, &bytes, &checksum, &first_error]() {
+			gifd::Client	client;
+			gifd::Frames	frames;
+			std::vector<double>	mine;
+			size_t			failed = 0;
+			uint64_t		done_bytes = 0;
+			std::string		error;
+			// Of the decoded pixels, reported so reading them can't be optimized away.
+			uint64_t		sum = 0;
+			for (size_t r=0; r<o.mRequests; ++r) {
+				const Input&	in(inputs[(c * o.mRequests + r) % inputs.size()]);
+				const std::string	out = output_path(o, c, r);
+				const auto	job_start = std::chrono::steady_clock::now();
+				try {
+					if (o.mMode == Mode::kDirect) {
+						run_direct(o, in, out);
+					} else if (o.mMode == Mode::kSpawn) {
+						run_spawn(o, in);
+					} else {
+						if (!client.isConnected()) client.connect(o.mSocket);
+						switch (o.mOp) {
+							case gifd::Op::kProbe:	client.probe(in.mPath); break;
+							case gifd::Op::kThumb:	client.thumb(in.mPath, out, o.mSize); break;
+							case gifd::Op::kDecode: {
+								client.decode(in.mPath, frames);
+								// Touch the frames, as a client would.
+								for (size_t k=0; k<frames.size(); ++k) {
+									const gif::ColorA8u*	p = frames.pixels(k);
+									for (int32_t x=0; x<frames.width(); ++x) sum += p[x].r;
+								}
+								break;
+							}
+							case gifd::Op::kEncode: {
+								std::vector<gif::BitmapView>	views;
+								for (const auto& bm : in.mFrames) views.push_back(gif::BitmapView(bm));
+								client.encode(views, in.mDelays, out);
+								break;
+							}
+						}
+					}
+					done_bytes += in.mBytes;
+				} catch (std::exception const &ex) {
+					if (error.empty()) error = ex.what();
+					++failed;
+				}
+				mine.push_back(seconds_since(job_start));
+			}
+			std::lock_guard<std::mutex>	lock(mutex);
+			latencies.insert(latencies.end(), mine.begin(), mine.end());
+			failures += failed;
+			bytes += done_bytes;
+			checksum += sum;
+			if (first_error.empty()) first_error = error;
+		}));
+	}
+	for (auto& t : threads) t.join();
+	const double			wall = seconds_since(start);
+
+	std::sort(latencies.begin(), latencies.end());
+	auto					percentile = [&latencies](const double p) {
+		const size_t		i = std::min(latencies.size() - 1, static_cast<size_t>(p * (latencies.size() - 1) + 0.5));
+		return 1000.0 * latencies[i];
+	};
+	const char*				modes[] = { "daemon", "direct", "spawn" };
+	std::printf("%s, %u clients x %u jobs: %u failed, %.3f s\n", modes[static_cast<int>(o.mMode)],
+				static_cast<unsigned>(o.mClients), static_cast<unsigned>(o.mRequests), static_cast<unsigned>(failures), wall);
+	std::printf("  %.1f jobs/s, %.1f MB/s of input\n", latencies.size() / wall, bytes / (1024.0 * 1024.0) / wall);
+	std::printf("  latency ms: p50 %.2f, p90 %.2f, p99 %.2f, max %.2f\n", percentile(0.5), percentile(0.9), percentile(0.99), percentile(1.0));
+	if (o.mMode == Mode::kDaemon && o.mOp == gifd::Op::kDecode) std::printf("  pixel checksum %llx\n", static_cast<unsigned long long>(checksum));
+	if (!first_error.empty()) std::printf("  first error: %s\n", first_error.c_str());
+	return failures > 0 ? 2 : 0;
+}
@@ -0,0 +1,180 @@
+#include "gifd_client.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace gifd {
+
+/**
+ * @class gifd::Frames
+ */
+Frames::~Frames() {
+	clear();
+}
+
+const gif::ColorA8u* Frames::pixels(const size_t frame) const {
+	if (frame >= size()) return nullptr;
+	const char*				base = static_cast<const char*>(mMap) + sizeof(FrameHeader);
+	return reinterpret_cast<const gif::ColorA8u*>(base + mHeader->frameSize() * frame);
+}
+
+gif::BitmapView Frames::view(const size_t frame) const {
+	const gif::ColorA8u*	p = pixels(frame);
+	if (!p) return gif::BitmapView();
+	return gif::BitmapView(p, width(), height(), static_cast<size_t>(width()) * 4);
+}
+
+double Frames::delay(const size_t frame) const {
+	if (frame >= size()) return 0.0;
+	double					d = 0.0;
+	std::memcpy(&d, static_cast<const char*>(mMap) + mHeader->delaysOffset() + sizeof(double) * frame, sizeof(double));
+	return d;
+}
+
+void Frames::clear() {
+	if (mMap) munmap(mMap, mMapSize);
+	mMap = nullptr;
+	mMapSize = 0;
+	mHeader = nullptr;
+}
+
+void Frames::map(const int fd, const uint64_t size) {
+	clear();
+	if (size < sizeof(FrameHeader)) {
+		::close(fd);
+		throw std::runtime_error("gifd::Frames::map() no frame data");
+	}
+	void*					m = mmap(nullptr, static_cast<size_t>(size), PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (m == MAP_FAILED) throw std::runtime_error(std::string("gifd::Frames::map() mmap failed: ") + std::strerror(errno));
+	mMap = m;
+	mMapSize = static_cast<size_t>(size);
+	mHeader = static_cast<const FrameHeader*>(mMap);
+	if (mHeader->mMagic != MAGIC || mHeader->mWidth < 0 || mHeader->mHeight < 0 || mHeader->totalSize() > mMapSize) {
+		clear();
+		throw std::runtime_error("gifd::Frames::map() invalid frame data");
+	}
+}
+
+/**
+ * @class gifd::Client
+ */
+void Client::connect(const std::string &socket_path) {
+	close();
+	sockaddr_un				addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (socket_path.size() >= sizeof(addr.sun_path)) throw std::runtime_error("gifd::Client::connect() path too long");
+	std::memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+	mSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (mSocket < 0) throw std::runtime_error(std::string("gifd::Client::connect() ") + std::strerror(errno));
+	if (::connect(mSocket, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+		const int			e = errno;
+		close();
+		throw std::runtime_error("gifd::Client::connect() " + socket_path + ": " + std::strerror(e));
+	}
+}
+
+void Client::close() {
+	if (mSocket >= 0) ::close(mSocket);
+	mSocket = -1;
+}
+
+Info Client::probe(const std::string &path) {
+	return call(Op::kProbe, path, std::string(), 0, -1, nullptr, nullptr);
+}
+
+Info Client::decode(const std::string &path, Frames &frames) {
+	int						fd = -1;
+	uint64_t				size = 0;
+	frames.clear();
+	const Info				info = call(Op::kDecode, path, std::string(), 0, -1, &fd, &size);
+	if (fd < 0) throw std::runtime_error("gifd::Client::decode() no frame data");
+	frames.map(fd, size);
+	return info;
+}
+
+Info Client::encode(const std::vector<gif::BitmapView> &frames, const std::vector<double> &delays, const std::string &output_path) {
+	if (frames.empty() || delays.size() != frames.size()) throw std::runtime_error("gifd::Client::encode() needs frames and a delay for each");
+	FrameHeader				header;
+	header.mWidth = frames.front().mWidth;
+	header.mHeight = frames.front().mHeight;
+	header.mFrameCount = static_cast<uint32_t>(frames.size());
+
+	const int				fd = create_memfd("gifd-encode");
+	try {
+		if (ftruncate(fd, static_cast<off_t>(header.totalSize())) != 0) throw std::runtime_error("gifd::Client::encode() can't size the frame data");
+		void*				m = mmap(nullptr, header.totalSize(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (m == MAP_FAILED) throw std::runtime_error(std::string("gifd::Client::encode() mmap failed: ") + std::strerror(errno));
+		char*				dst = static_cast<char*>(m);
+		std::memcpy(dst, &header, sizeof(header));
+		const size_t		row_size = static_cast<size_t>(header.mWidth) * 4;
+		std::vector<gif::ColorA8u>	scratch(static_cast<size_t>(header.mWidth));
+		bool				sizes_match = true;
+		for (size_t k=0; k<frames.size() && sizes_match; ++k) {
+			const gif::BitmapView&	v(frames[k]);
+			sizes_match = (v.mWidth == header.mWidth && v.mHeight == header.mHeight);
+			char*			frame_dst = dst + sizeof(header) + header.frameSize() * k;
+			for (int32_t y=0; y<v.mHeight && sizes_match; ++y) std::memcpy(frame_dst + row_size * y, v.row(y, scratch.data()), row_size);
+		}
+		std::memcpy(dst + header.delaysOffset(), delays.data(), sizeof(double) * delays.size());
+		// The mapping has to go before the memfd can be sealed against writes.
+		munmap(m, header.totalSize());
+		if (!sizes_match) throw std::runtime_error("gifd::Client::encode() frames differ in size");
+		seal_memfd(fd);
+		const Info			info = call(Op::kEncode, std::string(), output_path, 0, fd, nullptr, nullptr);
+		::close(fd);
+		return info;
+	} catch (std::exception const&) {
+		::close(fd);
+		throw;
+	}
+}
+
+Info Client::thumb(const std::string &input_path, const std::string &output_path, const int32_t size) {
+	return call(Op::kThumb, input_path, output_path, size, -1, nullptr, nullptr);
+}
+
+Info Client::call(	const Op op, const std::string &input, const std::string &output, const int32_t size,
+					const int send_fd, int *recv_fd, uint64_t *data_size) {
+	if (mSocket < 0) throw std::runtime_error("gifd::Client not connected");
+	Request					request;
+	request.mOp = op;
+	request.mInputLength = static_cast<uint32_t>(input.size());
+	request.mOutputLength = static_cast<uint32_t>(output.size());
+	request.mSize = size;
+
+	Reply					reply;
+	int						fd = -1;
+	try {
+		send_all(mSocket, &request, sizeof(request), send_fd);
+		send_string(mSocket, input);
+		send_string(mSocket, output);
+		recv_all(mSocket, &reply, sizeof(reply), &fd);
+	} catch (std::exception const&) {
+		// The stream is out of step, so the connection can't be reused.
+		close();
+		throw;
+	}
+	Info					info;
+	info.mWidth = reply.mWidth;
+	info.mHeight = reply.mHeight;
+	info.mFrameCount = reply.mFrameCount;
+	info.mMessage = recv_string(mSocket, reply.mMessageLength);
+	if (reply.mMagic != MAGIC || reply.mStatus != 0) {
+		if (fd >= 0) ::close(fd);
+		throw std::runtime_error("gifd: " + info.mMessage);
+	}
+	if (recv_fd) *recv_fd = fd;
+	else if (fd >= 0) ::close(fd);
+	if (data_size) *data_size = reply.mDataSize;
+	return info;
+}
+
+} // namespace gifd
@@ -0,0 +1,96 @@
+#ifndef GIFD_CLIENT_H_
+#define GIFD_CLIENT_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "gif_io/gif_bitmap.h"
+#include "gifd_protocol.h"
+
+namespace gifd {
+
+/**
+ * @class gifd::Info
+ * @brief What a job reports about its file.
+ */
+class Info {
+public:
+	Info() { }
+
+	int32_t					mWidth = 0,
+							mHeight = 0;
+	uint32_t				mFrameCount = 0;
+	// Probe details, i.e. the duration and loop count.
+	std::string				mMessage;
+};
+
+/**
+ * @class gifd::Frames
+ * @brief Decoded frames, mapped read-only from the daemon's memfd.
+ * Nothing is copied; the mapping lives as long as this object.
+ */
+class Frames {
+public:
+	Frames() { }
+	Frames(const Frames&) = delete;
+	Frames& operator=(const Frames&) = delete;
+	~Frames();
+
+	bool					empty() const { return size() < 1; }
+	size_t					size() const { return mHeader ? mHeader->mFrameCount : 0; }
+	int32_t					width() const { return mHeader ? mHeader->mWidth : 0; }
+	int32_t					height() const { return mHeader ? mHeader->mHeight : 0; }
+	// The frame's pixels, width() * height() of them.
+	const gif::ColorA8u*	pixels(const size_t frame) const;
+	gif::BitmapView			view(const size_t frame) const;
+	double					delay(const size_t frame) const;
+
+	void					clear();
+	// Map the memfd, which is closed. Throw on error.
+	void					map(const int fd, const uint64_t size);
+
+private:
+	void*					mMap = nullptr;
+	size_t					mMapSize = 0;
+	const FrameHeader*		mHeader = nullptr;
+};
+
+/**
+ * @class gifd::Client
+ * @brief A connection to the gifd daemon. Jobs run one at a time per client;
+ * use a client per thread for concurrent jobs. Every call throws on error,
+ * including errors the daemon reports.
+ */
+class Client {
+public:
+	Client() { }
+	Client(const Client&) = delete;
+	Client& operator=(const Client&) = delete;
+	~Client() { close(); }
+
+	void					connect(const std::string &socket_path = DEFAULT_SOCKET);
+	bool					isConnected() const { return mSocket >= 0; }
+	void					close();
+
+	// Read the file's blocks without decoding anything.
+	Info					probe(const std::string &path);
+	// Decode every frame of the file into frames.
+	Info					decode(const std::string &path, Frames &frames);
+	// Write the frames, all the same size, as a GIF file. Pixels are copied once,
+	// into the memfd the daemon reads them from.
+	Info					encode(	const std::vector<gif::BitmapView> &frames, const std::vector<double> &delays,
+									const std::string &output_path);
+	// Write a copy of the file scaled to fit in size x size.
+	Info					thumb(const std::string &input_path, const std::string &output_path, const int32_t size);
+
+private:
+	// Run a job. Answer the reply's info and any descriptor the daemon sent.
+	Info					call(	const Op, const std::string &input, const std::string &output, const int32_t size,
+									const int send_fd, int *recv_fd, uint64_t *data_size);
+
+	int						mSocket = -1;
+};
+
+} // namespace gifd
+
+#endif
@@ -0,0 +1,121 @@
+#include "gifd_protocol.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace gifd {
+
+void send_all(const int socket, const void *data, const size_t size, const int fd) {
+	const char*				p = static_cast<const char*>(data);
+	size_t					sent = 0;
+	bool					fd_sent = (fd < 0);
+	while (sent < size) {
+		iovec				iov;
+		iov.iov_base = const_cast<char*>(p + sent);
+		iov.iov_len = size - sent;
+		msghdr				msg;
+		std::memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		// The descriptor rides along with the first byte.
+		char				control[CMSG_SPACE(sizeof(int))];
+		if (!fd_sent) {
+			std::memset(control, 0, sizeof(control));
+			msg.msg_control = control;
+			msg.msg_controllen = sizeof(control);
+			cmsghdr*		c = CMSG_FIRSTHDR(&msg);
+			c->cmsg_level = SOL_SOCKET;
+			c->cmsg_type = SCM_RIGHTS;
+			c->cmsg_len = CMSG_LEN(sizeof(int));
+			std::memcpy(CMSG_DATA(c), &fd, sizeof(int));
+		}
+		const ssize_t		n = sendmsg(socket, &msg, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			throw std::runtime_error(std::string("gifd send failed: ") + std::strerror(errno));
+		}
+		fd_sent = true;
+		sent += static_cast<size_t>(n);
+	}
+}
+
+void recv_all(const int socket, void *data, const size_t size, int *fd) {
+	char*					p = static_cast<char*>(data);
+	size_t					received = 0;
+	if (fd) *fd = -1;
+	while (received < size) {
+		iovec				iov;
+		iov.iov_base = p + received;
+		iov.iov_len = size - received;
+		msghdr				msg;
+		std::memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		char				control[CMSG_SPACE(sizeof(int))];
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		const ssize_t		n = recvmsg(socket, &msg, MSG_CMSG_CLOEXEC);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			throw std::runtime_error(std::string("gifd receive failed: ") + std::strerror(errno));
+		}
+		if (n == 0) throw std::runtime_error("gifd connection closed");
+		for (cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+			if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+			int				received_fd = -1;
+			std::memcpy(&received_fd, CMSG_DATA(c), sizeof(int));
+			if (fd && *fd < 0) *fd = received_fd;
+			else close(received_fd);
+		}
+		received += static_cast<size_t>(n);
+	}
+}
+
+void send_string(const int socket, const std::string &s) {
+	if (!s.empty()) send_all(socket, s.data(), s.size());
+}
+
+std::string recv_string(const int socket, const size_t size) {
+	std::string				s(size, '\0');
+	if (size > 0) recv_all(socket, &s[0], size);
+	return s;
+}
+
+int create_memfd(const char *name) {
+	const int				fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0) throw std::runtime_error(std::string("gifd memfd_create failed: ") + std::strerror(errno));
+	return fd;
+}
+
+void write_all(const int fd, const void *data, const size_t size) {
+	const char*				p = static_cast<const char*>(data);
+	size_t					written = 0;
+	while (written < size) {
+		const ssize_t		n = write(fd, p + written, size - written);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			throw std::runtime_error(std::string("gifd write failed: ") + std::strerror(errno));
+		}
+		written += static_cast<size_t>(n);
+	}
+}
+
+void seal_memfd(const int fd) {
+	if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+		throw std::runtime_error(std::string("gifd can't seal the memfd: ") + std::strerror(errno));
+	}
+}
+
+bool is_memfd_sealed(const int fd) {
+	const int				needed = F_SEAL_SHRINK | F_SEAL_WRITE;
+	const int				seals = fcntl(fd, F_GET_SEALS);
+	return seals >= 0 && (seals & needed) == needed;
+}
+
+} // namespace gifd
@@ -0,0 +1,80 @@
+#ifndef GIFD_PROTOCOL_H_
+#define GIFD_PROTOCOL_H_
+
+// The gifd job protocol, shared by the daemon and the client library.
+// Linux only: frames travel in sealed memfds passed over a Unix socket.
+//
+// Each job is a Request, the input and output paths, and for kEncode a frame
+// file descriptor. The daemon answers with a Reply and its message, and for
+// kDecode a frame file descriptor. A connection carries any number of jobs,
+// one at a time.
+//
+// Frame data, in a memfd: a FrameHeader, then every frame's RGBA pixels
+// in order, then one double delay (in seconds) per frame.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#if !defined(__linux__)
+#error gifd needs Linux (memfd and Unix domain sockets)
+#endif
+
+namespace gifd {
+
+const uint32_t		MAGIC(0x44464947);
+const char* const	DEFAULT_SOCKET("/tmp/gifd.sock");
+
+enum class Op : uint32_t { kProbe = 1, kDecode = 2, kEncode = 3, kThumb = 4 };
+
+struct Request {
+	uint32_t		mMagic = MAGIC;
+	Op				mOp = Op::kProbe;
+	uint32_t		mInputLength = 0,
+					mOutputLength = 0;
+	// Thumbnail size.
+	int32_t			mSize = 0;
+	uint32_t		mReserved = 0;
+};
+
+struct Reply {
+	uint32_t		mMagic = MAGIC;
+	// 0 on success, otherwise the message is the error.
+	uint32_t		mStatus = 0;
+	int32_t			mWidth = 0,
+					mHeight = 0;
+	uint32_t		mFrameCount = 0,
+					mMessageLength = 0;
+	uint64_t		mDataSize = 0;
+};
+
+struct FrameHeader {
+	uint32_t		mMagic = MAGIC;
+	int32_t			mWidth = 0,
+					mHeight = 0;
+	uint32_t		mFrameCount = 0;
+
+	size_t			frameSize() const { return static_cast<size_t>(mWidth) * static_cast<size_t>(mHeight) * 4; }
+	size_t			delaysOffset() const { return sizeof(FrameHeader) + frameSize() * mFrameCount; }
+	size_t			totalSize() const { return delaysOffset() + sizeof(double) * mFrameCount; }
+};
+
+// Socket helpers. Throw on error, including the peer closing.
+void				send_all(const int socket, const void*, const size_t, const int fd = -1);
+void				recv_all(const int socket, void*, const size_t, int *fd = nullptr);
+void				send_string(const int socket, const std::string&);
+std::string			recv_string(const int socket, const size_t);
+
+// Create an empty memfd. Throw on error.
+int					create_memfd(const char *name);
+// Write the whole buffer to the fd. Throw on error.
+void				write_all(const int fd, const void*, const size_t);
+// Seal the memfd so the receiver can trust its size and contents. Throw on error.
+void				seal_memfd(const int fd);
+// Answer true if the memfd can no longer shrink or be written, so it's safe
+// to map. A peer could otherwise truncate it under the mapping.
+bool				is_memfd_sealed(const int fd);
+
+} // namespace gifd
+
+#endif
@@ -0,0 +1,87 @@
+// gif_export: stream a GIF file as YUV4MPEG2 or raw RGBA video with
+// gif::VideoExporter, i.e. gif_export in.gif | ffmpeg -i - out.mp4
+// Builds from the gif_io library alone, see the README.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include "gif_io/gif_file.h"
+#include "gif_io/gif_video.h"
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace {
+
+void		usage() {
+	std::cerr	<< "usage: gif_export [options] input.gif [output]" << std::endl
+				<< "Writes to stdout without an output file." << std::endl
+				<< "  --rgba          raw RGBA frames instead of YUV4MPEG2" << std::endl
+				<< "  --fps N[/D]     constant output frame rate, default 25" << std::endl
+				<< "  --background RRGGBB  shown under transparent pixels, default 000000" << std::endl;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+	gif::VideoExporter::Format	format = gif::VideoExporter::Format::kY4m;
+	uint32_t				rate_num = 25,
+							rate_den = 1;
+	uint32_t				background = 0;
+	std::string				paths[2];
+	size_t					path_count = 0;
+
+	for (int k=1; k<argc; ++k) {
+		const std::string	arg(argv[k]);
+		const bool			has_value = k + 1 < argc;
+		if (arg == "--rgba") format = gif::VideoExporter::Format::kRgba;
+		else if (arg == "--fps" && has_value) {
+			const std::string	v(argv[++k]);
+			const size_t		slash = v.find('/');
+			rate_num = static_cast<uint32_t>(std::atoi(v.substr(0, slash).c_str()));
+			if (slash != std::string::npos) rate_den = static_cast<uint32_t>(std::atoi(v.substr(slash + 1).c_str()));
+		} else if (arg == "--background" && has_value) {
+			background = static_cast<uint32_t>(std::strtoul(argv[++k], nullptr, 16));
+		} else if (arg.size() > 1 && arg[0] == '-') { usage(); return 1; }
+		else if (path_count < 2) paths[path_count++] = arg;
+		else { usage(); return 1; }
+	}
+	if (path_count < 1) { usage(); return 1; }
+
+	std::FILE*				file = stdout;
+	if (path_count > 1 && paths[1] != "-") {
+		file = std::fopen(paths[1].c_str(), "wb");
+		if (!file) {
+			std::cerr << "gif_export: can't open " << paths[1] << std::endl;
+			return 1;
+		}
+	} else {
+#if defined(_WIN32)
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+	}
+
+	int						result = 0;
+	try {
+		const auto			start = std::chrono::steady_clock::now();
+		gif::VideoExporter	exporter(file, format);
+		exporter.setFrameRate(rate_num, rate_den);
+		exporter.setBackground(gif::ColorA8u(	static_cast<uint8_t>(background >> 16),
+												static_cast<uint8_t>(background >> 8),
+												static_cast<uint8_t>(background)));
+		if (!gif::Reader(paths[0]).read(exporter)) throw std::runtime_error("can't export " + paths[0]);
+		const double		ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cerr	<< paths[0] << ": " << exporter.getInputCount() << " frames in, " << exporter.getOutputCount()
+					<< " out at " << rate_num << "/" << rate_den << " fps, " << static_cast<int64_t>(ms) << " ms" << std::endl;
+	} catch (std::exception const &ex) {
+		std::cerr << "gif_export: " << ex.what() << std::endl;
+		result = 1;
+	}
+	if (file != stdout) std::fclose(file);
+	return result;
+}
@@ -0,0 +1,89 @@
+// gif_resize: resize a GIF file with gif::ResizePipeline.
+// Builds from the gif_io library alone, see the README.
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include "gif_io/gif_file.h"
+#include "gif_io/gif_pipeline.h"
+
+namespace {
+
+void		usage() {
+	std::cout	<< "usage: gif_resize [options] input.gif output.gif" << std::endl
+				<< "  --width N       output width, height follows unless given" << std::endl
+				<< "  --height N      output height, width follows unless given" << std::endl
+				<< "  --scale F       scale both sides, i.e. 0.5" << std::endl
+				<< "  --effort E      fast (default), balanced or best" << std::endl
+				<< "  --quality Q     lossy encoding, 0 to 100 (default, lossless)" << std::endl
+				<< "  --local         a color table per frame instead of a global one" << std::endl
+				<< "  --diff          only write the area of each frame that changed" << std::endl
+				<< "  --async         write the file on its own thread" << std::endl
+				<< "  --queue N       frames held between stages (default 2), 2 * N + 4 in memory at most" << std::endl;
+}
+
+size_t		file_size(const std::string &path) {
+	std::ifstream	f(path, std::ios::binary | std::ios::ate);
+	return f ? static_cast<size_t>(f.tellg()) : 0;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+	gif::ResizePipeline		pipeline;
+	gif::LzwWriter::Effort	effort = gif::LzwWriter::Effort::kFast;
+	uint32_t				quality = 100;
+	bool					local = false,
+							diff = false,
+							async = false;
+	int32_t					width = 0,
+							height = 0;
+	std::string				paths[2];
+	size_t					path_count = 0;
+
+	for (int k=1; k<argc; ++k) {
+		const std::string	arg(argv[k]);
+		const bool			has_value = k + 1 < argc;
+		if (arg == "--width" && has_value) width = std::atoi(argv[++k]);
+		else if (arg == "--height" && has_value) height = std::atoi(argv[++k]);
+		else if (arg == "--scale" && has_value) pipeline.setScale(std::atof(argv[++k]));
+		else if (arg == "--quality" && has_value) quality = static_cast<uint32_t>(std::atoi(argv[++k]));
+		else if (arg == "--queue" && has_value) pipeline.setQueueSize(static_cast<size_t>(std::atoi(argv[++k])));
+		else if (arg == "--local") local = true;
+		else if (arg == "--diff") diff = true;
+		else if (arg == "--async") async = true;
+		else if (arg == "--effort" && has_value) {
+			const std::string	e(argv[++k]);
+			if (e == "fast") effort = gif::LzwWriter::Effort::kFast;
+			else if (e == "balanced") effort = gif::LzwWriter::Effort::kBalanced;
+			else if (e == "best") effort = gif::LzwWriter::Effort::kBest;
+			else { usage(); return 1; }
+		} else if (arg.size() > 1 && arg[0] == '-') { usage(); return 1; }
+		else if (path_count < 2) paths[path_count++] = arg;
+		else { usage(); return 1; }
+	}
+	if (path_count != 2) { usage(); return 1; }
+	if (width > 0 || height > 0) pipeline.setSize(width, height);
+
+	pipeline.setConfigure([=](gif::Writer &w) {
+		if (local) w.setTableMode(gif::TableMode::kLocalTable);
+		w.setFrameDifferencing(diff).setEffort(effort).setQuality(quality).setAsyncOutput(async);
+	});
+
+	try {
+		const auto			start = std::chrono::steady_clock::now();
+		pipeline.run(paths[0], paths[1]);
+		const double		ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout	<< paths[1] << ": " << pipeline.getWidth() << "x" << pipeline.getHeight()
+					<< ", " << pipeline.getFrameCount() << " frames, " << file_size(paths[1]) << " bytes, "
+					<< static_cast<int64_t>(ms) << " ms, peak " << pipeline.getPeakFrames() << " frames in memory" << std::endl;
+	} catch (std::exception const &ex) {
+		std::cerr << "gif_resize: " << ex.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}